@@ -1,7 +1,10 @@
 #include "is_utf8.h"
 #include "simdutf.h"
+#include <algorithm>
 #include <assert.h>
 #include <chrono>
+#include <thread>
+#include <vector>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -244,8 +247,205 @@ bool bench(size_t N) {
   return isgood;
 }
 
+bool batch_bench(size_t count, size_t max_length) {
+  printf("random UTF-8, batch of short strings\n");
+  printf("%zu strings of 1 to %zu bytes\n", count, max_length);
+  std::vector<char> storage(count * (max_length + 4) + 1);
+  std::vector<const char *> ptrs(count);
+  std::vector<size_t> lens(count);
+  std::vector<uint8_t> results(count);
+  size_t volume = 0;
+  char *p = storage.data();
+  for (size_t i = 0; i < count; i++) {
+    ptrs[i] = p;
+    lens[i] = populate_utf8(p, 1 + size_t(rand()) % max_length);
+    volume += lens[i];
+    p += lens[i];
+  }
+  volatile bool isgood{true};
+
+  {
+    uint64_t start = nano();
+    uint64_t finish = start;
+    size_t iterations{0};
+    uint64_t threshold = 500000000;
+    for (; finish - start < threshold;) {
+      iterations++;
+      for (size_t i = 0; i < count; i++) {
+        isgood &= is_utf8(ptrs[i], lens[i]);
+      }
+      finish = nano();
+    }
+    double t = double(finish - start) / double(iterations * count);
+    printf("is_utf8 (loop)        %f ns/string %f GB/s\n", t,
+           (volume * iterations) / double(finish - start));
+  }
+
+  {
+    uint64_t start = nano();
+    uint64_t finish = start;
+    size_t iterations{0};
+    uint64_t threshold = 500000000;
+    for (; finish - start < threshold;) {
+      iterations++;
+      isgood &= is_utf8_batch(ptrs.data(), lens.data(), count,
+                              results.data()) == count;
+      finish = nano();
+    }
+    double t = double(finish - start) / double(iterations * count);
+    printf("is_utf8_batch         %f ns/string %f GB/s\n", t,
+           (volume * iterations) / double(finish - start));
+  }
+  printf("\n");
+  return isgood;
+}
+
+bool parallel_bench(size_t N) {
+  printf("random UTF-8, multiple threads\n");
+  printf("string size = %zu \n", N);
+  char *input = new char[N + 4];
+  N = populate_utf8(input, N);
+  volatile bool isgood{true};
+  size_t max_threads = std::thread::hardware_concurrency();
+  if (max_threads == 0) {
+    max_threads = 1;
+  }
+  double single = 0;
+  for (size_t threads = 1;; threads = std::min(2 * threads, max_threads)) {
+    uint64_t start = nano();
+    uint64_t finish = start;
+    size_t count{0};
+    uint64_t threshold = 500000000;
+    for (; finish - start < threshold;) {
+      count++;
+      isgood &= is_utf8_parallel(input, N, threads);
+      finish = nano();
+    }
+    double t = (N * count) / double(finish - start);
+    if (threads == 1) {
+      single = t;
+    }
+    printf("is_utf8_parallel %3zu threads  %f GB/s (x%.2f)\n", threads, t,
+           t / single);
+    if (threads == max_threads) {
+      break;
+    }
+  }
+  delete[] input;
+  printf("\n");
+  return isgood;
+}
+
+// Time to reject an input having a single error, as a function of where the
+// error is.
+bool early_exit_bench(size_t N) {
+  printf("random UTF-8 with one error, time to reject\n");
+  printf("string size = %zu \n", N);
+  char *input = new char[N + 4];
+  N = populate_utf8(input, N);
+  volatile bool isgood{true};
+  printf("%12s %18s %18s\n", "error at", "is_utf8 (us)", "early_exit (us)");
+  // The last row (no error) is the cost for valid inputs.
+  for (size_t pos = 0;; pos = pos == 0 ? 1024 : pos * 8) {
+    pos = std::min(pos, N);
+    char saved = input[pos];
+    if (pos < N) {
+      input[pos] = char(0xFF);
+    }
+    bool expected = pos == N;
+    double timings[2];
+    for (size_t which = 0; which < 2; which++) {
+      uint64_t start = nano();
+      uint64_t finish = start;
+      size_t count{0};
+      uint64_t threshold = 200000000;
+      for (; finish - start < threshold;) {
+        count++;
+        isgood &= (which == 0 ? is_utf8(input, N)
+                              : is_utf8_early_exit(input, N)) == expected;
+        finish = nano();
+      }
+      timings[which] = double(finish - start) / double(count) / 1000.0;
+    }
+    input[pos] = saved;
+    if (pos < N) {
+      printf("%12zu %18.2f %18.2f\n", pos, timings[0], timings[1]);
+    } else {
+      printf("%12s %18.2f %18.2f\n", "none", timings[0], timings[1]);
+      break;
+    }
+  }
+  delete[] input;
+  printf("\n");
+  return isgood;
+}
+
+// A plain loop, as found in many code bases.
+static never_inline bool basic_validate_utf16le(const char16_t *input,
+                                                size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    uint16_t word = input[i];
+    if ((word & 0xF800) == 0xD800) {
+      if (word >= 0xDC00 || i + 1 == length ||
+          (input[i + 1] & 0xFC00) != 0xDC00) {
+        return false;
+      }
+      i++;
+    }
+  }
+  return true;
+}
+
+bool utf16_bench(size_t N) {
+  printf("random UTF-16LE (from random UTF-8)\n");
+  char *utf8 = new char[N + 4];
+  size_t utf8_length = populate_utf8(utf8, N);
+  std::vector<char16_t> input(is_utf8_utf16_length(utf8, utf8_length));
+  is_utf8_to_utf16le(utf8, utf8_length, input.data());
+  delete[] utf8;
+  printf("string size = %zu code units\n", input.size());
+  size_t bytes = input.size() * sizeof(char16_t);
+  volatile bool isgood{true};
+
+  {
+    uint64_t start = nano();
+    uint64_t finish = start;
+    size_t count{0};
+    uint64_t threshold = 500000000;
+    for (; finish - start < threshold;) {
+      count++;
+      isgood &= basic_validate_utf16le(input.data(), input.size());
+      finish = nano();
+    }
+    double t = (bytes * count) / double(finish - start);
+
+    printf("basic_validate_utf16le %f GB/s\n", t);
+  }
+
+  {
+    uint64_t start = nano();
+    uint64_t finish = start;
+    size_t count{0};
+    uint64_t threshold = 500000000;
+    for (; finish - start < threshold;) {
+      count++;
+      isgood &= is_utf16le_valid(input.data(), input.size());
+      finish = nano();
+    }
+    double t = (bytes * count) / double(finish - start);
+
+    printf("is_utf16le_valid       %f GB/s\n", t);
+  }
+  printf("\n");
+  return isgood;
+}
+
 int main() {
   return (bench(40096) & bench(100000) & bench(50000))
   & (zerobuffer_bench(40096) & zerobuffer_bench(100000) & zerobuffer_bench(50000))
+  & (batch_bench(10000, 16) & batch_bench(10000, 64) & batch_bench(10000, 200))
+  & parallel_bench(size_t(256) << 20)
+  & (utf16_bench(40096) & utf16_bench(100000))
+  & early_exit_bench(size_t(50) << 20)
   ? EXIT_SUCCESS : EXIT_FAILURE;
 }
\ No newline at end of file
@@ -0,0 +1,236 @@
+#ifndef IS_UTF8_BENCHMARKS_CORPUS_H
+#define IS_UTF8_BENCHMARKS_CORPUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <random>
+#include <string>
+#include <vector>
+
+// Synthetic corpora imitating real-world text in various scripts. They are
+// generated locally (no download) and deterministically: the same size gives
+// the same bytes on every run. All of them are valid UTF-8.
+namespace corpus {
+
+struct text {
+  const char *name;
+  std::string data;
+};
+
+inline void append_code_point(std::string &out, uint32_t code_point) {
+  if (code_point < 0x80) {
+    out += char(code_point);
+  } else if (code_point < 0x800) {
+    out += char(0xC0 | (code_point >> 6));
+    out += char(0x80 | (code_point & 0x3F));
+  } else if (code_point < 0x10000) {
+    out += char(0xE0 | (code_point >> 12));
+    out += char(0x80 | ((code_point >> 6) & 0x3F));
+    out += char(0x80 | (code_point & 0x3F));
+  } else {
+    out += char(0xF0 | (code_point >> 18));
+    out += char(0x80 | ((code_point >> 12) & 0x3F));
+    out += char(0x80 | ((code_point >> 6) & 0x3F));
+    out += char(0x80 | (code_point & 0x3F));
+  }
+}
+
+inline uint32_t pick(std::mt19937 &gen, uint32_t first, uint32_t last) {
+  return std::uniform_int_distribution<uint32_t>(first, last)(gen);
+}
+
+// A sentence of words whose letters are drawn from [first, last], with a
+// few other letters (e.g., accented ones) mixed in.
+inline void append_sentence(std::string &out, std::mt19937 &gen,
+                            uint32_t first, uint32_t last,
+                            const std::vector<uint32_t> &others = {},
+                            uint32_t comma = ',') {
+  size_t words = pick(gen, 4, 16);
+  for (size_t w = 0; w < words; w++) {
+    size_t letters = pick(gen, 1, 10);
+    for (size_t l = 0; l < letters; l++) {
+      if (!others.empty() && pick(gen, 0, 99) < 8) {
+        uint32_t other = pick(gen, 0, uint32_t(others.size() - 1));
+        append_code_point(out, others[other]);
+      } else {
+        append_code_point(out, pick(gen, first, last));
+      }
+    }
+    if (w + 1 < words) {
+      if (pick(gen, 0, 9) == 0) {
+        append_code_point(out, comma);
+      }
+      out += ' ';
+    }
+  }
+  out += ". ";
+}
+
+inline void append_latin(std::string &out, std::mt19937 &gen) {
+  // é è à ç ü ö ä ß ñ ø å
+  static const std::vector<uint32_t> accented{
+      0xE9, 0xE8, 0xE0, 0xE7, 0xFC, 0xF6, 0xE4, 0xDF, 0xF1, 0xF8, 0xE5};
+  append_sentence(out, gen, 'a', 'z', accented);
+}
+
+inline void append_cyrillic(std::string &out, std::mt19937 &gen) {
+  append_sentence(out, gen, 0x430, 0x44F);
+}
+
+inline void append_arabic(std::string &out, std::mt19937 &gen) {
+  append_sentence(out, gen, 0x621, 0x64A, {}, 0x60C); // Arabic comma
+}
+
+// No spaces between words, ideographic comma and full stop.
+inline void append_cjk(std::string &out, std::mt19937 &gen) {
+  size_t characters = pick(gen, 8, 40);
+  for (size_t c = 0; c < characters; c++) {
+    append_code_point(out, pick(gen, 0x4E00, 0x9FFF));
+    if (pick(gen, 0, 11) == 0) {
+      append_code_point(out, 0x3001);
+    }
+  }
+  append_code_point(out, 0x3002);
+}
+
+// Short messages, mostly ASCII, with emoji (some of them with a skin tone).
+inline void append_emoji(std::string &out, std::mt19937 &gen) {
+  size_t words = pick(gen, 2, 10);
+  for (size_t w = 0; w < words; w++) {
+    size_t letters = pick(gen, 1, 8);
+    for (size_t l = 0; l < letters; l++) {
+      out += char(pick(gen, 'a', 'z'));
+    }
+    out += ' ';
+    if (pick(gen, 0, 2) == 0) {
+      append_code_point(out, pick(gen, 0x1F300, 0x1F64F));
+      if (pick(gen, 0, 4) == 0) {
+        append_code_point(out, pick(gen, 0x1F3FB, 0x1F3FF));
+      }
+      out += ' ';
+    }
+  }
+  out += '\n';
+}
+
+inline void append_any_script(std::string &out, std::mt19937 &gen) {
+  switch (pick(gen, 0, 4)) {
+  case 0:
+    append_latin(out, gen);
+    break;
+  case 1:
+    append_cyrillic(out, gen);
+    break;
+  case 2:
+    append_arabic(out, gen);
+    break;
+  case 3:
+    append_cjk(out, gen);
+    break;
+  default:
+    append_emoji(out, gen);
+  }
+}
+
+// Markup (ASCII) around short texts in any script.
+inline void append_html(std::string &out, std::mt19937 &gen) {
+  out += "<div class=\"item-" + std::to_string(pick(gen, 0, 999)) + "\">\n";
+  out += "  <a href=\"https://example.com/articles/" +
+         std::to_string(pick(gen, 0, 99999)) + "?ref=home\">";
+  append_any_script(out, gen);
+  out += "</a>\n  <p>";
+  append_any_script(out, gen);
+  out += "</p>\n</div>\n";
+}
+
+// One JSON object per line: ASCII keys and values, a message that is
+// sometimes in another script.
+inline void append_json_log(std::string &out, std::mt19937 &gen) {
+  static const char *levels[] = {"DEBUG", "INFO", "INFO", "WARN", "ERROR"};
+  char timestamp[64];
+  snprintf(timestamp, sizeof(timestamp),
+           "2023-%02u-%02uT%02u:%02u:%02u.%03uZ", pick(gen, 1, 12),
+           pick(gen, 1, 28), pick(gen, 0, 23), pick(gen, 0, 59),
+           pick(gen, 0, 59), pick(gen, 0, 999));
+  out += "{\"ts\":\"";
+  out += timestamp;
+  out += "\",\"level\":\"";
+  out += levels[pick(gen, 0, 4)];
+  out += "\",\"service\":\"api-" + std::to_string(pick(gen, 1, 9));
+  out += "\",\"request_id\":\"" + std::to_string(gen()) + "\",\"msg\":\"";
+  if (pick(gen, 0, 3) == 0) {
+    append_any_script(out, gen);
+  } else {
+    append_sentence(out, gen, 'a', 'z');
+  }
+  if (!out.empty() && out.back() == '\n') {
+    out.pop_back();
+  }
+  out += "\",\"latency_ms\":" + std::to_string(pick(gen, 0, 5000)) + "}\n";
+}
+
+// One line of a web server access log: ASCII but for a rare user name with
+// an accented letter (one line in 32).
+inline void append_access_log(std::string &out, std::mt19937 &gen) {
+  static const char *users[] = {"alice", "bob", "carol", "dave", "-", "-"};
+  static const char *accented_users[] = {"jos\xC3\xA9", "zo\xC3\xAB",
+                                         "fran\xC3\xA7ois",
+                                         "m\xC3\xBCller"};
+  static const char *paths[] = {"/", "/api/v1/users/", "/static/app.js?v=",
+                                "/images/logo.png?w=", "/search?q=item"};
+  char line[256];
+  snprintf(line, sizeof(line), "10.%u.%u.%u - ", pick(gen, 0, 255),
+           pick(gen, 0, 255), pick(gen, 1, 254));
+  out += line;
+  out += pick(gen, 0, 31) == 0 ? accented_users[pick(gen, 0, 3)]
+                               : users[pick(gen, 0, 5)];
+  snprintf(line, sizeof(line),
+           " [%02u/Oct/2023:%02u:%02u:%02u +0000] \"GET %s%u HTTP/1.1\" %u "
+           "%u \"https://example.com/\" \"Mozilla/5.0 (X11; Linux x86_64; "
+           "rv:109.0) Gecko/20100101 Firefox/118.0\"\n",
+           pick(gen, 1, 28), pick(gen, 0, 23), pick(gen, 0, 59),
+           pick(gen, 0, 59), paths[pick(gen, 0, 4)], pick(gen, 0, 99999),
+           pick(gen, 0, 9) == 0 ? 404u : 200u, pick(gen, 100, 99999));
+  out += line;
+}
+
+// Cuts the text to at most size bytes, at a character boundary.
+inline void truncate(std::string &out, size_t size) {
+  if (out.size() <= size) {
+    return;
+  }
+  while (size > 0 && (uint8_t(out[size]) & 0xC0) == 0x80) {
+    size--;
+  }
+  out.resize(size);
+}
+
+template <typename F> std::string generate(size_t size, uint32_t seed, F f) {
+  std::mt19937 gen(seed);
+  std::string out;
+  out.reserve(size + 256);
+  while (out.size() < size) {
+    f(out, gen);
+  }
+  truncate(out, size);
+  return out;
+}
+
+// All the corpora, each of (nearly) size bytes.
+inline std::vector<text> all(size_t size) {
+  return {
+      {"latin", generate(size, 1, append_latin)},
+      {"cyrillic", generate(size, 2, append_cyrillic)},
+      {"cjk", generate(size, 3, append_cjk)},
+      {"arabic", generate(size, 4, append_arabic)},
+      {"emoji", generate(size, 5, append_emoji)},
+      {"html", generate(size, 6, append_html)},
+      {"json_logs", generate(size, 7, append_json_log)},
+      {"access_logs", generate(size, 8, append_access_log)},
+  };
+}
+
+} // namespace corpus
+
+#endif // IS_UTF8_BENCHMARKS_CORPUS_H
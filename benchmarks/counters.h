@@ -0,0 +1,118 @@
+#ifndef IS_UTF8_BENCHMARKS_COUNTERS_H
+#define IS_UTF8_BENCHMARKS_COUNTERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <array>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define IS_UTF8_BENCH_HAS_PERF 1
+#endif
+
+// Hardware performance counters of the calling thread, read with Linux
+// perf_event_open. Each event is optional: an event that the system does not
+// let us count (no PMU in a virtual machine, perf_event_paranoid, other
+// operating systems...) is reported as unavailable, and the benchmarks fall
+// back to the clocks.
+namespace counters {
+
+enum event {
+  CYCLES,
+  INSTRUCTIONS,
+  BRANCH_MISSES,
+  L1D_MISSES, // level 1 data cache, read misses
+  LLC_MISSES, // last level cache
+  EVENT_COUNT
+};
+
+inline const char *event_name(size_t e) {
+  static const char *names[EVENT_COUNT] = {
+      "cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses"};
+  return names[e];
+}
+
+typedef std::array<double, EVENT_COUNT> snapshot;
+
+class event_counters {
+public:
+  event_counters() {
+    fds.fill(-1);
+#ifdef IS_UTF8_BENCH_HAS_PERF
+    const uint32_t types[EVENT_COUNT] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                                         PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+                                         PERF_TYPE_HARDWARE};
+    const uint64_t configs[EVENT_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_CACHE_MISSES};
+    for (size_t e = 0; e < EVENT_COUNT; e++) {
+      perf_event_attr attr{};
+      attr.size = sizeof(attr);
+      attr.type = types[e];
+      attr.config = configs[e];
+      // user space only: allowed with the default perf_event_paranoid
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      // to scale the counts if the events do not all fit in the PMU
+      attr.read_format =
+          PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      fds[e] = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+#endif
+  }
+
+  ~event_counters() {
+#ifdef IS_UTF8_BENCH_HAS_PERF
+    for (int fd : fds) {
+      if (fd != -1) {
+        close(fd);
+      }
+    }
+#endif
+  }
+
+  event_counters(const event_counters &) = delete;
+  event_counters &operator=(const event_counters &) = delete;
+
+  bool available(size_t e) const { return fds[e] != -1; }
+
+  bool any_available() const {
+    for (size_t e = 0; e < EVENT_COUNT; e++) {
+      if (available(e)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // The counts so far, zero for the unavailable events: subtract two
+  // snapshots to count the events in between.
+  snapshot read() const {
+    snapshot values{};
+#ifdef IS_UTF8_BENCH_HAS_PERF
+    for (size_t e = 0; e < EVENT_COUNT; e++) {
+      uint64_t buffer[3]; // value, time enabled, time running
+      if (fds[e] == -1 ||
+          ::read(fds[e], buffer, sizeof(buffer)) != sizeof(buffer)) {
+        continue;
+      }
+      values[e] = buffer[2] == 0 ? 0
+                                 : double(buffer[0]) * double(buffer[1]) /
+                                       double(buffer[2]);
+    }
+#endif
+    return values;
+  }
+
+private:
+  std::array<int, EVENT_COUNT> fds;
+};
+
+} // namespace counters
+
+#endif // IS_UTF8_BENCHMARKS_COUNTERS_H
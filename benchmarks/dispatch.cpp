@@ -0,0 +1,53 @@
+#include "is_utf8.h"
+#include "timer.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// The dispatch through the active implementation (function-local static,
+// sequentially consistent atomic load and virtual call), which is_utf8 used
+// before caching the validation function.
+namespace is_utf8_internals {
+bool validate_utf8(const char *buf, size_t len) noexcept;
+}
+
+template <typename F>
+double ns_per_call(const std::vector<char> &data, size_t length, F f) {
+  size_t count = data.size() / length;
+  volatile bool isgood{true};
+  double best = 1e9;
+  for (size_t trial = 0; trial < 10; trial++) {
+    uint64_t start = nano();
+    for (size_t i = 0; i < count; i++) {
+      isgood &= f(data.data() + i * length, length);
+    }
+    uint64_t finish = nano();
+    double t = double(finish - start) / double(count);
+    if (t < best) {
+      best = t;
+    }
+  }
+  if (!isgood) {
+    printf("bug\n");
+  }
+  return best;
+}
+
+int main() {
+  // Many distinct strings, so that the input does not stay in registers.
+  std::vector<char> data(size_t(1) << 20);
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = char('a' + rand() % 26);
+  }
+  for (size_t length : {1, 8, 16, 32}) {
+    printf("%zu-byte inputs\n", length);
+    printf("is_utf8 (cached function)         %f ns/call\n",
+           ns_per_call(data, length, is_utf8));
+    printf("active implementation (virtual)   %f ns/call\n",
+           ns_per_call(data, length, is_utf8_internals::validate_utf8));
+    printf("\n");
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,226 @@
+// Throughput of the scalar validation of the fallback kernel, which runs
+// four interleaved streams through a shift-based DFA, next to two byte-at-a-time
+// routines: the previous fallback (a branchy decoder with a 16-byte ASCII
+// fast path), and the Guava-style basic_validate_utf8 of bench.cpp. All three
+// are scalar code: this is what targets without SIMD kernels get.
+//
+// Usage: fallback [corpus size in bytes, default 64 KiB]
+// Prints CSV: one line per corpus and routine.
+#include "is_utf8.cpp"
+
+#include "corpus.h"
+#include "timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _MSC_VER
+#define never_inline __declspec(noinline)
+#else
+#define never_inline __attribute__((noinline))
+#endif
+
+namespace {
+
+// copied in part from Guava, as in bench.cpp
+never_inline bool basic_validate_utf8(const char *b, size_t length) {
+  const unsigned char *bytes = (const unsigned char *)b;
+  for (size_t index = 0;;) {
+    unsigned char byte1;
+
+    do { // fast ASCII Path
+      if (index >= length) {
+        return true;
+      }
+      byte1 = bytes[index++];
+    } while (byte1 < 0x80);
+    if (byte1 < 0xE0) {
+      // Two-byte form.
+      if (index == length) {
+        return false;
+      }
+      if (byte1 < 0xC2 || bytes[index++] > 0xBF) {
+        return false;
+      }
+    } else if (byte1 < 0xF0) {
+      // Three-byte form.
+      if (index + 1 >= length) {
+        return false;
+      }
+      unsigned char byte2 = bytes[index++];
+      if (byte2 > 0xBF
+          // Overlong? 5 most significant bits must not all be zero.
+          || (byte1 == 0xE0 && byte2 < 0xA0)
+          // Check for illegal surrogate codepoints.
+          || (byte1 == 0xED && 0xA0 <= byte2)
+          // Third byte trailing-byte test.
+          || bytes[index++] > 0xBF) {
+        return false;
+      }
+    } else {
+
+      // Four-byte form.
+      if (index + 2 >= length) {
+        return false;
+      }
+      int byte2 = bytes[index++];
+      if (byte2 > 0xBF
+          // Check that 1 <= plane <= 16. Tricky optimized form of:
+          // if (byte1 > (byte) 0xF4
+          //     || byte1 == (byte) 0xF0 && byte2 < (byte) 0x90
+          //     || byte1 == (byte) 0xF4 && byte2 > (byte) 0x8F)
+          || (((byte1 << 28) + (byte2 - 0x90)) >> 30) != 0
+          // Third byte trailing-byte test
+          || bytes[index++] > 0xBF
+          // Fourth byte trailing-byte test
+          || bytes[index++] > 0xBF) {
+        return false;
+      }
+    }
+  }
+}
+
+#if !IS_UTF8_IS_ARM64
+// The scalar validation of the fallback kernel, before the DFA.
+// credit: based on code from Google Fuchsia (Apache Licensed)
+never_inline bool previous_fallback(const char *buf, size_t len) {
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(buf);
+  uint64_t pos = 0;
+  uint32_t code_point = 0;
+  while (pos < len) {
+    // check of the next 8 bytes are ascii.
+    uint64_t next_pos = pos + 16;
+    if (next_pos <=
+        len) { // if it is safe to read 8 more bytes, check that they are ascii
+      uint64_t v1;
+      std::memcpy(&v1, data + pos, sizeof(uint64_t));
+      uint64_t v2;
+      std::memcpy(&v2, data + pos + sizeof(uint64_t), sizeof(uint64_t));
+      uint64_t v{v1 | v2};
+      if ((v & 0x8080808080808080) == 0) {
+        pos = next_pos;
+        continue;
+      }
+    }
+    unsigned char byte = data[pos];
+
+    while (byte < 0b10000000) {
+      if (++pos == len) {
+        return true;
+      }
+      byte = data[pos];
+    }
+
+    if ((byte & 0b11100000) == 0b11000000) {
+      next_pos = pos + 2;
+      if (next_pos > len) {
+        return false;
+      }
+      if ((data[pos + 1] & 0b11000000) != 0b10000000) {
+        return false;
+      }
+      // range check
+      code_point = (byte & 0b00011111) << 6 | (data[pos + 1] & 0b00111111);
+      if ((code_point < 0x80) || (0x7ff < code_point)) {
+        return false;
+      }
+    } else if ((byte & 0b11110000) == 0b11100000) {
+      next_pos = pos + 3;
+      if (next_pos > len) {
+        return false;
+      }
+      if ((data[pos + 1] & 0b11000000) != 0b10000000) {
+        return false;
+      }
+      if ((data[pos + 2] & 0b11000000) != 0b10000000) {
+        return false;
+      }
+      // range check
+      code_point = (byte & 0b00001111) << 12 |
+                   (data[pos + 1] & 0b00111111) << 6 |
+                   (data[pos + 2] & 0b00111111);
+      if ((code_point < 0x800) || (0xffff < code_point) ||
+          (0xd7ff < code_point && code_point < 0xe000)) {
+        return false;
+      }
+    } else if ((byte & 0b11111000) == 0b11110000) { // 0b11110000
+      next_pos = pos + 4;
+      if (next_pos > len) {
+        return false;
+      }
+      if ((data[pos + 1] & 0b11000000) != 0b10000000) {
+        return false;
+      }
+      if ((data[pos + 2] & 0b11000000) != 0b10000000) {
+        return false;
+      }
+      if ((data[pos + 3] & 0b11000000) != 0b10000000) {
+        return false;
+      }
+      // range check
+      code_point =
+          (byte & 0b00000111) << 18 | (data[pos + 1] & 0b00111111) << 12 |
+          (data[pos + 2] & 0b00111111) << 6 | (data[pos + 3] & 0b00111111);
+      if (code_point <= 0xffff || 0x10ffff < code_point) {
+        return false;
+      }
+    } else {
+      // we may have a continuation
+      return false;
+    }
+    pos = next_pos;
+  }
+  return true;
+}
+#endif
+
+// Best of many runs, each long enough for the clock to be precise.
+template <typename F> double measure(const std::string &data, F validate) {
+  volatile bool isgood{true};
+  isgood &= validate(data.data(), data.size()); // warm up
+  double best_ns = 1e300;
+  size_t repeat = 1 + (size_t(1) << 20) / (data.size() + 1);
+  uint64_t deadline = nano() + 200000000;
+  do {
+    uint64_t start = nano();
+    for (size_t i = 0; i < repeat; i++) {
+      isgood &= validate(data.data(), data.size());
+    }
+    uint64_t finish = nano();
+    double ns = double(finish - start) / double(repeat);
+    if (ns < best_ns) {
+      best_ns = ns;
+    }
+  } while (nano() < deadline);
+  if (!isgood) {
+    fprintf(stderr, "a valid corpus was rejected\n");
+    exit(EXIT_FAILURE);
+  }
+  return double(data.size()) / best_ns;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t size = argc > 1 ? size_t(strtoull(argv[1], nullptr, 10)) : 1 << 16;
+  const is_utf8_internals::implementation *fallback =
+      is_utf8_internals::get_available_implementations()["fallback"];
+  if (fallback == nullptr) {
+    fprintf(stderr, "the fallback kernel is not built on this target\n");
+    return EXIT_FAILURE;
+  }
+  printf("corpus,routine,gb_per_s\n");
+  for (const corpus::text &text : corpus::all(size)) {
+    printf("%s,basic_validate_utf8,%.3f\n", text.name,
+           measure(text.data, basic_validate_utf8));
+#if !IS_UTF8_IS_ARM64
+    printf("%s,previous_fallback,%.3f\n", text.name,
+           measure(text.data, previous_fallback));
+#endif
+    printf("%s,fallback,%.3f\n", text.name,
+           measure(text.data, [&](const char *buf, size_t len) {
+             return fallback->validate_utf8(buf, len);
+           }));
+    fflush(stdout);
+  }
+  return EXIT_SUCCESS;
+}
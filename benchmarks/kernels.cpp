@@ -0,0 +1,152 @@
+// Throughput of each kernel supported by this machine, on corpora in various
+// scripts. The source is included to reach the kernels themselves, as
+// listed by get_available_implementations(), instead of the one selected at
+// runtime.
+//
+// Usage: kernels [corpus size in bytes, default 1 MiB]
+// Prints JSON: one result per corpus and kernel. On Linux, the hardware
+// performance counters are reported when they are available (see counters.h),
+// null otherwise.
+#include "is_utf8.cpp"
+
+#include "corpus.h"
+#include "counters.h"
+#include "timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define IS_UTF8_BENCH_HAS_TSC 1
+#endif
+
+namespace {
+
+// Time stamp counter: the reference cycles of the processor, which only match
+// the core cycles when the frequency is the nominal one.
+uint64_t tsc() {
+#ifdef IS_UTF8_BENCH_HAS_TSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+struct measurement {
+  double gb_per_s;
+  double tsc_per_byte;
+  counters::snapshot events; // per call
+};
+
+// Best of many runs, each long enough for the clocks to be precise. The
+// events are those of the fastest run.
+measurement measure(const is_utf8_internals::implementation &impl,
+                    const std::string &data,
+                    const counters::event_counters &events) {
+  volatile bool isgood{true};
+  isgood &= impl.validate_utf8(data.data(), data.size()); // warm up
+  measurement best{0, 0, {}};
+  double best_ns = 1e300;
+  uint64_t deadline = nano() + 200000000;
+  size_t repeat = 1 + (size_t(1) << 20) / (data.size() + 1);
+  do {
+    counters::snapshot start_events = events.read();
+    uint64_t start = nano();
+    uint64_t start_tsc = tsc();
+    for (size_t i = 0; i < repeat; i++) {
+      isgood &= impl.validate_utf8(data.data(), data.size());
+    }
+    uint64_t finish_tsc = tsc();
+    uint64_t finish = nano();
+    counters::snapshot finish_events = events.read();
+    double ns = double(finish - start) / double(repeat);
+    if (ns < best_ns) {
+      best_ns = ns;
+      best.gb_per_s = double(data.size()) / ns;
+      best.tsc_per_byte = double(finish_tsc - start_tsc) / double(repeat) /
+                          double(data.size());
+      for (size_t e = 0; e < counters::EVENT_COUNT; e++) {
+        best.events[e] =
+            (finish_events[e] - start_events[e]) / double(repeat);
+      }
+    }
+  } while (nano() < deadline);
+  if (!isgood) {
+    fprintf(stderr, "%s rejected a valid corpus\n", impl.name().c_str());
+    exit(EXIT_FAILURE);
+  }
+  return best;
+}
+
+void print_number_or_null(bool available, const char *format, double value) {
+  if (available) {
+    printf(format, value);
+  } else {
+    printf("null");
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t size = argc > 1 ? size_t(strtoull(argv[1], nullptr, 10)) : 1 << 20;
+  std::vector<corpus::text> corpora = corpus::all(size);
+  counters::event_counters events;
+  // Cycles per byte come from the core cycles if we can count them.
+  bool has_cycles = events.available(counters::CYCLES);
+#ifdef IS_UTF8_BENCH_HAS_TSC
+  const char *cycle_counter = has_cycles ? "perf" : "tsc";
+  bool has_cycles_per_byte = true;
+#else
+  const char *cycle_counter = has_cycles ? "perf" : "none";
+  bool has_cycles_per_byte = has_cycles;
+#endif
+  if (!events.any_available()) {
+    fprintf(stderr, "hardware performance counters unavailable, "
+                    "reporting the clocks only\n");
+  }
+  printf("{\n  \"corpus_size\": %zu,\n  \"cycle_counter\": \"%s\",\n", size,
+         cycle_counter);
+  printf("  \"results\": [");
+  bool first = true;
+  for (const corpus::text &text : corpora) {
+    for (const is_utf8_internals::implementation *impl :
+         is_utf8_internals::get_available_implementations()) {
+      if (!impl->supported_by_runtime_system()) {
+        continue;
+      }
+      measurement m = measure(*impl, text.data, events);
+      double bytes = double(text.data.size());
+      printf("%s\n    {\"corpus\": \"%s\", \"bytes\": %zu, "
+             "\"implementation\": \"%s\", \"gb_per_s\": %.3f, "
+             "\"cycles_per_byte\": ",
+             first ? "" : ",", text.name, text.data.size(),
+             impl->name().c_str(), m.gb_per_s);
+      print_number_or_null(has_cycles_per_byte, "%.4f",
+                           has_cycles ? m.events[counters::CYCLES] / bytes
+                                      : m.tsc_per_byte);
+      printf(", \"instructions_per_byte\": ");
+      print_number_or_null(events.available(counters::INSTRUCTIONS), "%.4f",
+                           m.events[counters::INSTRUCTIONS] / bytes);
+      printf(", \"instructions_per_cycle\": ");
+      print_number_or_null(has_cycles &&
+                               events.available(counters::INSTRUCTIONS),
+                           "%.3f",
+                           m.events[counters::INSTRUCTIONS] /
+                               m.events[counters::CYCLES]);
+      // per call, i.e., for the whole corpus
+      for (size_t e = 0; e < counters::EVENT_COUNT; e++) {
+        printf(", \"%s\": ", counters::event_name(e));
+        print_number_or_null(events.available(e), "%.0f", m.events[e]);
+      }
+      printf("}");
+      first = false;
+    }
+  }
+  printf("\n  ]\n}\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,240 @@
+// Distribution of the latency of a single call on short strings (1 to 128
+// bytes), as when validating every header and field of RPC messages, for each
+// kernel supported by this machine and for is_utf8 itself. The strings are
+// drawn at random from a large pool of all scripts, so that neither their
+// lengths nor their contents can be learned by the branch predictor.
+//
+// Also measures the cost of the first call, which goes through
+// detect_best_supported_implementation_on_first_use.
+//
+// Usage: latency [number of calls per kernel, default 1000000]
+#include "is_utf8.cpp"
+
+#include "corpus.h"
+#include "timer.h"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define IS_UTF8_BENCH_HAS_TSC 1
+#endif
+
+namespace {
+
+// A timestamp in ticks of the time stamp counter if we have one (the fences
+// keep the measured call between the two reads), of the clock otherwise.
+is_utf8_really_inline uint64_t start_ticks() {
+#ifdef IS_UTF8_BENCH_HAS_TSC
+  _mm_lfence();
+  uint64_t t = __rdtsc();
+  _mm_lfence();
+  return t;
+#else
+  return nano();
+#endif
+}
+
+is_utf8_really_inline uint64_t finish_ticks() {
+#ifdef IS_UTF8_BENCH_HAS_TSC
+  unsigned int aux;
+  uint64_t t = __rdtscp(&aux);
+  _mm_lfence();
+  return t;
+#else
+  return nano();
+#endif
+}
+
+// How to turn a number of ticks into nanoseconds, once the cost of reading
+// the ticks is removed.
+struct calibration {
+  double ns_per_tick;
+  uint64_t overhead; // in ticks, the least of back-to-back reads
+};
+
+calibration calibrate() {
+  calibration c{1, UINT64_MAX};
+  for (size_t i = 0; i < 100000; i++) {
+    uint64_t start = start_ticks();
+    uint64_t finish = finish_ticks();
+    c.overhead = std::min(c.overhead, finish - start);
+  }
+#ifdef IS_UTF8_BENCH_HAS_TSC
+  uint64_t start_ns = nano();
+  uint64_t start = start_ticks();
+  while (nano() - start_ns < 100000000) {
+  }
+  uint64_t finish = finish_ticks();
+  uint64_t finish_ns = nano();
+  c.ns_per_tick = double(finish_ns - start_ns) / double(finish - start);
+#endif
+  return c;
+}
+
+struct string_view {
+  const char *data;
+  size_t length;
+};
+
+// Strings of 1 to 128 bytes cut at character boundaries from the corpora,
+// in random order. They are copied next to each other in storage, which must
+// outlive them, so that the pool fits in the level 2 cache: we measure the
+// call, not the memory.
+std::vector<string_view> pool(const std::string &text, size_t count,
+                              std::string &storage) {
+  std::mt19937 gen(42);
+  std::vector<std::pair<size_t, size_t>> ranges; // in storage
+  while (ranges.size() < count) {
+    // Up to 3 continuation bytes skipped, then up to 128 bytes and the one
+    // after them read.
+    size_t start = corpus::pick(gen, 0, uint32_t(text.size() - 132));
+    while ((uint8_t(text[start]) & 0xC0) == 0x80) {
+      start++;
+    }
+    size_t length = corpus::pick(gen, 1, 128);
+    while (length > 0 && (uint8_t(text[start + length]) & 0xC0) == 0x80) {
+      length--;
+    }
+    if (length > 0) {
+      ranges.push_back({storage.size(), length});
+      storage.append(text, start, length);
+    }
+  }
+  std::vector<string_view> strings;
+  for (const std::pair<size_t, size_t> &range : ranges) {
+    strings.push_back({storage.data() + range.first, range.second});
+  }
+  return strings;
+}
+
+struct percentiles {
+  double p50, p90, p99, p999, max;
+};
+
+// Sorts the samples.
+percentiles summarize(std::vector<uint64_t> &ticks, const calibration &c) {
+  std::sort(ticks.begin(), ticks.end());
+  auto at = [&](double q) {
+    uint64_t t = ticks[std::min(ticks.size() - 1, size_t(q * ticks.size()))];
+    return double(t > c.overhead ? t - c.overhead : 0) * c.ns_per_tick;
+  };
+  return {at(0.5), at(0.9), at(0.99), at(0.999), at(1)};
+}
+
+void print(const char *name, const percentiles &p) {
+  printf("%-28s %8.1f %8.1f %8.1f %8.1f %10.1f\n", name, p.p50, p.p90, p.p99,
+         p.p999, p.max);
+}
+
+template <typename F>
+percentiles measure(const std::vector<string_view> &strings, size_t calls,
+                    const calibration &c, F validate) {
+  volatile bool isgood{true};
+  for (const string_view &s : strings) { // warm up
+    isgood &= validate(s.data, s.length);
+  }
+  std::vector<uint64_t> ticks(calls);
+  for (size_t i = 0; i < calls; i++) {
+    const string_view &s = strings[i % strings.size()];
+    uint64_t start = start_ticks();
+    isgood &= validate(s.data, s.length);
+    uint64_t finish = finish_ticks();
+    ticks[i] = finish - start;
+  }
+  if (!isgood) {
+    fprintf(stderr, "a valid string was rejected\n");
+    exit(EXIT_FAILURE);
+  }
+  return summarize(ticks, c);
+}
+
+// Puts back the state of the library before its first call: the next call
+// detects the best implementation again.
+void forget_implementation() {
+  is_utf8_internals::get_active_implementation() =
+      &is_utf8_internals::internal::
+          detect_best_supported_implementation_on_first_use_singleton;
+#if defined(IS_UTF8_NO_THREADS)
+  is_utf8_internals::internal::validate_utf8_function_cache =
+      &is_utf8_internals::internal::validate_utf8_on_first_use;
+  is_utf8_internals::internal::size_class_dispatch = false;
+#else
+  is_utf8_internals::internal::validate_utf8_function_cache.store(
+      &is_utf8_internals::internal::validate_utf8_on_first_use);
+  is_utf8_internals::internal::size_class_dispatch.store(false);
+#endif
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  // Before anything else, the very first call of the process.
+  const char *first = "a";
+  uint64_t first_start = start_ticks();
+  volatile bool isgood = is_utf8(first, 1);
+  uint64_t first_finish = finish_ticks();
+  uint64_t second_start = start_ticks();
+  isgood = isgood & is_utf8(first, 1);
+  uint64_t second_finish = finish_ticks();
+
+  size_t calls =
+      argc > 1 ? size_t(strtoull(argv[1], nullptr, 10)) : size_t(1000000);
+  if (calls == 0) {
+    fprintf(stderr, "the number of calls must be positive\n");
+    return EXIT_FAILURE;
+  }
+  calibration c = calibrate();
+  std::string text;
+  for (const corpus::text &t : corpus::all(size_t(1) << 20)) {
+    text += t.data;
+  }
+  std::string storage;
+  std::vector<string_view> strings = pool(text, size_t(1) << 13, storage);
+
+#ifdef IS_UTF8_BENCH_HAS_TSC
+  printf("clock: time stamp counter, %.3f ns per tick, ", c.ns_per_tick);
+#else
+  printf("clock: steady_clock, ");
+#endif
+  printf("%.1f ns of overhead removed\n\n",
+         double(c.overhead) * c.ns_per_tick);
+  printf("first call: %.1f ns, second call: %.1f ns\n",
+         double(first_finish - first_start - c.overhead) * c.ns_per_tick,
+         double(second_finish - second_start - c.overhead) * c.ns_per_tick);
+
+  // The first call again, without the initialization of the static
+  // variables: getenv, CPU detection and caching of the validation function.
+  std::vector<uint64_t> ticks(std::min(calls, size_t(10000)));
+  for (uint64_t &t : ticks) {
+    forget_implementation();
+    uint64_t start = start_ticks();
+    isgood = isgood & is_utf8(first, 1);
+    t = finish_ticks() - start;
+  }
+  printf("\n%-28s %8s %8s %8s %8s %10s\n", "ns per call", "p50", "p90", "p99",
+         "p99.9", "max");
+  print("is_utf8, first call", summarize(ticks, c));
+
+  print("is_utf8", measure(strings, calls, c, is_utf8));
+  for (const is_utf8_internals::implementation *impl :
+       is_utf8_internals::get_available_implementations()) {
+    if (!impl->supported_by_runtime_system()) {
+      continue;
+    }
+    print(impl->name().c_str(),
+          measure(strings, calls, c, [&](const char *buf, size_t len) {
+            return impl->validate_utf8(buf, len);
+          }));
+  }
+  if (!isgood) {
+    fprintf(stderr, "bug\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
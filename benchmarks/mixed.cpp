@@ -0,0 +1,152 @@
+// Throughput of each kernel supported by this machine when its calls alternate
+// with floating-point vector code on the same core, as in a service that
+// validates its requests between numerical work. The 512-bit kernels (icelake,
+// skylake_x) can lower the frequency of the core, and the following code runs
+// at the lower frequency for a while: compare the throughput of the compute
+// loop after each kernel with its throughput alone.
+//
+// Usage: mixed [bytes validated per call, default 64 KiB]
+//              [floats per compute call, default 16384]
+// Prints CSV: one line per kernel, the validation in GB/s and the compute
+// loop in GFLOP/s, both measured while interleaved. The "none" line is the
+// compute loop alone.
+#include "is_utf8.cpp"
+
+#include "corpus.h"
+#include "timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#if (defined(__x86_64__) || defined(_M_X64)) && defined(__GNUC__)
+#include <immintrin.h>
+#define IS_UTF8_BENCH_HAS_AVX2_FMA 1
+#endif
+
+namespace {
+
+// A dot product with eight independent accumulators: two floating-point
+// operations per float and per pass.
+#ifdef IS_UTF8_BENCH_HAS_AVX2_FMA
+__attribute__((target("avx2,fma"))) float compute_avx2(const float *a,
+                                                       const float *b,
+                                                       size_t n) {
+  __m256 sum[8];
+  for (__m256 &s : sum) {
+    s = _mm256_setzero_ps();
+  }
+  size_t i = 0;
+  for (; i + 64 <= n; i += 64) {
+    for (size_t k = 0; k < 8; k++) {
+      sum[k] = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8 * k),
+                               _mm256_loadu_ps(b + i + 8 * k), sum[k]);
+    }
+  }
+  __m256 total = _mm256_setzero_ps();
+  for (__m256 &s : sum) {
+    total = _mm256_add_ps(total, s);
+  }
+  float lanes[8];
+  _mm256_storeu_ps(lanes, total);
+  float result = 0;
+  for (float lane : lanes) {
+    result += lane;
+  }
+  for (; i < n; i++) {
+    result += a[i] * b[i];
+  }
+  return result;
+}
+#endif
+
+float compute(const float *a, const float *b, size_t n) {
+#ifdef IS_UTF8_BENCH_HAS_AVX2_FMA
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return compute_avx2(a, b, n);
+  }
+#endif
+  float sum[8]{};
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    for (size_t k = 0; k < 8; k++) {
+      sum[k] += a[i + k] * b[i + k];
+    }
+  }
+  float result = 0;
+  for (float s : sum) {
+    result += s;
+  }
+  for (; i < n; i++) {
+    result += a[i] * b[i];
+  }
+  return result;
+}
+
+struct measurement {
+  double gb_per_s;
+  double gflop_per_s;
+};
+
+// Alternates calls of validate (if any) and of the compute loop for at least
+// a second, timing each of them separately.
+template <typename F>
+measurement interleave(const std::vector<float> &a,
+                       const std::vector<float> &b, size_t bytes,
+                       F validate) {
+  volatile bool isgood{true};
+  volatile float sink{0};
+  uint64_t validate_ns = 0;
+  uint64_t compute_ns = 0;
+  size_t calls = 0;
+  uint64_t deadline = nano() + 1000000000;
+  do {
+    uint64_t start = nano();
+    isgood &= validate();
+    uint64_t middle = nano();
+    sink = sink + compute(a.data(), b.data(), a.size());
+    uint64_t finish = nano();
+    validate_ns += middle - start;
+    compute_ns += finish - middle;
+    calls++;
+  } while (nano() < deadline);
+  if (!isgood) {
+    fprintf(stderr, "a valid buffer was rejected\n");
+    exit(EXIT_FAILURE);
+  }
+  return {double(calls) * double(bytes) / double(validate_ns),
+          double(calls) * 2 * double(a.size()) / double(compute_ns)};
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t bytes =
+      argc > 1 ? size_t(strtoull(argv[1], nullptr, 10)) : size_t(1) << 16;
+  size_t floats =
+      argc > 2 ? size_t(strtoull(argv[2], nullptr, 10)) : size_t(1) << 14;
+  if (bytes == 0 || floats == 0) {
+    fprintf(stderr, "the sizes must be positive\n");
+    return EXIT_FAILURE;
+  }
+  std::string text = corpus::generate(bytes, 1, corpus::append_latin);
+  text.resize(bytes, ' ');
+  std::vector<float> a(floats), b(floats);
+  for (size_t i = 0; i < floats; i++) {
+    a[i] = float(i % 7) * 0.5f;
+    b[i] = float(i % 5) * 0.25f;
+  }
+  printf("implementation,gb_per_s,gflop_per_s\n");
+  measurement alone = interleave(a, b, bytes, []() { return true; });
+  printf("none,,%.3f\n", alone.gflop_per_s);
+  for (const is_utf8_internals::implementation *impl :
+       is_utf8_internals::get_available_implementations()) {
+    if (!impl->supported_by_runtime_system()) {
+      continue;
+    }
+    measurement m = interleave(a, b, bytes, [&]() {
+      return impl->validate_utf8(text.data(), text.size());
+    });
+    printf("%s,%.3f,%.3f\n", impl->name().c_str(), m.gb_per_s, m.gflop_per_s);
+    fflush(stdout);
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,152 @@
+// Aggregate throughput of each kernel supported by this machine on 1 to N
+// threads, each validating its own buffer, next to the bandwidth of memset and
+// memcpy on the same number of threads. When a kernel follows memcpy, it is
+// memory-bound; when a kernel falls behind another one as threads are added
+// (e.g., icelake behind haswell), the processor lowers its frequency under
+// wide vector load on all cores.
+//
+// Usage: scaling [maximal number of threads, default: one per hardware thread]
+//                [MiB per thread, default: 1.5 times the last level cache]
+// Prints CSV: one line per number of threads and workload. For memcpy, the
+// throughput is that of the bytes copied (each of them read and written).
+#include "is_utf8.cpp"
+
+#include "corpus.h"
+#include "timer.h"
+#include <atomic>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+namespace {
+
+// 64 MiB if the size of the last level cache is unknown.
+size_t default_buffer_size() {
+  size_t size = size_t(64) << 20;
+#if defined(__linux__) && defined(_SC_LEVEL3_CACHE_SIZE)
+  long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+  if (llc > 0 && size_t(llc) + size_t(llc) / 2 > size) {
+    size = size_t(llc) + size_t(llc) / 2;
+  }
+#endif
+  return size;
+}
+
+// Each thread works on its own buffer, of Latin text, and copies or writes to
+// its own scratch buffer, both larger than the last level cache.
+struct thread_buffers {
+  std::unique_ptr<char[]> text;
+  std::unique_ptr<char[]> scratch;
+};
+
+void fill(thread_buffers &buffers, const std::string &unit, size_t size) {
+  buffers.text.reset(new char[size]);
+  buffers.scratch.reset(new char[size]);
+  size_t pos = 0;
+  while (pos + unit.size() <= size) {
+    memcpy(buffers.text.get() + pos, unit.data(), unit.size());
+    pos += unit.size();
+  }
+  // Spaces in place of a final incomplete unit: always valid.
+  memset(buffers.text.get() + pos, ' ', size - pos);
+  memset(buffers.scratch.get(), 0, size);
+}
+
+// Runs f on the buffers of each of the threads, all starting together, each
+// for at least 200 ms and two passes. Returns the sum of the throughputs of
+// the threads in GB/s.
+template <typename F>
+double aggregate(std::vector<thread_buffers> &buffers, size_t threads,
+                 size_t size, F f) {
+  std::atomic<size_t> ready{0};
+  std::vector<double> gb_per_s(threads);
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; t++) {
+    workers.emplace_back([&, t]() {
+      ready++;
+      while (ready.load() < threads) {
+      }
+      size_t passes = 0;
+      uint64_t start = nano();
+      uint64_t finish;
+      do {
+        f(buffers[t]);
+        passes++;
+        finish = nano();
+      } while (passes < 2 || finish - start < 200000000);
+      gb_per_s[t] = double(passes) * double(size) / double(finish - start);
+    });
+  }
+  double total = 0;
+  for (size_t t = 0; t < threads; t++) {
+    workers[t].join();
+    total += gb_per_s[t];
+  }
+  return total;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t max_threads = argc > 1 ? size_t(strtoull(argv[1], nullptr, 10))
+                                : size_t(std::thread::hardware_concurrency());
+  if (max_threads == 0) {
+    max_threads = 1;
+  }
+  size_t size = argc > 2 ? size_t(strtoull(argv[2], nullptr, 10)) << 20
+                         : default_buffer_size();
+  if (size == 0) {
+    fprintf(stderr, "the buffers must not be empty\n");
+    return EXIT_FAILURE;
+  }
+  std::string unit =
+      corpus::generate(size_t(1) << 20, 1, corpus::append_latin);
+  std::vector<thread_buffers> buffers(max_threads);
+  {
+    // Each thread touches its buffers first: they are local to its node.
+    std::vector<std::thread> fillers;
+    for (size_t t = 0; t < max_threads; t++) {
+      fillers.emplace_back([&, t]() { fill(buffers[t], unit, size); });
+    }
+    for (std::thread &filler : fillers) {
+      filler.join();
+    }
+  }
+  fprintf(stderr, "%zu MiB per thread\n", size >> 20);
+  printf("threads,workload,gb_per_s\n");
+  for (size_t threads = 1; threads <= max_threads; threads++) {
+    printf("%zu,memset,%.3f\n", threads,
+           aggregate(buffers, threads, size, [&](thread_buffers &b) {
+             memset(b.scratch.get(), int(threads), size);
+           }));
+    printf("%zu,memcpy,%.3f\n", threads,
+           aggregate(buffers, threads, size, [&](thread_buffers &b) {
+             memcpy(b.scratch.get(), b.text.get(), size);
+           }));
+    for (const is_utf8_internals::implementation *impl :
+         is_utf8_internals::get_available_implementations()) {
+      if (!impl->supported_by_runtime_system()) {
+        continue;
+      }
+      std::atomic<bool> isgood{true};
+      double gb_per_s =
+          aggregate(buffers, threads, size, [&](thread_buffers &b) {
+            if (!impl->validate_utf8(b.text.get(), size)) {
+              isgood = false;
+            }
+          });
+      if (!isgood) {
+        fprintf(stderr, "%s rejected a valid buffer\n", impl->name().c_str());
+        return EXIT_FAILURE;
+      }
+      printf("%zu,%s,%.3f\n", threads, impl->name().c_str(), gb_per_s);
+    }
+    fflush(stdout);
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,117 @@
+// Time per call of each kernel supported by this machine, and of is_utf8, at
+// every length from 0 to 64 bytes: below 64 bytes, the kernels never enter
+// their main loop, and the whole cost is that of the short input path. Each
+// length is measured on ASCII strings and on strings of Latin text, which
+// have two-byte characters, going through 1024 different strings so that
+// the branch predictor cannot learn a single one.
+//
+// Usage: short [maximal length in bytes, default 64]
+// Prints CSV: one line per kernel and length, the average time of a call in
+// nanoseconds (best of several runs). The "is_utf8_padded" rows go through
+// is_utf8_padded: the strings are stored one after the other, followed by 64
+// bytes, so that each of them is followed by at least 64 readable bytes.
+#include "is_utf8.cpp"
+
+#include "corpus.h"
+#include "timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace {
+
+constexpr size_t string_count = 1024;
+
+// string_count strings of length bytes, one after the other, cut from the
+// text at character boundaries, and 64 bytes of padding. The bytes of a
+// character cut by the end of a string are replaced by spaces: every string is
+// valid.
+std::string strings(const std::string &text, size_t length) {
+  std::mt19937 gen(length);
+  std::string result;
+  for (size_t i = 0; i < string_count; i++) {
+    size_t start = corpus::pick(gen, 0, uint32_t(text.size() - length - 1));
+    while ((uint8_t(text[start]) & 0xC0) == 0x80) {
+      start++;
+    }
+    std::string s = text.substr(start, length);
+    size_t end = length;
+    if ((uint8_t(text[start + length]) & 0xC0) == 0x80) {
+      while (end > 0 && (uint8_t(s[end - 1]) & 0xC0) == 0x80) {
+        end--;
+      }
+      if (end > 0) {
+        end--; // leading byte
+      }
+    }
+    for (size_t j = end; j < length; j++) {
+      s[j] = ' ';
+    }
+    result += s;
+  }
+  result.append(64, '\0');
+  return result;
+}
+
+// Best of many runs, each going once through all the strings.
+template <typename F>
+double measure(const std::string &data, size_t length, F validate) {
+  volatile bool isgood{true};
+  double best_ns = 1e300;
+  uint64_t deadline = nano() + 10000000;
+  size_t runs = 0;
+  do {
+    uint64_t start = nano();
+    for (size_t i = 0; i < string_count; i++) {
+      isgood &= validate(data.data() + i * length, length);
+    }
+    uint64_t finish = nano();
+    double ns = double(finish - start) / double(string_count);
+    if (ns < best_ns) {
+      best_ns = ns;
+    }
+    runs++;
+  } while (nano() < deadline || runs < 10);
+  if (!isgood) {
+    fprintf(stderr, "a valid string of %zu bytes was rejected\n", length);
+    exit(EXIT_FAILURE);
+  }
+  return best_ns;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t max_length =
+      argc > 1 ? size_t(strtoull(argv[1], nullptr, 10)) : size_t(64);
+  std::string latin =
+      corpus::generate(size_t(1) << 20, 1, corpus::append_latin);
+  std::string ascii(latin.size(), ' ');
+  for (size_t i = 0; i < ascii.size(); i++) {
+    ascii[i] = char(' ' + i * 7 % 95);
+  }
+  printf("implementation,bytes,ascii_ns,latin_ns\n");
+  for (size_t length = 0; length <= max_length; length++) {
+    std::string ascii_strings = strings(ascii, length);
+    std::string latin_strings = strings(latin, length);
+    for (const is_utf8_internals::implementation *impl :
+         is_utf8_internals::get_available_implementations()) {
+      if (!impl->supported_by_runtime_system()) {
+        continue;
+      }
+      auto validate = [&](const char *buf, size_t len) {
+        return impl->validate_utf8(buf, len);
+      };
+      printf("%s,%zu,%.2f,%.2f\n", impl->name().c_str(), length,
+             measure(ascii_strings, length, validate),
+             measure(latin_strings, length, validate));
+    }
+    printf("is_utf8,%zu,%.2f,%.2f\n", length,
+           measure(ascii_strings, length, is_utf8),
+           measure(latin_strings, length, is_utf8));
+    printf("is_utf8_padded,%zu,%.2f,%.2f\n", length,
+           measure(ascii_strings, length, is_utf8_padded),
+           measure(latin_strings, length, is_utf8_padded));
+    fflush(stdout);
+  }
+  return EXIT_SUCCESS;
+}
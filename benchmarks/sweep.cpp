@@ -0,0 +1,140 @@
+// Latency and throughput of each kernel supported by this machine as a
+// function of the input length, to locate the crossover points: where the
+// SIMD kernels start paying for themselves on short strings, and where the
+// tail handling (the padded copy of the last block, the masked loads) stops
+// dominating.
+//
+// Usage: sweep [maximal length in bytes, default 1 GiB]
+// Prints CSV: one line per kernel and length. The lengths are every length
+// up to 160 bytes (the dense steps around 16, 32, 64 and 128), then a
+// geometric sweep (powers of two and the midpoints between them). The
+// "is_utf8" rows go through the public function, with its dispatch.
+#include "is_utf8.cpp"
+
+#include "corpus.h"
+#include "timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace {
+
+std::vector<size_t> lengths(size_t max_length) {
+  std::vector<size_t> result;
+  for (size_t length = 1; length <= 160 && length <= max_length; length++) {
+    result.push_back(length);
+  }
+  for (size_t length = 256; length <= max_length; length *= 2) {
+    result.push_back(length * 3 / 4);
+    result.push_back(length);
+  }
+  return result;
+}
+
+// Latin text (mostly ASCII, with two-byte characters) repeated to the given
+// length. Generating the whole of it would take too long at 1 GiB.
+std::string input(size_t length) {
+  std::string unit =
+      corpus::generate(size_t(1) << 20, 1, corpus::append_latin);
+  std::string data;
+  data.reserve(length);
+  while (data.size() + unit.size() <= length) {
+    data += unit;
+  }
+  std::string tail = unit;
+  corpus::truncate(tail, length - data.size());
+  data += tail;
+  data.resize(length, ' ');
+  return data;
+}
+
+// A prefix of the input may end in the middle of a character: the bytes of
+// that character are replaced by spaces while it is measured, so that every
+// kernel sees a valid string of exactly the requested length.
+class valid_prefix {
+public:
+  valid_prefix(std::string &data, size_t length) : data(data), start(length) {
+    // The character is cut if the next byte continues it.
+    if (length < data.size() && (uint8_t(data[length]) & 0xC0) == 0x80) {
+      while ((uint8_t(data[start - 1]) & 0xC0) == 0x80) {
+        start--;
+      }
+      start--; // leading byte
+    }
+    saved.assign(data, start, length - start);
+    for (size_t i = start; i < length; i++) {
+      data[i] = ' ';
+    }
+  }
+  ~valid_prefix() { data.replace(start, saved.size(), saved); }
+
+private:
+  std::string &data;
+  size_t start;
+  std::string saved;
+};
+
+struct measurement {
+  double ns_per_call;
+  double gb_per_s;
+};
+
+// Best of many runs, each with enough calls for the clock to be precise.
+template <typename F> measurement measure(size_t length, F validate) {
+  volatile bool isgood{true};
+  isgood &= validate(); // warm up
+  double best_ns = 1e300;
+  size_t repeat = 1 + (size_t(1) << 20) / length;
+  uint64_t deadline = nano() + 20000000;
+  size_t runs = 0;
+  do {
+    uint64_t start = nano();
+    for (size_t i = 0; i < repeat; i++) {
+      isgood &= validate();
+    }
+    uint64_t finish = nano();
+    double ns = double(finish - start) / double(repeat);
+    if (ns < best_ns) {
+      best_ns = ns;
+    }
+    runs++;
+  } while (nano() < deadline || runs < 3);
+  if (!isgood) {
+    fprintf(stderr, "a valid input of %zu bytes was rejected\n", length);
+    exit(EXIT_FAILURE);
+  }
+  return {best_ns, double(length) / best_ns};
+}
+
+void print(const char *name, size_t length, measurement m) {
+  printf("%s,%zu,%.3f,%.4f\n", name, length, m.ns_per_call, m.gb_per_s);
+  fflush(stdout);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t max_length =
+      argc > 1 ? size_t(strtoull(argv[1], nullptr, 10)) : size_t(1) << 30;
+  if (max_length == 0) {
+    fprintf(stderr, "the maximal length must be positive\n");
+    return EXIT_FAILURE;
+  }
+  std::string data = input(max_length);
+  printf("implementation,bytes,ns_per_call,gb_per_s\n");
+  for (size_t length : lengths(max_length)) {
+    valid_prefix prefix(data, length);
+    const char *buf = data.data();
+    for (const is_utf8_internals::implementation *impl :
+         is_utf8_internals::get_available_implementations()) {
+      if (!impl->supported_by_runtime_system()) {
+        continue;
+      }
+      print(impl->name().c_str(), length, measure(length, [&]() {
+              return impl->validate_utf8(buf, length);
+            }));
+    }
+    print("is_utf8", length,
+          measure(length, [&]() { return is_utf8(buf, length); }));
+  }
+  return EXIT_SUCCESS;
+}
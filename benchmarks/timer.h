@@ -0,0 +1,14 @@
+#ifndef IS_UTF8_BENCHMARKS_TIMER_H
+#define IS_UTF8_BENCHMARKS_TIMER_H
+
+#include <stdint.h>
+#include <chrono>
+
+// Nanoseconds of the monotonic clock, for the benchmarks to time their loops.
+inline uint64_t nano() {
+  return std::chrono::duration_cast<::std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+#endif // IS_UTF8_BENCHMARKS_TIMER_H
@@ -1,5 +1,7 @@
 #ifndef IS_UTF8
+#define IS_UTF8
 #include <stddef.h>
+#include <stdint.h>
 
 // Check whether the provided string is UTF-8.
 // The function is designed for use cases where
@@ -7,4 +9,174 @@
 // Thus the function unconditionally scans the
 // whole input.
 extern "C" bool is_utf8(const char *src, size_t len);
+
+// Same result as is_utf8, for inputs that are often invalid (e.g., binary
+// files labeled as text): the function returns as soon as it has seen an
+// error, checking every few kilobytes (IS_UTF8_EARLY_EXIT_BLOCKS blocks of 64
+// bytes when building the library). Valid inputs are validated almost as fast
+// as with is_utf8.
+extern "C" bool is_utf8_early_exit(const char *src, size_t len);
+
+// Same result as is_utf8, for inputs followed by at least 64 readable bytes
+// (e.g., network buffers or arena allocations with padding): the len + 64
+// bytes at src must be readable, whatever the bytes past len. The kernel then
+// reads the last bytes of the input in place, past its end, instead of going
+// through a copy.
+extern "C" bool is_utf8_padded(const char *src, size_t len);
+
+// By default, the implementation (kernel) is the most advanced one that the
+// processor supports. is_utf8_autotune instead measures every supported
+// kernel on a few buffers (a few milliseconds) and uses the fastest from then
+// on: one for strings of fewer than 64 bytes, one for longer strings. Returns
+// the name of the kernel for long strings (e.g., "haswell");
+// is_utf8_medium_implementation returns the other one. Setting the
+// environment variable IS_UTF8_AUTOTUNE=1 autotunes on the first call
+// instead. Setting IS_UTF8_FORCE_IMPLEMENTATION (e.g., to the name returned
+// here) pins the kernel: autotuning then leaves it alone, and it validates
+// strings of any length. Setting IS_UTF8_FORCE_MEDIUM_IMPLEMENTATION as well
+// (e.g., to the name returned by is_utf8_medium_implementation) pins the
+// kernel for strings of fewer than 64 bytes: the two names returned after
+// autotuning reproduce its choice.
+extern "C" const char *is_utf8_autotune(void);
+
+// The kernels compiled into the library, whether or not the processor
+// supports them, indexed from 0 to is_utf8_implementation_count() - 1 (e.g.,
+// to measure each of them in a canary). The names and descriptions are
+// those of the kernels, e.g., "haswell" and "Intel/AMD AVX2"; they are
+// NULL, and is_utf8_implementation_supported false, if the index is out of
+// range. The strings live as long as the library.
+extern "C" size_t is_utf8_implementation_count(void);
+extern "C" const char *is_utf8_implementation_name(size_t index);
+extern "C" const char *is_utf8_implementation_description(size_t index);
+extern "C" bool is_utf8_implementation_supported(size_t index);
+
+// The name of the kernel that is_utf8 and the other functions use (for
+// strings of 64 bytes or more, after is_utf8_autotune).
+extern "C" const char *is_utf8_active_implementation(void);
+
+// The name of the kernel that is_utf8 uses for strings of 16 to 63 bytes
+// (shorter ones are validated without a kernel): the active kernel, unless
+// autotuning or IS_UTF8_FORCE_MEDIUM_IMPLEMENTATION chose another one.
+extern "C" const char *is_utf8_medium_implementation(void);
+
+// Use the kernel of the given name from now on, whatever
+// IS_UTF8_FORCE_IMPLEMENTATION or a previous autotuning chose (including
+// for the strings of fewer than 64 bytes that autotuning or
+// IS_UTF8_FORCE_MEDIUM_IMPLEMENTATION gave to another kernel).
+// Returns false, leaving the active kernel unchanged, if there is no such
+// kernel or if the processor does not support it. Streams already started
+// finish with the kernel they started with. Meant to be called at startup or
+// rarely: calls running on other threads at the same time use either kernel.
+extern "C" bool is_utf8_set_implementation(const char *name);
+
+// The functions above, for C++ (std::string, std::vector): see is_utf8_api.h.
+
+// Classes of errors reported by is_utf8_with_errors.
+enum is_utf8_error_code {
+  IS_UTF8_SUCCESS = 0,
+  IS_UTF8_HEADER_BITS, // Any byte must have fewer than 5 header bits.
+  IS_UTF8_TOO_SHORT,   // The leading byte must be followed by N-1 continuation
+                       // bytes, where N is the UTF-8 character length. This is
+                       // also the error when the input is truncated.
+  IS_UTF8_TOO_LONG,    // The leading byte must not be a continuation byte.
+  IS_UTF8_OVERLONG,    // The decoded character must be above U+7F for two-byte
+                       // characters, U+7FF for three-byte characters, and
+                       // U+FFFF for four-byte characters.
+  IS_UTF8_TOO_LARGE,   // The decoded character must be at most U+10FFFF.
+  IS_UTF8_SURROGATE,   // The decoded character must not be in U+D800...DFFF.
+  IS_UTF8_OTHER        // Not related to the input: no kernel could be used
+                       // (e.g., IS_UTF8_FORCE_IMPLEMENTATION names none).
+};
+
+struct is_utf8_result {
+  enum is_utf8_error_code error;
+  // In case of error, the position of the first byte of the faulty
+  // character. In case of success, the length of the input (for the
+  // conversions to UTF-16, the number of char16_t written).
+  size_t count;
+};
+
+// Check whether the provided string is UTF-8 and, if it is not,
+// locate the first error. Valid inputs are checked as fast as
+// with is_utf8: the error is only located once the input has
+// been found to be invalid.
+extern "C" is_utf8_result is_utf8_with_errors(const char *src, size_t len);
+
+// Convert the provided string from UTF-8 to UTF-16LE (resp. UTF-16BE),
+// validating it in the same pass. The output must have room for
+// is_utf8_utf16_length(src, len) char16_t. Returns the number of char16_t
+// written or, if the input is not UTF-8, the error as is_utf8_with_errors
+// does (the output is then left in an unspecified state).
+extern "C" is_utf8_result is_utf8_to_utf16le(const char *src, size_t len,
+                                             char16_t *out);
+extern "C" is_utf8_result is_utf8_to_utf16be(const char *src, size_t len,
+                                             char16_t *out);
+
+// Number of char16_t needed to convert the provided UTF-8 string to UTF-16.
+// The input is not validated: if it is not UTF-8, the result is still enough
+// for is_utf8_to_utf16le and is_utf8_to_utf16be.
+extern "C" size_t is_utf8_utf16_length(const char *src, size_t len);
+
+// Properties of a UTF-8 string, see is_utf8_profile.
+struct is_utf8_string_profile {
+  bool is_ascii;       // All the code points are below U+0080.
+  bool is_latin1;      // All the code points are below U+0100.
+  size_t code_points;  // The number of code points.
+  size_t utf16_length; // The number of char16_t once converted to UTF-16.
+};
+
+// Check whether the provided string is UTF-8 and, if it is, fill the profile.
+// Everything is computed in the pass that validates the string. Returns false,
+// leaving the profile unspecified, if the string is not UTF-8.
+extern "C" bool is_utf8_profile(const char *src, size_t len,
+                                is_utf8_string_profile *profile);
+
+// Check whether the provided string of len char16_t is valid UTF-16LE (resp.
+// UTF-16BE): each high surrogate (U+D800...U+DBFF) must be followed by a low
+// surrogate (U+DC00...U+DFFF), and each low surrogate must follow a high
+// surrogate.
+extern "C" bool is_utf16le_valid(const char16_t *src, size_t len);
+extern "C" bool is_utf16be_valid(const char16_t *src, size_t len);
+
+// Check whether the provided string is UTF-8 using up to nthreads threads
+// (0: one per hardware thread). The result is always the same as is_utf8.
+// Meant for large inputs: each thread is given at least one megabyte, so
+// that small inputs are validated on the calling thread.
+extern "C" bool is_utf8_parallel(const char *src, size_t len, size_t nthreads);
+
+// Check whether each of the n strings ptrs[i] (of length lens[i]) is UTF-8,
+// setting results[i] to 1 if it is, to 0 otherwise. Returns the number of
+// valid strings. Prefer it to calling is_utf8 in a loop on many short strings:
+// the implementation is selected once for the whole batch.
+extern "C" size_t is_utf8_batch(const char *const *ptrs, const size_t *lens,
+                                size_t n, uint8_t *results);
+
+// Returns the index of the first of the n strings ptrs[i] (of length lens[i])
+// that is not UTF-8, or n if they are all valid. Stops at the first invalid
+// string.
+extern "C" size_t is_utf8_batch_first_invalid(const char *const *ptrs,
+                                              const size_t *lens, size_t n);
+
+// Streaming validation, for inputs that arrive in pieces (e.g., socket
+// reads). The pieces may have any size and characters may straddle them:
+// they are validated in place, only the bytes of an incomplete 64-byte
+// block are kept from one call to the next.
+//
+//   is_utf8_stream *stream = is_utf8_stream_init();
+//   while (...) { is_utf8_stream_update(stream, piece, piece_length); }
+//   bool valid = is_utf8_stream_finish(stream);
+typedef struct is_utf8_stream is_utf8_stream;
+
+// Start a new stream. Returns NULL if the state cannot be allocated.
+extern "C" is_utf8_stream *is_utf8_stream_init(void);
+
+// Validate the next bytes of the stream. Returns false as soon as the stream
+// is known to be invalid, in which case further updates are no-ops.
+extern "C" bool is_utf8_stream_update(is_utf8_stream *stream, const char *src,
+                                      size_t len);
+
+// Validate the end of the stream and release it. Returns true if and only if
+// the concatenation of all the bytes provided is valid UTF-8. Must be called
+// exactly once per stream, even after an update returned false.
+extern "C" bool is_utf8_stream_finish(is_utf8_stream *stream);
 #endif // IS_UTF8
@@ -0,0 +1,48 @@
+#ifndef IS_UTF8_API
+#define IS_UTF8_API
+#include "is_utf8.h"
+#include <string>
+#include <vector>
+
+// The functions of is_utf8.h that list, query and set the kernels, for C++:
+// inline wrappers, so that the library only exports the C functions.
+namespace is_utf8_api {
+// A kernel compiled into the library.
+struct implementation {
+  std::string name;        // e.g., "haswell"
+  std::string description; // e.g., "Intel/AMD AVX2"
+  bool supported;          // Whether the processor supports it.
+};
+
+// The kernels compiled into the library, whether or not the processor supports
+// them, in the order of is_utf8_implementation_name.
+inline std::vector<implementation> implementations() {
+  std::vector<implementation> list;
+  for (size_t i = 0; i < is_utf8_implementation_count(); i++) {
+    implementation impl = {is_utf8_implementation_name(i),
+                           is_utf8_implementation_description(i),
+                           is_utf8_implementation_supported(i)};
+    list.push_back(impl);
+  }
+  return list;
+}
+
+// See is_utf8_active_implementation.
+inline std::string active_implementation() {
+  return is_utf8_active_implementation();
+}
+
+// See is_utf8_medium_implementation.
+inline std::string medium_implementation() {
+  return is_utf8_medium_implementation();
+}
+
+// See is_utf8_set_implementation.
+inline bool set_implementation(const std::string &name) {
+  return is_utf8_set_implementation(name.c_str());
+}
+
+// See is_utf8_autotune.
+inline std::string autotune() { return is_utf8_autotune(); }
+} // namespace is_utf8_api
+#endif // IS_UTF8_API
@@ -1,5 +1,6 @@
 #ifndef IS_UTF8_H
 #define IS_UTF8_H
+#include "is_utf8.h"
 #include <cstring>
 
 #ifndef IS_UTF8_COMPILER_CHECK_H
@@ -430,6 +431,11 @@ struct result {
   is_utf8_really_inline result(error_code, size_t);
 };
 
+is_utf8_really_inline result::result() : error{error_code::SUCCESS}, count{0} {}
+
+is_utf8_really_inline result::result(error_code _err, size_t _pos)
+    : error{_err}, count{_pos} {}
+
 } // namespace is_utf8_internals
 #endif
 
@@ -441,6 +447,7 @@ IS_UTF8_DISABLE_UNDESIRED_WARNINGS
 #include <string>
 #if !defined(IS_UTF8_NO_THREADS)
 #include <atomic>
+#include <thread>
 #endif
 #include <tuple>
 #include <vector>
@@ -668,6 +675,118 @@ namespace is_utf8_internals {
  */
 bool validate_utf8(const char *buf, size_t len) noexcept;
 
+namespace internal {
+/**
+ * Size of the opaque state of a streaming validation: large enough for the
+ * widest checker (three 512-bit registers).
+ */
+constexpr size_t utf8_stream_state_size = 192;
+} // namespace internal
+
+/**
+ * Validate the UTF-8 string and stop on error.
+ *
+ * Overridden by each implementation.
+ *
+ * @param buf the UTF-8 string to validate.
+ * @param len the length of the string in bytes.
+ * @return a result pair struct with an error code and either the position of
+ * the error (in the input in bytes) if any, or the number of bytes validated if
+ * successful.
+ */
+result validate_utf8_with_errors(const char *buf, size_t len) noexcept;
+
+/**
+ * Validate the UTF-8 string using several threads. The input is cut into
+ * ranges starting on a leading byte (or ASCII), so that the input is valid if
+ * and only if all ranges are valid: the result is the same as validate_utf8.
+ *
+ * @param buf the UTF-8 string to validate.
+ * @param len the length of the string in bytes.
+ * @param thread_count the maximal number of threads, 0 for one thread per
+ * hardware thread.
+ * @return true if and only if the string is valid UTF-8.
+ */
+bool validate_utf8_parallel(const char *buf, size_t len,
+                            size_t thread_count) noexcept;
+
+/**
+ * Convert possibly broken UTF-8 string into UTF-16LE string and stop on error.
+ *
+ * @param buf the UTF-8 string to convert.
+ * @param len the length of the string in bytes.
+ * @param utf16_output the pointer to a buffer that can hold
+ * utf16_length_from_utf8(buf, len) char16_t.
+ * @return a result pair struct with an error code and either the position of
+ * the error (in the input in bytes) if any, or the number of char16_t written
+ * if successful.
+ */
+result convert_utf8_to_utf16le_with_errors(const char *buf, size_t len,
+                                           char16_t *utf16_output) noexcept;
+
+/**
+ * Convert possibly broken UTF-8 string into UTF-16BE string and stop on error.
+ *
+ * @param buf the UTF-8 string to convert.
+ * @param len the length of the string in bytes.
+ * @param utf16_output the pointer to a buffer that can hold
+ * utf16_length_from_utf8(buf, len) char16_t.
+ * @return a result pair struct with an error code and either the position of
+ * the error (in the input in bytes) if any, or the number of char16_t written
+ * if successful.
+ */
+result convert_utf8_to_utf16be_with_errors(const char *buf, size_t len,
+                                           char16_t *utf16_output) noexcept;
+
+/**
+ * Compute the number of 2-byte code units that this UTF-8 string would require
+ * in UTF-16 format. The string is not validated.
+ *
+ * @param buf the UTF-8 string to process.
+ * @param len the length of the string in bytes.
+ * @return the number of char16_t code units required to encode the string.
+ */
+size_t utf16_length_from_utf8(const char *buf, size_t len) noexcept;
+
+// Number of 64-byte blocks between two checks for errors in
+// validate_utf8_early_exit: 32 blocks are 2 KiB.
+#ifndef IS_UTF8_EARLY_EXIT_BLOCKS
+#define IS_UTF8_EARLY_EXIT_BLOCKS 32
+#endif
+
+// The haswell kernel validates the inputs of at least
+// IS_UTF8_DUAL_STREAM_LENGTH bytes as two halves in the same loop, prefetching
+// IS_UTF8_PREFETCH_DISTANCE bytes ahead in each of them. Defining
+// IS_UTF8_DUAL_STREAM_LENGTH to 0 disables it.
+#ifndef IS_UTF8_DUAL_STREAM_LENGTH
+#define IS_UTF8_DUAL_STREAM_LENGTH 4096
+#endif
+#ifndef IS_UTF8_PREFETCH_DISTANCE
+#define IS_UTF8_PREFETCH_DISTANCE 512
+#endif
+
+// After an ASCII block, the kernels look for the next non-ASCII byte
+// IS_UTF8_ASCII_SCAN_LENGTH bytes at a time (a multiple of 64, at most 1024):
+// the runs of ASCII characters are skipped without going through the checker.
+// Defining it to 64 disables the scan.
+#ifndef IS_UTF8_ASCII_SCAN_LENGTH
+#define IS_UTF8_ASCII_SCAN_LENGTH 256
+#endif
+
+/**
+ * Properties of a valid UTF-8 string, computed while validating it.
+ */
+struct utf8_profile {
+  /** All the code points are below U+0080. */
+  bool is_ascii;
+  /** All the code points are below U+0100. */
+  bool is_latin1;
+  /** The number of code points. */
+  size_t code_points;
+  /** The number of char16_t needed to encode the string in UTF-16. */
+  size_t utf16_length;
+};
+
 class implementation {
 public:
   virtual const std::string &name() const { return _name; }
@@ -692,6 +811,217 @@ public:
   is_utf8_warn_unused virtual bool validate_utf8(const char *buf,
                                                  size_t len) const noexcept = 0;
 
+  /** @private A plain function doing the same as validate_utf8. */
+  typedef bool (*validate_utf8_function)(const char *buf, size_t len);
+
+  /**
+   * Get a plain function doing the same as validate_utf8, so that calls may
+   * be dispatched without going through the implementation.
+   *
+   * Overridden by each implementation.
+   */
+  virtual validate_utf8_function get_validate_utf8_function() const noexcept = 0;
+
+  /**
+   * Validate the UTF-8 string and stop on error.
+   *
+   * Overridden by each implementation.
+   *
+   * @param buf the UTF-8 string to validate.
+   * @param len the length of the string in bytes.
+   * @return a result pair struct with an error code and either the position of
+   * the error (in the input in bytes) if any, or the number of bytes validated
+   * if successful.
+   */
+  is_utf8_warn_unused virtual result
+  validate_utf8_with_errors(const char *buf, size_t len) const noexcept = 0;
+
+  /**
+   * Validate the UTF-8 string, returning as soon as an error has been seen.
+   * Errors are checked every IS_UTF8_EARLY_EXIT_BLOCKS blocks of 64 bytes,
+   * so that invalid inputs are rejected early and valid inputs are validated
+   * almost as fast as with validate_utf8.
+   *
+   * Overridden by each implementation.
+   *
+   * @param buf the UTF-8 string to validate.
+   * @param len the length of the string in bytes.
+   * @return true if and only if the string is valid UTF-8.
+   */
+  is_utf8_warn_unused virtual bool
+  validate_utf8_early_exit(const char *buf, size_t len) const noexcept = 0;
+
+  /**
+   * Start validating a stream of UTF-8 data.
+   *
+   * Overridden by each implementation.
+   *
+   * @param state storage for the validation state, at least
+   * internal::utf8_stream_state_size bytes, no alignment required.
+   */
+  virtual void utf8_stream_init(void *state) const noexcept = 0;
+
+  /**
+   * Validate the next whole 64-byte blocks of a stream of UTF-8 data.
+   *
+   * Overridden by each implementation.
+   *
+   * @param state the state set by utf8_stream_init.
+   * @param buf the next bytes of the stream.
+   * @param len the number of bytes, a multiple of 64.
+   * @return false if an error has been found so far.
+   */
+  is_utf8_warn_unused virtual bool
+  utf8_stream_update(void *state, const char *buf,
+                     size_t len) const noexcept = 0;
+
+  /**
+   * Validate the last bytes of a stream of UTF-8 data.
+   *
+   * Overridden by each implementation.
+   *
+   * @param state the state set by utf8_stream_init.
+   * @param buf the last bytes of the stream.
+   * @param len the number of bytes, less than 64 (possibly zero).
+   * @return true if and only if the whole stream is valid UTF-8.
+   */
+  is_utf8_warn_unused virtual bool
+  utf8_stream_finish(void *state, const char *buf,
+                     size_t len) const noexcept = 0;
+
+  /**
+   * Validate many UTF-8 strings.
+   *
+   * Overridden by each implementation.
+   *
+   * @param bufs the UTF-8 strings to validate.
+   * @param lens the lengths of the strings in bytes.
+   * @param count the number of strings.
+   * @param results set to 1 for each valid string, to 0 otherwise.
+   * @return the number of valid strings.
+   */
+  virtual size_t validate_utf8_batch(const char *const *bufs,
+                                     const size_t *lens, size_t count,
+                                     uint8_t *results) const noexcept = 0;
+
+  /**
+   * Find the first string that is not valid UTF-8 among many.
+   *
+   * Overridden by each implementation.
+   *
+   * @param bufs the UTF-8 strings to validate.
+   * @param lens the lengths of the strings in bytes.
+   * @param count the number of strings.
+   * @return the index of the first invalid string, count if all are valid.
+   */
+  is_utf8_warn_unused virtual size_t
+  find_first_invalid_utf8(const char *const *bufs, const size_t *lens,
+                          size_t count) const noexcept = 0;
+
+  /**
+   * Convert possibly broken UTF-8 string into UTF-16LE string and stop on
+   * error. The input is validated as it is converted, in a single pass.
+   *
+   * Overridden by each implementation.
+   *
+   * @param buf the UTF-8 string to convert.
+   * @param len the length of the string in bytes.
+   * @param utf16_output the pointer to a buffer that can hold
+   * utf16_length_from_utf8(buf, len) char16_t.
+   * @return a result pair struct with an error code and either the position of
+   * the error (in the input in bytes) if any, or the number of char16_t written
+   * if successful.
+   */
+  is_utf8_warn_unused virtual result
+  convert_utf8_to_utf16le_with_errors(const char *buf, size_t len,
+                                      char16_t *utf16_output) const noexcept = 0;
+
+  /**
+   * Convert possibly broken UTF-8 string into UTF-16BE string and stop on
+   * error. The input is validated as it is converted, in a single pass.
+   *
+   * Overridden by each implementation.
+   *
+   * @param buf the UTF-8 string to convert.
+   * @param len the length of the string in bytes.
+   * @param utf16_output the pointer to a buffer that can hold
+   * utf16_length_from_utf8(buf, len) char16_t.
+   * @return a result pair struct with an error code and either the position of
+   * the error (in the input in bytes) if any, or the number of char16_t written
+   * if successful.
+   */
+  is_utf8_warn_unused virtual result
+  convert_utf8_to_utf16be_with_errors(const char *buf, size_t len,
+                                      char16_t *utf16_output) const noexcept = 0;
+
+  /**
+   * Compute the number of 2-byte code units that this UTF-8 string would
+   * require in UTF-16 format. The string is not validated: for an invalid
+   * string, the result bounds what the conversions write before they stop.
+   *
+   * Overridden by each implementation.
+   *
+   * @param buf the UTF-8 string to process.
+   * @param len the length of the string in bytes.
+   * @return the number of char16_t code units required to encode the string.
+   */
+  is_utf8_warn_unused virtual size_t
+  utf16_length_from_utf8(const char *buf, size_t len) const noexcept = 0;
+
+  /**
+   * Validate the UTF-8 string and, in the same pass, compute its profile.
+   *
+   * Overridden by each implementation.
+   *
+   * @param buf the UTF-8 string to validate.
+   * @param len the length of the string in bytes.
+   * @param profile set if the string is valid, unspecified otherwise.
+   * @return true if and only if the string is valid UTF-8.
+   */
+  is_utf8_warn_unused virtual bool
+  validate_utf8_profile(const char *buf, size_t len,
+                        utf8_profile *profile) const noexcept = 0;
+
+  /**
+   * Validate the UTF-16LE string.
+   *
+   * Overridden by each implementation.
+   *
+   * @param buf the UTF-16LE string to validate.
+   * @param len the length of the string in number of 2-byte code units
+   * (char16_t).
+   * @return true if and only if the string is valid UTF-16LE.
+   */
+  is_utf8_warn_unused virtual bool
+  validate_utf16le(const char16_t *buf, size_t len) const noexcept = 0;
+
+  /**
+   * Validate the UTF-16BE string.
+   *
+   * Overridden by each implementation.
+   *
+   * @param buf the UTF-16BE string to validate.
+   * @param len the length of the string in number of 2-byte code units
+   * (char16_t).
+   * @return true if and only if the string is valid UTF-16BE.
+   */
+  is_utf8_warn_unused virtual bool
+  validate_utf16be(const char16_t *buf, size_t len) const noexcept = 0;
+
+  /**
+   * Validate the UTF-8 string, which is followed by at least 64 readable
+   * bytes (whatever their content): the last block is read in place, past the
+   * end of the string, instead of being copied to a padded block.
+   *
+   * Overridden by each implementation.
+   *
+   * @param buf the UTF-8 string to validate, with len + 64 readable bytes.
+   * @param len the length of the string in bytes.
+   * @return true if and only if the string is valid UTF-8.
+   */
+  is_utf8_warn_unused virtual bool
+  validate_utf8_padded(const char *buf, size_t len) const noexcept = 0;
+
 protected:
   /** @private Construct an implementation with the given name and description.
    * For subclasses. */
@@ -769,6 +1099,19 @@ public:
    * supported implementation. Will never return nullptr.
    */
   const implementation *detect_best_supported() const noexcept;
+
+  /**
+   * Measure the implementations supported by the current host on text of len
+   * bytes (mostly ASCII, with characters of 2, 3 and 4 bytes) and return the
+   * fastest. The most advanced one wins unless another one is clearly faster.
+   *
+   * This is used when autotuning (IS_UTF8_AUTOTUNE, is_utf8_autotune). It
+   * takes a few milliseconds.
+   *
+   * @return the fastest supported implementation, as detect_best_supported
+   * when there is no supported implementation. Will never return nullptr.
+   */
+  const implementation *detect_fastest_supported(size_t len) const noexcept;
 };
 
 template <typename T> class atomic_ptr {
@@ -826,6 +1169,14 @@ extern IS_UTF8_DLLIMPORTEXPORT const internal::available_implementation_list& ge
  */
 extern IS_UTF8_DLLIMPORTEXPORT internal::atomic_ptr<const implementation>& get_active_implementation();
 
+namespace internal {
+/**
+ * @private The active implementation, after the detection on first use has
+ * run: never the detector itself.
+ */
+const implementation *get_resolved_active_implementation() noexcept;
+} // namespace internal
+
 } // namespace is_utf8_internals
 
 #endif // IS_UTF8_IMPLEMENTATION_H
@@ -840,8 +1191,11 @@ IS_UTF8_POP_DISABLE_WARNINGS
 
 #endif // IS_UTF8_H
 
+#include <chrono>
 #include <climits>
 #include <initializer_list>
+#include <memory>
+#include <new>
 
 // Useful for debugging purposes
 namespace is_utf8_internals {
@@ -902,6 +1256,39 @@ public:
                                           internal::instruction_set::NEON) {}
   is_utf8_warn_unused bool validate_utf8(const char *buf,
                                          size_t len) const noexcept final;
+  is_utf8_warn_unused result
+  validate_utf8_with_errors(const char *buf, size_t len) const noexcept final;
+  is_utf8_warn_unused bool
+  validate_utf8_early_exit(const char *buf, size_t len) const noexcept final;
+  void utf8_stream_init(void *state) const noexcept final;
+  is_utf8_warn_unused bool utf8_stream_update(void *state, const char *buf,
+                                              size_t len) const noexcept final;
+  is_utf8_warn_unused bool utf8_stream_finish(void *state, const char *buf,
+                                              size_t len) const noexcept final;
+  size_t validate_utf8_batch(const char *const *bufs, const size_t *lens,
+                             size_t count,
+                             uint8_t *results) const noexcept final;
+  is_utf8_warn_unused size_t
+  find_first_invalid_utf8(const char *const *bufs, const size_t *lens,
+                          size_t count) const noexcept final;
+  validate_utf8_function get_validate_utf8_function() const noexcept final;
+  is_utf8_warn_unused result
+  convert_utf8_to_utf16le_with_errors(const char *buf, size_t len,
+                                      char16_t *utf16_output) const noexcept final;
+  is_utf8_warn_unused result
+  convert_utf8_to_utf16be_with_errors(const char *buf, size_t len,
+                                      char16_t *utf16_output) const noexcept final;
+  is_utf8_warn_unused size_t
+  utf16_length_from_utf8(const char *buf, size_t len) const noexcept final;
+  is_utf8_warn_unused bool
+  validate_utf8_profile(const char *buf, size_t len,
+                        utf8_profile *profile) const noexcept final;
+  is_utf8_warn_unused bool validate_utf16le(const char16_t *buf,
+                                            size_t len) const noexcept final;
+  is_utf8_warn_unused bool validate_utf16be(const char16_t *buf,
+                                            size_t len) const noexcept final;
+  is_utf8_warn_unused bool
+  validate_utf8_padded(const char *buf, size_t len) const noexcept final;
 };
 
 } // namespace arm64
@@ -1537,6 +1924,52 @@ template <> struct simd8<int8_t> {
   }
 };
 
+// The first len bytes at ptr (all of them if len >= 16), followed by zeros. If
+// len < 16, they must be the last bytes of an input of at least 16 bytes:
+// they are shuffled out of the last 16 bytes of the input, so that nothing is
+// read past its end nor copied.
+is_utf8_really_inline uint8x16_t load_partial(const uint8_t *ptr, size_t len) {
+  static const uint8_t window[32] = {
+      0,    1,    2,    3,    4,    5,    6,    7,    8,    9,    10,
+      11,   12,   13,   14,   15,   0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+      0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80};
+  if (len >= 16) {
+    return vld1q_u8(ptr);
+  }
+  if (len == 0) {
+    return vdupq_n_u8(0);
+  }
+  // out of range indexes (0x80) give zeros
+  return vqtbl1q_u8(vld1q_u8(ptr + len - 16), vld1q_u8(window + 16 - len));
+}
+
+// 64 bytes of 0xFF then 64 zeros: the 64 bytes at keep_first(len) keep the
+// first len bytes of a block (len <= 64).
+is_utf8_really_inline const uint8_t *keep_first(size_t len) {
+  static const uint8_t mask[128] = {
+      0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+      0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+      0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+      0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+      0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+      0xFF, 0xFF, 0xFF, 0xFF, 0,    0,    0,    0,    0,    0,    0,    0,
+      0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,
+      0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,
+      0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,
+      0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,
+      0,    0,    0,    0,    0,    0,    0,    0};
+  return mask + 64 - len;
+}
+
+// The 16 bytes at ptr, the bytes where mask is zero cleared.
+is_utf8_really_inline uint8x16_t load_padded(const uint8_t *ptr,
+                                             const uint8_t *mask) {
+  return vandq_u8(vld1q_u8(ptr), vld1q_u8(mask));
+}
+
+// Tag of the constructor of simd8x64 that reads past the end of the input.
+struct padded_input {};
+
 template <typename T> struct simd8x64 {
   static constexpr int NUM_CHUNKS = 64 / sizeof(simd8<T>);
   static_assert(NUM_CHUNKS == 4,
@@ -1556,6 +1989,20 @@ template <typename T> struct simd8x64 {
                simd8<T>::load(ptr + sizeof(simd8<T>) / sizeof(T)),
                simd8<T>::load(ptr + 2 * sizeof(simd8<T>) / sizeof(T)),
                simd8<T>::load(ptr + 3 * sizeof(simd8<T>) / sizeof(T))} {}
+  // The last len < 64 bytes of an input of at least 16 bytes, followed by
+  // zeros (see load_partial).
+  is_utf8_really_inline simd8x64(const uint8_t *ptr, size_t len)
+      : chunks{load_partial(ptr, len),
+               load_partial(ptr + 16, len > 16 ? len - 16 : 0),
+               load_partial(ptr + 32, len > 32 ? len - 32 : 0),
+               load_partial(ptr + 48, len > 48 ? len - 48 : 0)} {}
+  // The last len < 64 bytes of an input followed by at least 64 readable
+  // bytes, followed by zeros: the whole block is read, then masked.
+  is_utf8_really_inline simd8x64(const uint8_t *ptr, size_t len, padded_input)
+      : chunks{load_padded(ptr, keep_first(len)),
+               load_padded(ptr + 16, keep_first(len) + 16),
+               load_padded(ptr + 32, keep_first(len) + 32),
+               load_padded(ptr + 48, keep_first(len) + 48)} {}
 
   is_utf8_really_inline void store(T *ptr) const {
     this->chunks[0].store(ptr + sizeof(simd8<T>) * 0 / sizeof(T));
@@ -2307,6 +2754,39 @@ public:
                 internal::instruction_set::AVX512VBMI2) {}
   is_utf8_warn_unused bool validate_utf8(const char *buf,
                                          size_t len) const noexcept final;
+  is_utf8_warn_unused result
+  validate_utf8_with_errors(const char *buf, size_t len) const noexcept final;
+  is_utf8_warn_unused bool
+  validate_utf8_early_exit(const char *buf, size_t len) const noexcept final;
+  void utf8_stream_init(void *state) const noexcept final;
+  is_utf8_warn_unused bool utf8_stream_update(void *state, const char *buf,
+                                              size_t len) const noexcept final;
+  is_utf8_warn_unused bool utf8_stream_finish(void *state, const char *buf,
+                                              size_t len) const noexcept final;
+  size_t validate_utf8_batch(const char *const *bufs, const size_t *lens,
+                             size_t count,
+                             uint8_t *results) const noexcept final;
+  is_utf8_warn_unused size_t
+  find_first_invalid_utf8(const char *const *bufs, const size_t *lens,
+                          size_t count) const noexcept final;
+  validate_utf8_function get_validate_utf8_function() const noexcept final;
+  is_utf8_warn_unused result
+  convert_utf8_to_utf16le_with_errors(const char *buf, size_t len,
+                                      char16_t *utf16_output) const noexcept final;
+  is_utf8_warn_unused result
+  convert_utf8_to_utf16be_with_errors(const char *buf, size_t len,
+                                      char16_t *utf16_output) const noexcept final;
+  is_utf8_warn_unused size_t
+  utf16_length_from_utf8(const char *buf, size_t len) const noexcept final;
+  is_utf8_warn_unused bool
+  validate_utf8_profile(const char *buf, size_t len,
+                        utf8_profile *profile) const noexcept final;
+  is_utf8_warn_unused bool validate_utf16le(const char16_t *buf,
+                                            size_t len) const noexcept final;
+  is_utf8_warn_unused bool validate_utf16be(const char16_t *buf,
+                                            size_t len) const noexcept final;
+  is_utf8_warn_unused bool
+  validate_utf8_padded(const char *buf, size_t len) const noexcept final;
 };
 
 } // namespace icelake
@@ -2322,100 +2802,356 @@ IS_UTF8_POP_DISABLE_WARNINGS
 #endif // IS_UTF8_IMPLEMENTATION_ICELAKE
 #endif // IS_UTF8_ICELAKE_H
 
-#ifndef IS_UTF8_HASWELL_H
-#define IS_UTF8_HASWELL_H
+#ifndef IS_UTF8_SKYLAKE_X_H
+#define IS_UTF8_SKYLAKE_X_H
 
-#ifdef IS_UTF8_WESTMERE_H
-#error "haswell.h must be included before westmere.h"
+// Skylake-X and Cascade Lake servers have AVX-512BW but not VBMI2. The icelake
+// kernel only needs AVX-512BW (byte shuffles, saturated subtractions, masked
+// loads and compares): skylake_x is the same kernel, for these processors.
+// The kernel is compiled once, for AVX-512BW, in namespace avx512bw, and both
+// implementations call it.
+#ifndef IS_UTF8_IMPLEMENTATION_SKYLAKE_X
+#if IS_UTF8_CAN_ALWAYS_RUN_ICELAKE
+#define IS_UTF8_IMPLEMENTATION_SKYLAKE_X 0
+#else
+#define IS_UTF8_IMPLEMENTATION_SKYLAKE_X (IS_UTF8_IS_X86_64)
 #endif
-#ifdef IS_UTF8_FALLBACK_H
-#error "haswell.h must be included before fallback.h"
 #endif
 
-// Default Haswell to on if this is x86-64. Even if we're not compiled for it,
-// it could be selected at runtime.
-#ifndef IS_UTF8_IMPLEMENTATION_HASWELL
-//
-// You do not want to restrict it like so: IS_UTF8_IS_X86_64 && __AVX2__
-// because we want to rely on *runtime dispatch*.
-//
-#if IS_UTF8_CAN_ALWAYS_RUN_ICELAKE
-#define IS_UTF8_IMPLEMENTATION_HASWELL 0
+#define IS_UTF8_CAN_ALWAYS_RUN_SKYLAKE_X                                       \
+  ((IS_UTF8_IMPLEMENTATION_SKYLAKE_X) && (IS_UTF8_IS_X86_64) && (__AVX2__) &&  \
+   (IS_UTF8_HAS_AVX512F && IS_UTF8_HAS_AVX512DQ && IS_UTF8_HAS_AVX512VL &&     \
+    IS_UTF8_HAS_AVX512BW) &&                                                   \
+   (!IS_UTF8_IS_32BITS))
+
+#define IS_UTF8_IMPLEMENTATION_AVX512BW                                        \
+  ((IS_UTF8_IMPLEMENTATION_ICELAKE) || (IS_UTF8_IMPLEMENTATION_SKYLAKE_X))
+
+#if IS_UTF8_IMPLEMENTATION_AVX512BW
+#if IS_UTF8_CAN_ALWAYS_RUN_ICELAKE || IS_UTF8_CAN_ALWAYS_RUN_SKYLAKE_X
+#define IS_UTF8_TARGET_AVX512BW
+#define IS_UTF8_UNTARGET_AVX512BW
 #else
-#define IS_UTF8_IMPLEMENTATION_HASWELL (IS_UTF8_IS_X86_64)
+#define IS_UTF8_TARGET_AVX512BW                                                \
+  IS_UTF8_TARGET_REGION("avx512f,avx512dq,avx512cd,avx512bw,avx512vl,avx2,"    \
+                        "bmi,bmi2,pclmul,lzcnt")
+#define IS_UTF8_UNTARGET_AVX512BW IS_UTF8_UNTARGET_REGION
 #endif
-
 #endif
-// To see why  (__BMI__) && (__PCLMUL__) && (__LZCNT__) are not part of this
-// next line, see https://github.com/simdutf/simdutf/issues/1247
-#if ((IS_UTF8_IMPLEMENTATION_HASWELL) && (IS_UTF8_IS_X86_64) && (__AVX2__))
-#define IS_UTF8_CAN_ALWAYS_RUN_HASWELL  1
+
+#if IS_UTF8_IMPLEMENTATION_SKYLAKE_X
+#if IS_UTF8_CAN_ALWAYS_RUN_SKYLAKE_X
+#define IS_UTF8_TARGET_SKYLAKE_X
+#define IS_UTF8_UNTARGET_SKYLAKE_X
 #else
-#define IS_UTF8_CAN_ALWAYS_RUN_HASWELL  0
+#define IS_UTF8_TARGET_SKYLAKE_X                                               \
+  IS_UTF8_TARGET_REGION("avx512f,avx512dq,avx512cd,avx512bw,avx512vl,avx2,"    \
+                        "bmi,bmi2,pclmul,lzcnt")
+#define IS_UTF8_UNTARGET_SKYLAKE_X IS_UTF8_UNTARGET_REGION
 #endif
 
-#if IS_UTF8_IMPLEMENTATION_HASWELL
-
-#define IS_UTF8_TARGET_HASWELL IS_UTF8_TARGET_REGION("avx2,bmi,pclmul,lzcnt")
-
-namespace is_utf8_internals {
-/**
- * Implementation for Haswell (Intel AVX2).
- */
-namespace haswell {} // namespace haswell
-} // namespace is_utf8_internals
-
-//
-// These two need to be included outside IS_UTF8_TARGET_REGION
-//
+#ifdef IS_UTF8_VISUAL_STUDIO
+#include <immintrin.h>
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
 
-#ifndef IS_UTF8_HASWELL_IMPLEMENTATION_H
-#define IS_UTF8_HASWELL_IMPLEMENTATION_H
+#ifndef IS_UTF8_SKYLAKE_X_IMPLEMENTATION_H
+#define IS_UTF8_SKYLAKE_X_IMPLEMENTATION_H
 
-// The constructor may be executed on any host, so we take care not to use
-// IS_UTF8_TARGET_REGION
 namespace is_utf8_internals {
-namespace haswell {
+namespace skylake_x {
 
 class implementation final : public is_utf8_internals::implementation {
 public:
   is_utf8_really_inline implementation()
       : is_utf8_internals::implementation(
-            "haswell", "Intel/AMD AVX2",
+            "skylake_x",
+            "Intel AVX512 (AVX-512BW, AVX-512CD, AVX-512DQ, AVX-512VL "
+            "extensions)",
             internal::instruction_set::AVX2 |
                 internal::instruction_set::PCLMULQDQ |
                 internal::instruction_set::BMI1 |
-                internal::instruction_set::BMI2) {}
+                internal::instruction_set::BMI2 |
+                internal::instruction_set::AVX512BW |
+                internal::instruction_set::AVX512CD |
+                internal::instruction_set::AVX512DQ |
+                internal::instruction_set::AVX512VL) {}
   is_utf8_warn_unused bool validate_utf8(const char *buf,
                                          size_t len) const noexcept final;
+  is_utf8_warn_unused result
+  validate_utf8_with_errors(const char *buf, size_t len) const noexcept final;
+  is_utf8_warn_unused bool
+  validate_utf8_early_exit(const char *buf, size_t len) const noexcept final;
+  void utf8_stream_init(void *state) const noexcept final;
+  is_utf8_warn_unused bool utf8_stream_update(void *state, const char *buf,
+                                              size_t len) const noexcept final;
+  is_utf8_warn_unused bool utf8_stream_finish(void *state, const char *buf,
+                                              size_t len) const noexcept final;
+  size_t validate_utf8_batch(const char *const *bufs, const size_t *lens,
+                             size_t count,
+                             uint8_t *results) const noexcept final;
+  is_utf8_warn_unused size_t
+  find_first_invalid_utf8(const char *const *bufs, const size_t *lens,
+                          size_t count) const noexcept final;
+  validate_utf8_function get_validate_utf8_function() const noexcept final;
+  is_utf8_warn_unused result
+  convert_utf8_to_utf16le_with_errors(const char *buf, size_t len,
+                                      char16_t *utf16_output) const noexcept final;
+  is_utf8_warn_unused result
+  convert_utf8_to_utf16be_with_errors(const char *buf, size_t len,
+                                      char16_t *utf16_output) const noexcept final;
+  is_utf8_warn_unused size_t
+  utf16_length_from_utf8(const char *buf, size_t len) const noexcept final;
+  is_utf8_warn_unused bool
+  validate_utf8_profile(const char *buf, size_t len,
+                        utf8_profile *profile) const noexcept final;
+  is_utf8_warn_unused bool validate_utf16le(const char16_t *buf,
+                                            size_t len) const noexcept final;
+  is_utf8_warn_unused bool validate_utf16be(const char16_t *buf,
+                                            size_t len) const noexcept final;
+  is_utf8_warn_unused bool
+  validate_utf8_padded(const char *buf, size_t len) const noexcept final;
 };
 
-} // namespace haswell
+} // namespace skylake_x
 } // namespace is_utf8_internals
 
-#endif // IS_UTF8_HASWELL_IMPLEMENTATION_H
+#endif // IS_UTF8_SKYLAKE_X_IMPLEMENTATION_H
 
-#ifndef IS_UTF8_HASWELL_INTRINSICS_H
-#define IS_UTF8_HASWELL_INTRINSICS_H
+#endif // IS_UTF8_IMPLEMENTATION_SKYLAKE_X
+#endif // IS_UTF8_SKYLAKE_X_H
 
-#ifdef IS_UTF8_VISUAL_STUDIO
-// under clang within visual studio, this will include <x86intrin.h>
-#include <intrin.h> // visual studio or clang
-#else
+#ifndef IS_UTF8_AVX512VL_H
+#define IS_UTF8_AVX512VL_H
 
-#if IS_UTF8_GCC11ORMORE
-// We should not get warnings while including <x86intrin.h> yet we do
-// under some versions of GCC.
-// If the x86intrin.h header has uninitialized values that are problematic,
-// it is a GCC issue, we want to ignore these warnings.
-IS_UTF8_DISABLE_GCC_WARNING(-Wuninitialized)
+// The icelake kernel on 256-bit registers: the masked loads, ternary logic and
+// compares into mask registers of AVX-512VL, without the 512-bit registers
+// that lower the frequency of Skylake-X and Cascade Lake cores, and of their
+// neighbours, next to other vector code.
+#ifndef IS_UTF8_IMPLEMENTATION_AVX512VL
+#define IS_UTF8_IMPLEMENTATION_AVX512VL (IS_UTF8_IS_X86_64)
 #endif
 
-#include <x86intrin.h> // elsewhere
+#define IS_UTF8_CAN_ALWAYS_RUN_AVX512VL                                        \
+  ((IS_UTF8_IMPLEMENTATION_AVX512VL) && (IS_UTF8_IS_X86_64) && (__AVX2__) &&   \
+   (IS_UTF8_HAS_AVX512F && IS_UTF8_HAS_AVX512DQ && IS_UTF8_HAS_AVX512VL &&     \
+    IS_UTF8_HAS_AVX512BW) &&                                                   \
+   (!IS_UTF8_IS_32BITS))
 
-#if IS_UTF8_GCC11ORMORE
-// cancels the suppression of the -Wuninitialized
-IS_UTF8_POP_DISABLE_WARNINGS
+#if IS_UTF8_IMPLEMENTATION_AVX512VL
+#if IS_UTF8_CAN_ALWAYS_RUN_AVX512VL
+#define IS_UTF8_TARGET_AVX512VL
+#define IS_UTF8_UNTARGET_AVX512VL
+#else
+#define IS_UTF8_TARGET_AVX512VL                                                \
+  IS_UTF8_TARGET_REGION("avx512f,avx512dq,avx512cd,avx512bw,avx512vl,avx2,"    \
+                        "bmi,bmi2,pclmul,lzcnt")
+#define IS_UTF8_UNTARGET_AVX512VL IS_UTF8_UNTARGET_REGION
+#endif
+
+#ifdef IS_UTF8_VISUAL_STUDIO
+#include <immintrin.h>
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+#ifndef IS_UTF8_AVX512VL_IMPLEMENTATION_H
+#define IS_UTF8_AVX512VL_IMPLEMENTATION_H
+
+namespace is_utf8_internals {
+namespace avx512vl {
+
+class implementation final : public is_utf8_internals::implementation {
+public:
+  is_utf8_really_inline implementation()
+      : is_utf8_internals::implementation(
+            "avx512vl",
+            "Intel AVX512 on 256-bit registers (AVX-512BW, AVX-512VL "
+            "extensions)",
+            internal::instruction_set::AVX2 |
+                internal::instruction_set::PCLMULQDQ |
+                internal::instruction_set::BMI1 |
+                internal::instruction_set::BMI2 |
+                internal::instruction_set::AVX512BW |
+                internal::instruction_set::AVX512CD |
+                internal::instruction_set::AVX512DQ |
+                internal::instruction_set::AVX512VL) {}
+  is_utf8_warn_unused bool validate_utf8(const char *buf,
+                                         size_t len) const noexcept final;
+  is_utf8_warn_unused result
+  validate_utf8_with_errors(const char *buf, size_t len) const noexcept final;
+  is_utf8_warn_unused bool
+  validate_utf8_early_exit(const char *buf, size_t len) const noexcept final;
+  void utf8_stream_init(void *state) const noexcept final;
+  is_utf8_warn_unused bool utf8_stream_update(void *state, const char *buf,
+                                              size_t len) const noexcept final;
+  is_utf8_warn_unused bool utf8_stream_finish(void *state, const char *buf,
+                                              size_t len) const noexcept final;
+  size_t validate_utf8_batch(const char *const *bufs, const size_t *lens,
+                             size_t count,
+                             uint8_t *results) const noexcept final;
+  is_utf8_warn_unused size_t
+  find_first_invalid_utf8(const char *const *bufs, const size_t *lens,
+                          size_t count) const noexcept final;
+  validate_utf8_function get_validate_utf8_function() const noexcept final;
+  is_utf8_warn_unused result
+  convert_utf8_to_utf16le_with_errors(const char *buf, size_t len,
+                                      char16_t *utf16_output) const noexcept final;
+  is_utf8_warn_unused result
+  convert_utf8_to_utf16be_with_errors(const char *buf, size_t len,
+                                      char16_t *utf16_output) const noexcept final;
+  is_utf8_warn_unused size_t
+  utf16_length_from_utf8(const char *buf, size_t len) const noexcept final;
+  is_utf8_warn_unused bool
+  validate_utf8_profile(const char *buf, size_t len,
+                        utf8_profile *profile) const noexcept final;
+  is_utf8_warn_unused bool validate_utf16le(const char16_t *buf,
+                                            size_t len) const noexcept final;
+  is_utf8_warn_unused bool validate_utf16be(const char16_t *buf,
+                                            size_t len) const noexcept final;
+  is_utf8_warn_unused bool
+  validate_utf8_padded(const char *buf, size_t len) const noexcept final;
+};
+
+} // namespace avx512vl
+} // namespace is_utf8_internals
+
+#endif // IS_UTF8_AVX512VL_IMPLEMENTATION_H
+
+#endif // IS_UTF8_IMPLEMENTATION_AVX512VL
+#endif // IS_UTF8_AVX512VL_H
+
+#ifndef IS_UTF8_HASWELL_H
+#define IS_UTF8_HASWELL_H
+
+#ifdef IS_UTF8_WESTMERE_H
+#error "haswell.h must be included before westmere.h"
+#endif
+#ifdef IS_UTF8_FALLBACK_H
+#error "haswell.h must be included before fallback.h"
+#endif
+
+// Default Haswell to on if this is x86-64. Even if we're not compiled for it,
+// it could be selected at runtime.
+#ifndef IS_UTF8_IMPLEMENTATION_HASWELL
+//
+// You do not want to restrict it like so: IS_UTF8_IS_X86_64 && __AVX2__
+// because we want to rely on *runtime dispatch*.
+//
+#if IS_UTF8_CAN_ALWAYS_RUN_ICELAKE || IS_UTF8_CAN_ALWAYS_RUN_SKYLAKE_X ||      \
+    IS_UTF8_CAN_ALWAYS_RUN_AVX512VL
+#define IS_UTF8_IMPLEMENTATION_HASWELL 0
+#else
+#define IS_UTF8_IMPLEMENTATION_HASWELL (IS_UTF8_IS_X86_64)
+#endif
+
+#endif
+// To see why  (__BMI__) && (__PCLMUL__) && (__LZCNT__) are not part of this
+// next line, see https://github.com/simdutf/simdutf/issues/1247
+#if ((IS_UTF8_IMPLEMENTATION_HASWELL) && (IS_UTF8_IS_X86_64) && (__AVX2__))
+#define IS_UTF8_CAN_ALWAYS_RUN_HASWELL  1
+#else
+#define IS_UTF8_CAN_ALWAYS_RUN_HASWELL  0
+#endif
+
+#if IS_UTF8_IMPLEMENTATION_HASWELL
+
+#define IS_UTF8_TARGET_HASWELL IS_UTF8_TARGET_REGION("avx2,bmi,pclmul,lzcnt")
+
+namespace is_utf8_internals {
+/**
+ * Implementation for Haswell (Intel AVX2).
+ */
+namespace haswell {} // namespace haswell
+} // namespace is_utf8_internals
+
+//
+// These two need to be included outside IS_UTF8_TARGET_REGION
+//
+
+#ifndef IS_UTF8_HASWELL_IMPLEMENTATION_H
+#define IS_UTF8_HASWELL_IMPLEMENTATION_H
+
+// The constructor may be executed on any host, so we take care not to use
+// IS_UTF8_TARGET_REGION
+namespace is_utf8_internals {
+namespace haswell {
+
+class implementation final : public is_utf8_internals::implementation {
+public:
+  is_utf8_really_inline implementation()
+      : is_utf8_internals::implementation(
+            "haswell", "Intel/AMD AVX2",
+            internal::instruction_set::AVX2 |
+                internal::instruction_set::PCLMULQDQ |
+                internal::instruction_set::BMI1 |
+                internal::instruction_set::BMI2) {}
+  is_utf8_warn_unused bool validate_utf8(const char *buf,
+                                         size_t len) const noexcept final;
+  is_utf8_warn_unused result
+  validate_utf8_with_errors(const char *buf, size_t len) const noexcept final;
+  is_utf8_warn_unused bool
+  validate_utf8_early_exit(const char *buf, size_t len) const noexcept final;
+  void utf8_stream_init(void *state) const noexcept final;
+  is_utf8_warn_unused bool utf8_stream_update(void *state, const char *buf,
+                                              size_t len) const noexcept final;
+  is_utf8_warn_unused bool utf8_stream_finish(void *state, const char *buf,
+                                              size_t len) const noexcept final;
+  size_t validate_utf8_batch(const char *const *bufs, const size_t *lens,
+                             size_t count,
+                             uint8_t *results) const noexcept final;
+  is_utf8_warn_unused size_t
+  find_first_invalid_utf8(const char *const *bufs, const size_t *lens,
+                          size_t count) const noexcept final;
+  validate_utf8_function get_validate_utf8_function() const noexcept final;
+  is_utf8_warn_unused result
+  convert_utf8_to_utf16le_with_errors(const char *buf, size_t len,
+                                      char16_t *utf16_output) const noexcept final;
+  is_utf8_warn_unused result
+  convert_utf8_to_utf16be_with_errors(const char *buf, size_t len,
+                                      char16_t *utf16_output) const noexcept final;
+  is_utf8_warn_unused size_t
+  utf16_length_from_utf8(const char *buf, size_t len) const noexcept final;
+  is_utf8_warn_unused bool
+  validate_utf8_profile(const char *buf, size_t len,
+                        utf8_profile *profile) const noexcept final;
+  is_utf8_warn_unused bool validate_utf16le(const char16_t *buf,
+                                            size_t len) const noexcept final;
+  is_utf8_warn_unused bool validate_utf16be(const char16_t *buf,
+                                            size_t len) const noexcept final;
+  is_utf8_warn_unused bool
+  validate_utf8_padded(const char *buf, size_t len) const noexcept final;
+};
+
+} // namespace haswell
+} // namespace is_utf8_internals
+
+#endif // IS_UTF8_HASWELL_IMPLEMENTATION_H
+
+#ifndef IS_UTF8_HASWELL_INTRINSICS_H
+#define IS_UTF8_HASWELL_INTRINSICS_H
+
+#ifdef IS_UTF8_VISUAL_STUDIO
+// under clang within visual studio, this will include <x86intrin.h>
+#include <intrin.h> // visual studio or clang
+#else
+
+#if IS_UTF8_GCC11ORMORE
+// We should not get warnings while including <x86intrin.h> yet we do
+// under some versions of GCC.
+// If the x86intrin.h header has uninitialized values that are problematic,
+// it is a GCC issue, we want to ignore these warnings.
+IS_UTF8_DISABLE_GCC_WARNING(-Wuninitialized)
+#endif
+
+#include <x86intrin.h> // elsewhere
+
+#if IS_UTF8_GCC11ORMORE
+// cancels the suppression of the -Wuninitialized
+IS_UTF8_POP_DISABLE_WARNINGS
 #endif
 
 #endif // IS_UTF8_VISUAL_STUDIO
@@ -2830,6 +3566,68 @@ is_utf8_really_inline simd8<int8_t>::operator simd8<uint8_t>() const {
   return this->value;
 }
 
+// The first len bytes at ptr (all of them if len >= 16), followed by zeros. If
+// len < 16, they must be the last bytes of an input of at least 16 bytes:
+// they are shuffled out of the last 16 bytes of the input, so that nothing is
+// read past its end nor copied.
+is_utf8_really_inline __m128i load_partial_16(const uint8_t *ptr,
+                                              size_t len) {
+  static const uint8_t window[32] = {
+      0,    1,    2,    3,    4,    5,    6,    7,    8,    9,    10,
+      11,   12,   13,   14,   15,   0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+      0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80};
+  if (len >= 16) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr));
+  }
+  if (len == 0) {
+    return _mm_setzero_si128();
+  }
+  const __m128i last =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr + len - 16));
+  return _mm_shuffle_epi8(
+      last, _mm_loadu_si128(
+                reinterpret_cast<const __m128i *>(window + 16 - len)));
+}
+
+// As load_partial_16, on 32 bytes.
+is_utf8_really_inline __m256i load_partial(const uint8_t *ptr, size_t len) {
+  if (len >= 32) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ptr));
+  }
+  return _mm256_inserti128_si256(
+      _mm256_castsi128_si256(load_partial_16(ptr, len < 16 ? len : 16)),
+      load_partial_16(ptr + 16, len > 16 ? len - 16 : 0), 1);
+}
+
+// 64 bytes of 0xFF then 64 zeros: the 64 bytes at keep_first(len) keep the
+// first len bytes of a block (len <= 64).
+is_utf8_really_inline const uint8_t *keep_first(size_t len) {
+  static const uint8_t mask[128] = {
+      0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+      0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+      0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+      0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+      0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+      0xFF, 0xFF, 0xFF, 0xFF, 0,    0,    0,    0,    0,    0,    0,    0,
+      0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,
+      0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,
+      0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,
+      0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,
+      0,    0,    0,    0,    0,    0,    0,    0};
+  return mask + 64 - len;
+}
+
+// The 32 bytes at ptr, the bytes where mask is zero cleared.
+is_utf8_really_inline __m256i load_padded(const uint8_t *ptr,
+                                          const uint8_t *mask) {
+  return _mm256_and_si256(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ptr)),
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(mask)));
+}
+
+// Tag of the constructor of simd8x64 that reads past the end of the input.
+struct padded_input {};
+
 template <typename T> struct simd8x64 {
   static constexpr int NUM_CHUNKS = 64 / sizeof(simd8<T>);
   static_assert(NUM_CHUNKS == 2,
@@ -2846,6 +3644,16 @@ template <typename T> struct simd8x64 {
   is_utf8_really_inline simd8x64(const T *ptr)
       : chunks{simd8<T>::load(ptr),
                simd8<T>::load(ptr + sizeof(simd8<T>) / sizeof(T))} {}
+  // The last len < 64 bytes of an input of at least 16 bytes, followed by
+  // zeros (see load_partial).
+  is_utf8_really_inline simd8x64(const uint8_t *ptr, size_t len)
+      : chunks{load_partial(ptr, len),
+               load_partial(ptr + 32, len > 32 ? len - 32 : 0)} {}
+  // The last len < 64 bytes of an input followed by at least 64 readable
+  // bytes, followed by zeros: the whole block is read, then masked.
+  is_utf8_really_inline simd8x64(const uint8_t *ptr, size_t len, padded_input)
+      : chunks{load_padded(ptr, keep_first(len)),
+               load_padded(ptr + 32, keep_first(len) + 32)} {}
 
   is_utf8_really_inline void store(T *ptr) const {
     this->chunks[0].store(ptr + sizeof(simd8<T>) * 0 / sizeof(T));
@@ -2914,9 +3722,7 @@ template <typename T> struct simd8x64 {
 
     return simd8x64<bool>(
                (this->chunks[0] <= mask_high) & (this->chunks[0] >= mask_low),
-               (this->chunks[1] <= mask_high) & (this->chunks[1] >= mask_low),
-               (this->chunks[2] <= mask_high) & (this->chunks[2] >= mask_low),
-               (this->chunks[3] <= mask_high) & (this->chunks[3] >= mask_low))
+               (this->chunks[1] <= mask_high) & (this->chunks[1] >= mask_low))
         .to_bitmask();
   }
   is_utf8_really_inline uint64_t not_in_range(const T low, const T high) const {
@@ -3292,9 +4098,7 @@ template <typename T> struct simd16x32 {
 
     return simd16x32<bool>(
                (this->chunks[0] <= mask_high) & (this->chunks[0] >= mask_low),
-               (this->chunks[1] <= mask_high) & (this->chunks[1] >= mask_low),
-               (this->chunks[2] <= mask_high) & (this->chunks[2] >= mask_low),
-               (this->chunks[3] <= mask_high) & (this->chunks[3] >= mask_low))
+               (this->chunks[1] <= mask_high) & (this->chunks[1] >= mask_low))
         .to_bitmask();
   }
   is_utf8_really_inline uint64_t not_in_range(const T low, const T high) const {
@@ -3343,7 +4147,8 @@ IS_UTF8_UNTARGET_REGION
 // You do not want to set it to (IS_UTF8_IS_X86_64 && !IS_UTF8_REQUIRES_HASWELL)
 // because you want to rely on runtime dispatch!
 //
-#if IS_UTF8_CAN_ALWAYS_RUN_ICELAKE || IS_UTF8_CAN_ALWAYS_RUN_HASWELL
+#if IS_UTF8_CAN_ALWAYS_RUN_ICELAKE || IS_UTF8_CAN_ALWAYS_RUN_SKYLAKE_X ||      \
+    IS_UTF8_CAN_ALWAYS_RUN_AVX512VL || IS_UTF8_CAN_ALWAYS_RUN_HASWELL
 #define IS_UTF8_IMPLEMENTATION_WESTMERE 0
 #else
 #define IS_UTF8_IMPLEMENTATION_WESTMERE (IS_UTF8_IS_X86_64)
@@ -3389,6 +4194,39 @@ public:
                 internal::instruction_set::PCLMULQDQ) {}
   is_utf8_warn_unused bool validate_utf8(const char *buf,
                                          size_t len) const noexcept final;
+  is_utf8_warn_unused result
+  validate_utf8_with_errors(const char *buf, size_t len) const noexcept final;
+  is_utf8_warn_unused bool
+  validate_utf8_early_exit(const char *buf, size_t len) const noexcept final;
+  void utf8_stream_init(void *state) const noexcept final;
+  is_utf8_warn_unused bool utf8_stream_update(void *state, const char *buf,
+                                              size_t len) const noexcept final;
+  is_utf8_warn_unused bool utf8_stream_finish(void *state, const char *buf,
+                                              size_t len) const noexcept final;
+  size_t validate_utf8_batch(const char *const *bufs, const size_t *lens,
+                             size_t count,
+                             uint8_t *results) const noexcept final;
+  is_utf8_warn_unused size_t
+  find_first_invalid_utf8(const char *const *bufs, const size_t *lens,
+                          size_t count) const noexcept final;
+  validate_utf8_function get_validate_utf8_function() const noexcept final;
+  is_utf8_warn_unused result
+  convert_utf8_to_utf16le_with_errors(const char *buf, size_t len,
+                                      char16_t *utf16_output) const noexcept final;
+  is_utf8_warn_unused result
+  convert_utf8_to_utf16be_with_errors(const char *buf, size_t len,
+                                      char16_t *utf16_output) const noexcept final;
+  is_utf8_warn_unused size_t
+  utf16_length_from_utf8(const char *buf, size_t len) const noexcept final;
+  is_utf8_warn_unused bool
+  validate_utf8_profile(const char *buf, size_t len,
+                        utf8_profile *profile) const noexcept final;
+  is_utf8_warn_unused bool validate_utf16le(const char16_t *buf,
+                                            size_t len) const noexcept final;
+  is_utf8_warn_unused bool validate_utf16be(const char16_t *buf,
+                                            size_t len) const noexcept final;
+  is_utf8_warn_unused bool
+  validate_utf8_padded(const char *buf, size_t len) const noexcept final;
 };
 
 } // namespace westmere
@@ -3889,6 +4727,57 @@ template <> struct simd8<uint16_t> : base<uint16_t> {
     return !bits_not_set_anywhere(bits);
   }
 };
+// The first len bytes at ptr (all of them if len >= 16), followed by zeros. If
+// len < 16, they must be the last bytes of an input of at least 16 bytes:
+// they are shuffled out of the last 16 bytes of the input, so that nothing is
+// read past its end nor copied.
+is_utf8_really_inline __m128i load_partial(const uint8_t *ptr, size_t len) {
+  static const uint8_t window[32] = {
+      0,    1,    2,    3,    4,    5,    6,    7,    8,    9,    10,
+      11,   12,   13,   14,   15,   0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+      0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80};
+  if (len >= 16) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr));
+  }
+  if (len == 0) {
+    return _mm_setzero_si128();
+  }
+  const __m128i last =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr + len - 16));
+  return _mm_shuffle_epi8(
+      last, _mm_loadu_si128(
+                reinterpret_cast<const __m128i *>(window + 16 - len)));
+}
+
+// 64 bytes of 0xFF then 64 zeros: the 64 bytes at keep_first(len) keep the
+// first len bytes of a block (len <= 64).
+is_utf8_really_inline const uint8_t *keep_first(size_t len) {
+  static const uint8_t mask[128] = {
+      0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+      0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+      0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+      0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+      0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+      0xFF, 0xFF, 0xFF, 0xFF, 0,    0,    0,    0,    0,    0,    0,    0,
+      0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,
+      0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,
+      0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,
+      0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,
+      0,    0,    0,    0,    0,    0,    0,    0};
+  return mask + 64 - len;
+}
+
+// The 16 bytes at ptr, the bytes where mask is zero cleared.
+is_utf8_really_inline __m128i load_padded(const uint8_t *ptr,
+                                          const uint8_t *mask) {
+  return _mm_and_si128(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr)),
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(mask)));
+}
+
+// Tag of the constructor of simd8x64 that reads past the end of the input.
+struct padded_input {};
+
 template <typename T> struct simd8x64 {
   static constexpr int NUM_CHUNKS = 64 / sizeof(simd8<T>);
   static_assert(NUM_CHUNKS == 4,
@@ -3908,6 +4797,20 @@ template <typename T> struct simd8x64 {
                simd8<T>::load(ptr + sizeof(simd8<T>) / sizeof(T)),
                simd8<T>::load(ptr + 2 * sizeof(simd8<T>) / sizeof(T)),
                simd8<T>::load(ptr + 3 * sizeof(simd8<T>) / sizeof(T))} {}
+  // The last len < 64 bytes of an input of at least 16 bytes, followed by
+  // zeros (see load_partial).
+  is_utf8_really_inline simd8x64(const uint8_t *ptr, size_t len)
+      : chunks{load_partial(ptr, len),
+               load_partial(ptr + 16, len > 16 ? len - 16 : 0),
+               load_partial(ptr + 32, len > 32 ? len - 32 : 0),
+               load_partial(ptr + 48, len > 48 ? len - 48 : 0)} {}
+  // The last len < 64 bytes of an input followed by at least 64 readable
+  // bytes, followed by zeros: the whole block is read, then masked.
+  is_utf8_really_inline simd8x64(const uint8_t *ptr, size_t len, padded_input)
+      : chunks{load_padded(ptr, keep_first(len)),
+               load_padded(ptr + 16, keep_first(len) + 16),
+               load_padded(ptr + 32, keep_first(len) + 32),
+               load_padded(ptr + 48, keep_first(len) + 48)} {}
 
   is_utf8_really_inline void store(T *ptr) const {
     this->chunks[0].store(ptr + sizeof(simd8<T>) * 0 / sizeof(T));
@@ -4414,6 +5317,7 @@ IS_UTF8_UNTARGET_REGION
 // selected.
 #ifndef IS_UTF8_IMPLEMENTATION_FALLBACK
 #if IS_UTF8_CAN_ALWAYS_RUN_ARM64 || IS_UTF8_CAN_ALWAYS_RUN_ICELAKE ||          \
+    IS_UTF8_CAN_ALWAYS_RUN_SKYLAKE_X || IS_UTF8_CAN_ALWAYS_RUN_AVX512VL ||     \
     IS_UTF8_CAN_ALWAYS_RUN_HASWELL || IS_UTF8_CAN_ALWAYS_RUN_WESTMERE ||       \
     IS_UTF8_CAN_ALWAYS_RUN_PPC64
 #define IS_UTF8_IMPLEMENTATION_FALLBACK 0
@@ -4450,6 +5354,39 @@ public:
             "fallback", "Generic fallback implementation", 0) {}
   is_utf8_warn_unused bool validate_utf8(const char *buf,
                                          size_t len) const noexcept final;
+  is_utf8_warn_unused result
+  validate_utf8_with_errors(const char *buf, size_t len) const noexcept final;
+  is_utf8_warn_unused bool
+  validate_utf8_early_exit(const char *buf, size_t len) const noexcept final;
+  void utf8_stream_init(void *state) const noexcept final;
+  is_utf8_warn_unused bool utf8_stream_update(void *state, const char *buf,
+                                              size_t len) const noexcept final;
+  is_utf8_warn_unused bool utf8_stream_finish(void *state, const char *buf,
+                                              size_t len) const noexcept final;
+  size_t validate_utf8_batch(const char *const *bufs, const size_t *lens,
+                             size_t count,
+                             uint8_t *results) const noexcept final;
+  is_utf8_warn_unused size_t
+  find_first_invalid_utf8(const char *const *bufs, const size_t *lens,
+                          size_t count) const noexcept final;
+  validate_utf8_function get_validate_utf8_function() const noexcept final;
+  is_utf8_warn_unused result
+  convert_utf8_to_utf16le_with_errors(const char *buf, size_t len,
+                                      char16_t *utf16_output) const noexcept final;
+  is_utf8_warn_unused result
+  convert_utf8_to_utf16be_with_errors(const char *buf, size_t len,
+                                      char16_t *utf16_output) const noexcept final;
+  is_utf8_warn_unused size_t
+  utf16_length_from_utf8(const char *buf, size_t len) const noexcept final;
+  is_utf8_warn_unused bool
+  validate_utf8_profile(const char *buf, size_t len,
+                        utf8_profile *profile) const noexcept final;
+  is_utf8_warn_unused bool validate_utf16le(const char16_t *buf,
+                                            size_t len) const noexcept final;
+  is_utf8_warn_unused bool validate_utf16be(const char16_t *buf,
+                                            size_t len) const noexcept final;
+  is_utf8_warn_unused bool
+  validate_utf8_padded(const char *buf, size_t len) const noexcept final;
 };
 
 } // namespace fallback
@@ -4514,6 +5451,12 @@ namespace internal {
 #if IS_UTF8_IMPLEMENTATION_ICELAKE
 const icelake::implementation icelake_singleton{};
 #endif
+#if IS_UTF8_IMPLEMENTATION_SKYLAKE_X
+const skylake_x::implementation skylake_x_singleton{};
+#endif
+#if IS_UTF8_IMPLEMENTATION_AVX512VL
+const avx512vl::implementation avx512vl_singleton{};
+#endif
 #if IS_UTF8_IMPLEMENTATION_HASWELL
 const haswell::implementation haswell_singleton{};
 #endif
@@ -4549,6 +5492,94 @@ public:
     return set_best()->validate_utf8(buf, len);
   }
 
+  is_utf8_warn_unused result validate_utf8_with_errors(
+      const char *buf, size_t len) const noexcept final override {
+    return set_best()->validate_utf8_with_errors(buf, len);
+  }
+
+  is_utf8_warn_unused bool
+  validate_utf8_early_exit(const char *buf,
+                           size_t len) const noexcept final override {
+    return set_best()->validate_utf8_early_exit(buf, len);
+  }
+
+  void utf8_stream_init(void *state) const noexcept final override {
+    return set_best()->utf8_stream_init(state);
+  }
+
+  is_utf8_warn_unused bool
+  utf8_stream_update(void *state, const char *buf,
+                     size_t len) const noexcept final override {
+    return set_best()->utf8_stream_update(state, buf, len);
+  }
+
+  is_utf8_warn_unused bool
+  utf8_stream_finish(void *state, const char *buf,
+                     size_t len) const noexcept final override {
+    return set_best()->utf8_stream_finish(state, buf, len);
+  }
+
+  size_t validate_utf8_batch(const char *const *bufs, const size_t *lens,
+                             size_t count,
+                             uint8_t *results) const noexcept final override {
+    return set_best()->validate_utf8_batch(bufs, lens, count, results);
+  }
+
+  is_utf8_warn_unused size_t
+  find_first_invalid_utf8(const char *const *bufs, const size_t *lens,
+                          size_t count) const noexcept final override {
+    return set_best()->find_first_invalid_utf8(bufs, lens, count);
+  }
+
+  validate_utf8_function
+  get_validate_utf8_function() const noexcept final override {
+    return set_best()->get_validate_utf8_function();
+  }
+
+  is_utf8_warn_unused result convert_utf8_to_utf16le_with_errors(
+      const char *buf, size_t len,
+      char16_t *utf16_output) const noexcept final override {
+    return set_best()->convert_utf8_to_utf16le_with_errors(buf, len,
+                                                           utf16_output);
+  }
+
+  is_utf8_warn_unused result convert_utf8_to_utf16be_with_errors(
+      const char *buf, size_t len,
+      char16_t *utf16_output) const noexcept final override {
+    return set_best()->convert_utf8_to_utf16be_with_errors(buf, len,
+                                                           utf16_output);
+  }
+
+  is_utf8_warn_unused size_t
+  utf16_length_from_utf8(const char *buf,
+                         size_t len) const noexcept final override {
+    return set_best()->utf16_length_from_utf8(buf, len);
+  }
+
+  is_utf8_warn_unused bool
+  validate_utf8_profile(const char *buf, size_t len,
+                        utf8_profile *profile) const noexcept final override {
+    return set_best()->validate_utf8_profile(buf, len, profile);
+  }
+
+  is_utf8_warn_unused bool
+  validate_utf16le(const char16_t *buf,
+                   size_t len) const noexcept final override {
+    return set_best()->validate_utf16le(buf, len);
+  }
+
+  is_utf8_warn_unused bool
+  validate_utf16be(const char16_t *buf,
+                   size_t len) const noexcept final override {
+    return set_best()->validate_utf16be(buf, len);
+  }
+
+  is_utf8_warn_unused bool
+  validate_utf8_padded(const char *buf,
+                       size_t len) const noexcept final override {
+    return set_best()->validate_utf8_padded(buf, len);
+  }
+
   is_utf8_really_inline
   detect_best_supported_implementation_on_first_use() noexcept
       : implementation("best_supported_detector",
@@ -4567,6 +5598,12 @@ const std::initializer_list<const implementation *>
 #if IS_UTF8_IMPLEMENTATION_ICELAKE
   &icelake_singleton,
 #endif
+#if IS_UTF8_IMPLEMENTATION_SKYLAKE_X
+      &skylake_x_singleton,
+#endif
+#if IS_UTF8_IMPLEMENTATION_AVX512VL
+      &avx512vl_singleton,
+#endif
 #if IS_UTF8_IMPLEMENTATION_HASWELL
       &haswell_singleton,
 #endif
@@ -4587,6 +5624,8 @@ const std::initializer_list<const implementation *>
 // So we can return UNSUPPORTED_ARCHITECTURE from the parser when there is no
 // support
 class unsupported_implementation final : public implementation {
+  static bool refuse_to_validate_utf8(const char *, size_t) { return false; }
+
 public:
   is_utf8_warn_unused bool validate_utf8(const char *,
                                          size_t) const noexcept final override {
@@ -4603,6 +5642,83 @@ public:
     // fallback for our fallback.
   }
 
+  is_utf8_warn_unused result validate_utf8_with_errors(
+      const char *, size_t) const noexcept final override {
+    return result(error_code::OTHER, 0);
+  }
+
+  is_utf8_warn_unused bool
+  validate_utf8_early_exit(const char *, size_t) const noexcept final override {
+    return false;
+  }
+
+  void utf8_stream_init(void *) const noexcept final override {}
+
+  is_utf8_warn_unused bool
+  utf8_stream_update(void *, const char *,
+                     size_t) const noexcept final override {
+    return false;
+  }
+
+  is_utf8_warn_unused bool
+  utf8_stream_finish(void *, const char *,
+                     size_t) const noexcept final override {
+    return false;
+  }
+
+  size_t validate_utf8_batch(const char *const *, const size_t *, size_t count,
+                             uint8_t *results) const noexcept final override {
+    std::memset(results, 0, count);
+    return 0;
+  }
+
+  is_utf8_warn_unused size_t
+  find_first_invalid_utf8(const char *const *, const size_t *,
+                          size_t) const noexcept final override {
+    return 0;
+  }
+
+  validate_utf8_function
+  get_validate_utf8_function() const noexcept final override {
+    return &refuse_to_validate_utf8;
+  }
+
+  is_utf8_warn_unused result convert_utf8_to_utf16le_with_errors(
+      const char *, size_t, char16_t *) const noexcept final override {
+    return result(error_code::OTHER, 0);
+  }
+
+  is_utf8_warn_unused result convert_utf8_to_utf16be_with_errors(
+      const char *, size_t, char16_t *) const noexcept final override {
+    return result(error_code::OTHER, 0);
+  }
+
+  is_utf8_warn_unused size_t
+  utf16_length_from_utf8(const char *, size_t) const noexcept final override {
+    return 0;
+  }
+
+  is_utf8_warn_unused bool
+  validate_utf8_profile(const char *, size_t,
+                        utf8_profile *) const noexcept final override {
+    return false;
+  }
+
+  is_utf8_warn_unused bool
+  validate_utf16le(const char16_t *, size_t) const noexcept final override {
+    return false;
+  }
+
+  is_utf8_warn_unused bool
+  validate_utf16be(const char16_t *, size_t) const noexcept final override {
+    return false;
+  }
+
+  is_utf8_warn_unused bool
+  validate_utf8_padded(const char *, size_t) const noexcept final override {
+    return false;
+  }
+
   unsupported_implementation()
       : implementation("unsupported",
                        "Unsupported CPU (no detected SIMD instructions)", 0) {}
@@ -4638,23 +5754,120 @@ available_implementation_list::detect_best_supported() const noexcept {
 }
 
 const implementation *
-detect_best_supported_implementation_on_first_use::set_best() const noexcept {
+available_implementation_list::detect_fastest_supported(size_t len) const
+    noexcept {
+  static const char sample[] =
+      "The caf\xc3\xa9 on the corner charges \xe2\x82\xac" "3 for a tea "
+      "\xf0\x9f\x8d\xb5 and \xe4\xb8\x89 for a cake; "
+      "the \xd0\xbc\xd0\xb5\xd0\xbd\xd1\x8e is in four scripts.\n";
+  // Whole characters of the sample, then spaces if the next one does not fit.
+  std::vector<char> text;
+  text.reserve(len);
+  size_t pos = 0;
+  while (text.size() < len) {
+    uint8_t leading_byte = uint8_t(sample[pos]);
+    size_t length = leading_byte >= 0b11110000   ? 4
+                    : leading_byte >= 0b11100000 ? 3
+                    : leading_byte >= 0b11000000 ? 2
+                                                 : 1;
+    if (text.size() + length > len) {
+      text.resize(len, ' ');
+      break;
+    }
+    text.insert(text.end(), sample + pos, sample + pos + length);
+    pos = (pos + length) % (sizeof(sample) - 1);
+  }
+  // About a quarter of a megabyte per run, best of a few runs.
+  size_t repeat = 1 + (size_t(1) << 18) / (len + 1);
+  const implementation *fastest = nullptr;
+  double fastest_ns = 0;
+  volatile bool isgood{true};
+  for (const implementation *impl : *this) {
+    if (!impl->supported_by_runtime_system()) {
+      continue;
+    }
+    implementation::validate_utf8_function f =
+        impl->get_validate_utf8_function();
+    double ns = 1e300;
+    for (size_t run = 0; run < 5; run++) {
+      auto start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < repeat; i++) {
+        isgood = isgood & f(text.data(), len);
+      }
+      auto finish = std::chrono::steady_clock::now();
+      ns = std::min(ns, double(std::chrono::duration_cast<
+                                   std::chrono::nanoseconds>(finish - start)
+                                   .count()));
+    }
+    // They are listed in priority order: a later one must be 5% faster.
+    if (fastest == nullptr || ns < fastest_ns * 0.95) {
+      fastest = impl;
+      fastest_ns = ns;
+    }
+  }
+  return fastest != nullptr ? fastest : detect_best_supported();
+}
+
+const char *forced_implementation_name() noexcept {
   IS_UTF8_PUSH_DISABLE_WARNINGS
   IS_UTF8_DISABLE_DEPRECATED_WARNING // Disable CRT_SECURE warning on MSVC:
                                      // manually verified this is safe
-      char *force_implementation_name = getenv("IS_UTF8_FORCE_IMPLEMENTATION");
+      return getenv("IS_UTF8_FORCE_IMPLEMENTATION");
   IS_UTF8_POP_DISABLE_WARNINGS
+}
 
-  if (force_implementation_name) {
-    auto force_implementation =
-        get_available_implementations()[force_implementation_name];
-    if (force_implementation) {
-      return get_active_implementation() = force_implementation;
-    } else {
+bool autotune_requested() noexcept {
+  IS_UTF8_PUSH_DISABLE_WARNINGS
+  IS_UTF8_DISABLE_DEPRECATED_WARNING // Disable CRT_SECURE warning on MSVC:
+                                     // manually verified this is safe
+      const char *autotune = getenv("IS_UTF8_AUTOTUNE");
+  IS_UTF8_POP_DISABLE_WARNINGS
+  return autotune != nullptr && autotune[0] != '\0' &&
+         strcmp(autotune, "0") != 0;
+}
+
+const char *forced_medium_implementation_name() noexcept {
+  IS_UTF8_PUSH_DISABLE_WARNINGS
+  IS_UTF8_DISABLE_DEPRECATED_WARNING // Disable CRT_SECURE warning on MSVC:
+                                     // manually verified this is safe
+      return getenv("IS_UTF8_FORCE_MEDIUM_IMPLEMENTATION");
+  IS_UTF8_POP_DISABLE_WARNINGS
+}
+
+// The implementation named by IS_UTF8_FORCE_MEDIUM_IMPLEMENTATION, if set.
+const implementation *forced_medium_implementation() noexcept {
+  const char *name = forced_medium_implementation_name();
+  if (name == nullptr) {
+    return nullptr;
+  }
+  const implementation *impl = get_available_implementations()[name];
+  // Note: abort() and stderr usage within the library is forbidden.
+  return impl != nullptr ? impl : &unsupported_singleton;
+}
+
+// The implementation for medium inputs, when it is not the active one: set by
+// autotuning or by IS_UTF8_FORCE_MEDIUM_IMPLEMENTATION.
+atomic_ptr<const implementation> medium_implementation{nullptr};
+
+const implementation *autotune() noexcept;
+
+const implementation *
+detect_best_supported_implementation_on_first_use::set_best() const noexcept {
+  medium_implementation = forced_medium_implementation();
+  const char *force_implementation_name = forced_implementation_name();
+  if (force_implementation_name) {
+    auto force_implementation =
+        get_available_implementations()[force_implementation_name];
+    if (force_implementation) {
+      return get_active_implementation() = force_implementation;
+    } else {
       // Note: abort() and stderr usage within the library is forbidden.
       return get_active_implementation() = &unsupported_singleton;
     }
   }
+  if (autotune_requested()) {
+    return get_active_implementation() = autotune();
+  }
   return get_active_implementation() =
              get_available_implementations().detect_best_supported();
 }
@@ -4677,6 +5890,218 @@ is_utf8_warn_unused bool validate_utf8(const char *buf, size_t len) noexcept {
   return get_active_implementation()->validate_utf8(buf, len);
 }
 
+is_utf8_warn_unused result validate_utf8_with_errors(const char *buf,
+                                                     size_t len) noexcept {
+  return get_active_implementation()->validate_utf8_with_errors(buf, len);
+}
+
+is_utf8_warn_unused result convert_utf8_to_utf16le_with_errors(
+    const char *buf, size_t len, char16_t *utf16_output) noexcept {
+  return get_active_implementation()->convert_utf8_to_utf16le_with_errors(
+      buf, len, utf16_output);
+}
+
+is_utf8_warn_unused result convert_utf8_to_utf16be_with_errors(
+    const char *buf, size_t len, char16_t *utf16_output) noexcept {
+  return get_active_implementation()->convert_utf8_to_utf16be_with_errors(
+      buf, len, utf16_output);
+}
+
+is_utf8_warn_unused size_t utf16_length_from_utf8(const char *buf,
+                                                  size_t len) noexcept {
+  return get_active_implementation()->utf16_length_from_utf8(buf, len);
+}
+
+// Below this many bytes per thread, starting a thread costs more than it saves.
+#ifndef IS_UTF8_PARALLEL_MIN_BYTES_PER_THREAD
+#define IS_UTF8_PARALLEL_MIN_BYTES_PER_THREAD (size_t(1) << 20)
+#endif
+
+// Size classes of is_utf8. Below IS_UTF8_SHORT_INPUT_LENGTH bytes, the input
+// is validated inline with scalar code (words of 8 bytes for ASCII). Below
+// IS_UTF8_MEDIUM_INPUT_LENGTH bytes, the input is checked for ASCII with 16-byte
+// registers and only given to the kernel if it is not ASCII: the kernels work
+// on blocks of 64 bytes, which a short input must be copied to. Longer inputs
+// go to the kernel directly. Defining IS_UTF8_MEDIUM_INPUT_LENGTH to 0 sends
+// every input to the kernel. See the sweep benchmark to choose the lengths.
+#ifndef IS_UTF8_SHORT_INPUT_LENGTH
+#define IS_UTF8_SHORT_INPUT_LENGTH 16
+#endif
+#ifndef IS_UTF8_MEDIUM_INPUT_LENGTH
+#define IS_UTF8_MEDIUM_INPUT_LENGTH 64
+#endif
+
+namespace internal {
+const implementation *get_resolved_active_implementation() noexcept {
+  // Any call through the detector installs the best implementation.
+  (void)get_active_implementation()->name();
+  return get_active_implementation();
+}
+
+bool validate_utf8_on_first_use(const char *buf, size_t len);
+
+// The validation function of the active implementation. It is constant
+// initialized, so that a call costs one (relaxed) load and an indirect call:
+// no guard for a static, no virtual call.
+#if defined(IS_UTF8_NO_THREADS)
+implementation::validate_utf8_function validate_utf8_function_cache{
+    &validate_utf8_on_first_use};
+#else
+std::atomic<implementation::validate_utf8_function>
+    validate_utf8_function_cache{&validate_utf8_on_first_use};
+#endif
+
+// The validation function for the medium size class: that of the active
+// implementation, unless autotuning found a faster one for medium inputs.
+#if defined(IS_UTF8_NO_THREADS)
+implementation::validate_utf8_function medium_validate_utf8_function_cache{
+    &validate_utf8_on_first_use};
+#else
+std::atomic<implementation::validate_utf8_function>
+    medium_validate_utf8_function_cache{&validate_utf8_on_first_use};
+#endif
+
+// Whether is_utf8 routes the inputs by size class. Only once the
+// implementation is known: until then, every input goes to the detector. Not
+// when the implementation is forced, so that it sees every input (e.g., when
+// testing it), unless the implementation for medium inputs is forced too.
+#if defined(IS_UTF8_NO_THREADS)
+bool size_class_dispatch{false};
+#else
+std::atomic<bool> size_class_dispatch{false};
+#endif
+
+implementation::validate_utf8_function refresh_validate_utf8_function() {
+  implementation::validate_utf8_function f =
+      get_resolved_active_implementation()->get_validate_utf8_function();
+  const implementation *medium = medium_implementation;
+  bool by_size = forced_implementation_name() == nullptr || medium != nullptr;
+  implementation::validate_utf8_function medium_f =
+      medium != nullptr ? medium->get_validate_utf8_function() : f;
+#if defined(IS_UTF8_NO_THREADS)
+  medium_validate_utf8_function_cache = medium_f;
+  validate_utf8_function_cache = f;
+  size_class_dispatch = by_size;
+#else
+  medium_validate_utf8_function_cache.store(medium_f,
+                                            std::memory_order_relaxed);
+  validate_utf8_function_cache.store(f, std::memory_order_relaxed);
+  size_class_dispatch.store(by_size, std::memory_order_relaxed);
+#endif
+  return f;
+}
+
+// Picks the fastest implementation for medium inputs, unless it is forced
+// (remembered for refresh_validate_utf8_function), and returns the fastest for
+// long inputs.
+const implementation *autotune() noexcept {
+  const available_implementation_list &list = get_available_implementations();
+#if IS_UTF8_MEDIUM_INPUT_LENGTH > IS_UTF8_SHORT_INPUT_LENGTH
+  const implementation *forced_medium = forced_medium_implementation();
+  medium_implementation =
+      forced_medium != nullptr
+          ? forced_medium
+          : list.detect_fastest_supported(
+                (IS_UTF8_SHORT_INPUT_LENGTH + IS_UTF8_MEDIUM_INPUT_LENGTH) / 2);
+#endif
+  return list.detect_fastest_supported(size_t(64) << 10);
+}
+
+bool validate_utf8_on_first_use(const char *buf, size_t len) {
+  return refresh_validate_utf8_function()(buf, len);
+}
+
+is_utf8_really_inline implementation::validate_utf8_function
+cached_validate_utf8_function() {
+#if defined(IS_UTF8_NO_THREADS)
+  return validate_utf8_function_cache;
+#else
+  return validate_utf8_function_cache.load(std::memory_order_relaxed);
+#endif
+}
+
+is_utf8_really_inline implementation::validate_utf8_function
+cached_medium_validate_utf8_function() {
+#if defined(IS_UTF8_NO_THREADS)
+  return medium_validate_utf8_function_cache;
+#else
+  return medium_validate_utf8_function_cache.load(std::memory_order_relaxed);
+#endif
+}
+
+is_utf8_really_inline bool by_size_class() {
+#if defined(IS_UTF8_NO_THREADS)
+  return size_class_dispatch;
+#else
+  return size_class_dispatch.load(std::memory_order_relaxed);
+#endif
+}
+
+// Move the split position forward to the first byte that is not a continuation
+// byte. If there are four continuation bytes in a row, the input is invalid and
+// any split preserves the result: the second range starts with a continuation
+// byte and is itself invalid.
+is_utf8_really_inline size_t align_split(const char *buf, size_t len,
+                                         size_t pos) {
+  for (size_t i = 0; i < 3 && pos < len; i++, pos++) {
+    if ((uint8_t(buf[pos]) & 0b11000000) != 0b10000000) {
+      break;
+    }
+  }
+  return pos;
+}
+} // namespace internal
+
+is_utf8_warn_unused bool validate_utf8_parallel(const char *buf, size_t len,
+                                                size_t thread_count) noexcept {
+#if defined(IS_UTF8_NO_THREADS)
+  (void)thread_count;
+  return validate_utf8(buf, len);
+#else
+  if (thread_count == 0) {
+    thread_count = std::thread::hardware_concurrency();
+  }
+  size_t max_thread_count = len / IS_UTF8_PARALLEL_MIN_BYTES_PER_THREAD;
+  if (thread_count > max_thread_count) {
+    thread_count = max_thread_count;
+  }
+  if (thread_count <= 1) {
+    return validate_utf8(buf, len);
+  }
+  // Resolve the implementation once instead of in every thread.
+  const implementation *impl = internal::get_resolved_active_implementation();
+  std::vector<std::thread> threads;
+  std::unique_ptr<std::atomic<bool>[]> valid(
+      new (std::nothrow) std::atomic<bool>[thread_count]);
+  if (!valid) {
+    return impl->validate_utf8(buf, len);
+  }
+  size_t range_length = len / thread_count;
+  size_t start = 0;
+  size_t index = 0;
+  try {
+    threads.reserve(thread_count - 1);
+    for (; index + 1 < thread_count; index++) {
+      size_t end = internal::align_split(buf, len, start + range_length);
+      std::atomic<bool> *v = &valid[index];
+      threads.emplace_back([impl, buf, start, end, v]() {
+        v->store(impl->validate_utf8(buf + start, end - start),
+                 std::memory_order_relaxed);
+      });
+      start = end;
+    }
+  } catch (...) {
+    // Could not start another thread: this thread takes the rest.
+  }
+  bool is_valid = impl->validate_utf8(buf + start, len - start);
+  for (size_t i = 0; i < threads.size(); i++) {
+    threads[i].join();
+    is_valid &= valid[i].load(std::memory_order_relaxed);
+  }
+  return is_valid;
+#endif
+}
+
 const implementation *builtin_implementation() {
   static const implementation *builtin_impl =
       get_available_implementations()[IS_UTF8_STRINGIFY(
@@ -4698,16 +6123,191 @@ namespace utf8 {
 #if IS_UTF8_IS_ARM64
 // not needed
 #else
-// credit: based on code from Google Fuchsia (Apache Licensed)
+// A deterministic finite automaton for UTF-8 where each state is a shift
+// amount: the row of a byte packs, for every state, the next state in 6 bits
+// at the offset of the state, so that a step is a load and a shift.
+// credit: the shift-based DFA is due to Per Vognsen.
+namespace dfa {
+constexpr uint64_t ACCEPT = 0;
+constexpr uint64_t ERROR = 6;   // absorbing: its row entry is always ERROR
+constexpr uint64_t ONE = 12;    // one continuation byte expected
+constexpr uint64_t TWO = 18;    // two
+constexpr uint64_t TWO_E0 = 24; // two, after E0: the next one is A0..BF
+constexpr uint64_t TWO_ED = 30; // two, after ED: the next one is 80..9F
+constexpr uint64_t THREE = 36;  // three
+constexpr uint64_t THREE_F0 = 42; // three, after F0: the next one is 90..BF
+constexpr uint64_t THREE_F4 = 48; // three, after F4: the next one is 80..8F
+
+constexpr uint64_t row(uint64_t accept, uint64_t one, uint64_t two,
+                       uint64_t two_e0, uint64_t two_ed, uint64_t three,
+                       uint64_t three_f0, uint64_t three_f4) {
+  return accept << ACCEPT | ERROR << ERROR | one << ONE | two << TWO |
+         two_e0 << TWO_E0 | two_ed << TWO_ED | three << THREE |
+         three_f0 << THREE_F0 | three_f4 << THREE_F4;
+}
+
+// A leading byte only goes somewhere from ACCEPT.
+constexpr uint64_t lead(uint64_t next) {
+  return row(next, ERROR, ERROR, ERROR, ERROR, ERROR, ERROR, ERROR);
+}
+
+constexpr uint64_t ASCII = lead(ACCEPT);
+constexpr uint64_t BAD = lead(ERROR);
+constexpr uint64_t C80 = row(ERROR, ACCEPT, ONE, ERROR, ONE, TWO, ERROR, TWO);
+constexpr uint64_t C90 = row(ERROR, ACCEPT, ONE, ERROR, ONE, TWO, TWO, ERROR);
+constexpr uint64_t CA0 = row(ERROR, ACCEPT, ONE, ONE, ERROR, TWO, TWO, ERROR);
+constexpr uint64_t L2 = lead(ONE);
+constexpr uint64_t E0 = lead(TWO_E0);
+constexpr uint64_t L3 = lead(TWO);
+constexpr uint64_t ED = lead(TWO_ED);
+constexpr uint64_t F0 = lead(THREE_F0);
+constexpr uint64_t L4 = lead(THREE);
+constexpr uint64_t F4 = lead(THREE_F4);
+
+#define IS_UTF8_DFA_X4(r) r, r, r, r
+#define IS_UTF8_DFA_X16(r)                                                     \
+  IS_UTF8_DFA_X4(r), IS_UTF8_DFA_X4(r), IS_UTF8_DFA_X4(r), IS_UTF8_DFA_X4(r)
+static const uint64_t rows[256] = {
+    // 00..7F
+    IS_UTF8_DFA_X16(ASCII), IS_UTF8_DFA_X16(ASCII), IS_UTF8_DFA_X16(ASCII),
+    IS_UTF8_DFA_X16(ASCII), IS_UTF8_DFA_X16(ASCII), IS_UTF8_DFA_X16(ASCII),
+    IS_UTF8_DFA_X16(ASCII), IS_UTF8_DFA_X16(ASCII),
+    // 80..BF
+    IS_UTF8_DFA_X16(C80), IS_UTF8_DFA_X16(C90), IS_UTF8_DFA_X16(CA0),
+    IS_UTF8_DFA_X16(CA0),
+    // C0..DF
+    BAD, BAD, L2, L2, IS_UTF8_DFA_X4(L2), IS_UTF8_DFA_X4(L2),
+    IS_UTF8_DFA_X4(L2), IS_UTF8_DFA_X4(L2), IS_UTF8_DFA_X4(L2),
+    IS_UTF8_DFA_X4(L2), IS_UTF8_DFA_X4(L2),
+    // E0..EF
+    E0, IS_UTF8_DFA_X4(L3), IS_UTF8_DFA_X4(L3), IS_UTF8_DFA_X4(L3), ED, L3,
+    L3,
+    // F0..FF
+    F0, L4, L4, L4, F4, IS_UTF8_DFA_X4(BAD), IS_UTF8_DFA_X4(BAD), BAD, BAD,
+    BAD};
+#undef IS_UTF8_DFA_X16
+#undef IS_UTF8_DFA_X4
+static_assert(sizeof(rows) == 256 * sizeof(uint64_t), "one row per byte");
+
+is_utf8_really_inline uint64_t step(uint64_t state, uint8_t byte) {
+  return rows[byte] >> (state & 63);
+}
+
+is_utf8_really_inline bool is_ascii(uint64_t word) {
+  return (word & 0x8080808080808080) == 0;
+}
+
+// Eight bytes, skipped if they are ASCII and we are between characters.
+is_utf8_really_inline uint64_t run_word(uint64_t state, const uint8_t *data) {
+  uint64_t word;
+  std::memcpy(&word, data, sizeof(word));
+  if ((state & 63) == ACCEPT && is_ascii(word)) {
+    return state;
+  }
+  for (size_t i = 0; i < 8; i++) {
+    state = step(state, data[i]);
+  }
+  return state;
+}
+
+inline uint64_t run(uint64_t state, const uint8_t *data, size_t len) {
+  size_t pos = 0;
+  for (; pos + 16 <= len; pos += 16) {
+    uint64_t v1, v2;
+    std::memcpy(&v1, data + pos, sizeof(v1));
+    std::memcpy(&v2, data + pos + 8, sizeof(v2));
+    if ((state & 63) == ACCEPT && is_ascii(v1 | v2)) {
+      continue;
+    }
+    for (size_t i = 0; i < 16; i++) {
+      state = step(state, data[pos + i]);
+    }
+  }
+  for (; pos + 8 <= len; pos += 8) {
+    state = run_word(state, data + pos);
+  }
+  if ((state & 63) == ACCEPT) {
+    while (pos < len && data[pos] < 0x80) {
+      pos++;
+    }
+  }
+  for (; pos < len; pos++) {
+    state = step(state, data[pos]);
+  }
+  return state;
+}
+} // namespace dfa
+
+// Below this length, a single stream goes through the input.
+#ifndef IS_UTF8_SCALAR_STREAMS_THRESHOLD
+#define IS_UTF8_SCALAR_STREAMS_THRESHOLD 256
+#endif
+
+// Each step of the automaton depends on the previous one: a single stream
+// runs at the latency of a load and a shift per byte. We cut the input into
+// four streams at character boundaries and run them in lockstep, so that
+// the processor overlaps their steps. ASCII goes eight bytes at a time: in
+// 32-byte blocks of each of the streams, together, then in words.
 inline is_utf8_warn_unused bool validate(const char *buf, size_t len) noexcept {
   const uint8_t *data = reinterpret_cast<const uint8_t *>(buf);
-  uint64_t pos = 0;
+  if (len < IS_UTF8_SCALAR_STREAMS_THRESHOLD) {
+    return (dfa::run(dfa::ACCEPT, data, len) & 63) == dfa::ACCEPT;
+  }
+  // A stream starts at most three bytes after the quarter: past them, a
+  // continuation byte is an error that the previous stream reports.
+  const size_t quarter = len / 4;
+  const uint8_t *start[5];
+  start[0] = data;
+  start[4] = data + len;
+  for (size_t k = 1; k < 4; k++) {
+    const uint8_t *p = data + quarter * k;
+    for (size_t skipped = 0; skipped < 3 && (*p & 0xC0) == 0x80; skipped++) {
+      p++;
+    }
+    start[k] = p;
+  }
+  const size_t common = quarter - 3; // every stream has that many bytes
+  uint64_t s0 = dfa::ACCEPT, s1 = dfa::ACCEPT, s2 = dfa::ACCEPT,
+           s3 = dfa::ACCEPT;
+  size_t pos = 0;
+  for (; pos + 32 <= common; pos += 32) {
+    uint64_t any = 0;
+    for (size_t i = 0; i < 32; i += 8) {
+      uint64_t v0, v1, v2, v3;
+      std::memcpy(&v0, start[0] + pos + i, sizeof(v0));
+      std::memcpy(&v1, start[1] + pos + i, sizeof(v1));
+      std::memcpy(&v2, start[2] + pos + i, sizeof(v2));
+      std::memcpy(&v3, start[3] + pos + i, sizeof(v3));
+      any |= (v0 | v1) | (v2 | v3);
+    }
+    if (((s0 | s1 | s2 | s3) & 63) == dfa::ACCEPT && dfa::is_ascii(any)) {
+      continue;
+    }
+    for (size_t i = 0; i < 32; i += 8) {
+      s0 = dfa::run_word(s0, start[0] + pos + i);
+      s1 = dfa::run_word(s1, start[1] + pos + i);
+      s2 = dfa::run_word(s2, start[2] + pos + i);
+      s3 = dfa::run_word(s3, start[3] + pos + i);
+    }
+  }
+  s0 = dfa::run(s0, start[0] + pos, size_t(start[1] - start[0]) - pos);
+  s1 = dfa::run(s1, start[1] + pos, size_t(start[2] - start[1]) - pos);
+  s2 = dfa::run(s2, start[2] + pos, size_t(start[3] - start[2]) - pos);
+  s3 = dfa::run(s3, start[3] + pos, size_t(start[4] - start[3]) - pos);
+  return ((s0 | s1 | s2 | s3) & 63) == dfa::ACCEPT;
+}
+#endif
+
+inline is_utf8_warn_unused result validate_with_errors(const char *buf,
+                                                       size_t len) noexcept {
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(buf);
+  size_t pos = 0;
   uint32_t code_point = 0;
   while (pos < len) {
-    // check of the next 8 bytes are ascii.
-    uint64_t next_pos = pos + 16;
-    if (next_pos <=
-        len) { // if it is safe to read 8 more bytes, check that they are ascii
+    // check of the next 16 bytes are ascii.
+    size_t next_pos = pos + 16;
+    if (next_pos <= len) { // if it is safe to read 16 more bytes, check that
+                           // they are ascii
       uint64_t v1;
       std::memcpy(&v1, data + pos, sizeof(uint64_t));
       uint64_t v2;
@@ -4722,7 +6322,7 @@ inline is_utf8_warn_unused bool validate(const char *buf, size_t len) noexcept {
 
     while (byte < 0b10000000) {
       if (++pos == len) {
-        return true;
+        return result(error_code::SUCCESS, len);
       }
       byte = data[pos];
     }
@@ -4730,65 +6330,101 @@ inline is_utf8_warn_unused bool validate(const char *buf, size_t len) noexcept {
     if ((byte & 0b11100000) == 0b11000000) {
       next_pos = pos + 2;
       if (next_pos > len) {
-        return false;
+        return result(error_code::TOO_SHORT, pos);
       }
       if ((data[pos + 1] & 0b11000000) != 0b10000000) {
-        return false;
+        return result(error_code::TOO_SHORT, pos);
       }
       // range check
       code_point = (byte & 0b00011111) << 6 | (data[pos + 1] & 0b00111111);
       if ((code_point < 0x80) || (0x7ff < code_point)) {
-        return false;
+        return result(error_code::OVERLONG, pos);
       }
     } else if ((byte & 0b11110000) == 0b11100000) {
       next_pos = pos + 3;
       if (next_pos > len) {
-        return false;
+        return result(error_code::TOO_SHORT, pos);
       }
       if ((data[pos + 1] & 0b11000000) != 0b10000000) {
-        return false;
+        return result(error_code::TOO_SHORT, pos);
       }
       if ((data[pos + 2] & 0b11000000) != 0b10000000) {
-        return false;
+        return result(error_code::TOO_SHORT, pos);
       }
       // range check
       code_point = (byte & 0b00001111) << 12 |
                    (data[pos + 1] & 0b00111111) << 6 |
                    (data[pos + 2] & 0b00111111);
-      if ((code_point < 0x800) || (0xffff < code_point) ||
-          (0xd7ff < code_point && code_point < 0xe000)) {
-        return false;
+      if ((code_point < 0x800) || (0xffff < code_point)) {
+        return result(error_code::OVERLONG, pos);
+      }
+      if (0xd7ff < code_point && code_point < 0xe000) {
+        return result(error_code::SURROGATE, pos);
       }
     } else if ((byte & 0b11111000) == 0b11110000) { // 0b11110000
       next_pos = pos + 4;
       if (next_pos > len) {
-        return false;
+        return result(error_code::TOO_SHORT, pos);
       }
       if ((data[pos + 1] & 0b11000000) != 0b10000000) {
-        return false;
+        return result(error_code::TOO_SHORT, pos);
       }
       if ((data[pos + 2] & 0b11000000) != 0b10000000) {
-        return false;
+        return result(error_code::TOO_SHORT, pos);
       }
       if ((data[pos + 3] & 0b11000000) != 0b10000000) {
-        return false;
+        return result(error_code::TOO_SHORT, pos);
       }
       // range check
       code_point =
           (byte & 0b00000111) << 18 | (data[pos + 1] & 0b00111111) << 12 |
           (data[pos + 2] & 0b00111111) << 6 | (data[pos + 3] & 0b00111111);
-      if (code_point <= 0xffff || 0x10ffff < code_point) {
-        return false;
+      if (code_point <= 0xffff) {
+        return result(error_code::OVERLONG, pos);
+      }
+      if (0x10ffff < code_point) {
+        return result(error_code::TOO_LARGE, pos);
       }
     } else {
-      // we may have a continuation
-      return false;
+      // we either have too many continuation bytes or an invalid leading byte
+      if ((byte & 0b11000000) == 0b10000000) {
+        return result(error_code::TOO_LONG, pos);
+      } else {
+        return result(error_code::HEADER_BITS, pos);
+      }
     }
     pos = next_pos;
   }
-  return true;
+  return result(error_code::SUCCESS, len);
+}
+
+// Finds the previous leading byte starting backward from buf and validates with
+// errors from there. Used to pinpoint the location of an error when an invalid
+// chunk is detected. We assume that the stream starts with a leading byte, and
+// to check that it is the case, we ask that you pass a pointer to the start of
+// the stream (start).
+inline is_utf8_warn_unused result rewind_and_validate_with_errors(
+    const char *start, const char *buf, size_t len) noexcept {
+  // First check that we start with a leading byte
+  if ((*start & 0b11000000) == 0b10000000) {
+    return result(error_code::TOO_LONG, 0);
+  }
+  size_t extra_len{0};
+  // A leading byte cannot be further than 4 bytes away
+  for (int i = 0; i < 5; i++) {
+    unsigned char byte = *buf;
+    if ((byte & 0b11000000) != 0b10000000) {
+      break;
+    } else {
+      buf--;
+      extra_len++;
+    }
+  }
+
+  result res = validate_with_errors(buf, len + extra_len);
+  res.count -= extra_len;
+  return res;
 }
-#endif
 } // namespace utf8
 } // unnamed namespace
 } // namespace scalar
@@ -4796,6 +6432,240 @@ inline is_utf8_warn_unused bool validate(const char *buf, size_t len) noexcept {
 
 #endif
 
+#ifndef IS_UTF8_BATCH_H
+#define IS_UTF8_BATCH_H
+
+namespace is_utf8_internals {
+namespace internal {
+namespace {
+/**
+ * Copies fewer than 64 bytes with fixed-size (possibly overlapping) copies,
+ * which compile to a few loads and stores, instead of calling memcpy.
+ */
+is_utf8_really_inline void copy_short(uint8_t *dst, const char *src,
+                                      size_t len) {
+  if (len >= 16) {
+    if (len >= 32) {
+      std::memcpy(dst, src, 32);
+      std::memcpy(dst + len - 32, src + len - 32, 32);
+    } else {
+      std::memcpy(dst, src, 16);
+      std::memcpy(dst + len - 16, src + len - 16, 16);
+    }
+  } else if (len >= 4) {
+    if (len >= 8) {
+      std::memcpy(dst, src, 8);
+      std::memcpy(dst + len - 8, src + len - 8, 8);
+    } else {
+      std::memcpy(dst, src, 4);
+      std::memcpy(dst + len - 4, src + len - 4, 4);
+    }
+  } else if (len != 0) {
+    dst[0] = uint8_t(src[0]);
+    dst[len / 2] = uint8_t(src[len / 2]);
+    dst[len - 1] = uint8_t(src[len - 1]);
+  }
+}
+
+/**
+ * Copies the strings bufs[first], bufs[first + 1], ... into a 64-byte block,
+ * each one followed by at least one space, for as long as they fit. The block
+ * is then valid UTF-8 if and only if each of these strings is valid: a
+ * character cut by the end of a string is too short since it is followed by a
+ * space, and a string starting with a continuation byte follows a space.
+ *
+ * The first string must be shorter than 64 bytes.
+ *
+ * @return the index following the last string copied in the block.
+ */
+is_utf8_really_inline size_t pack_short_strings(const char *const *bufs,
+                                                const size_t *lens,
+                                                size_t first, size_t count,
+                                                uint8_t *block) {
+  std::memset(block, 0x20, 64);
+  size_t pos = 0;
+  size_t i = first;
+  for (; i < count && pos + lens[i] < 64; i++) {
+    copy_short(block + pos, bufs[i], lens[i]);
+    pos += lens[i] + 1;
+  }
+  return i;
+}
+} // unnamed namespace
+} // namespace internal
+} // namespace is_utf8_internals
+
+#endif // IS_UTF8_BATCH_H
+
+#ifndef IS_UTF8_UTF8_TO_UTF16_H
+#define IS_UTF8_UTF8_TO_UTF16_H
+
+namespace is_utf8_internals {
+namespace internal {
+namespace {
+is_utf8_really_inline size_t count_ones(uint64_t input_num) {
+#ifdef IS_UTF8_REGULAR_VISUAL_STUDIO
+  input_num = input_num - ((input_num >> 1) & 0x5555555555555555);
+  input_num = (input_num & 0x3333333333333333) +
+              ((input_num >> 2) & 0x3333333333333333);
+  input_num = (input_num + (input_num >> 4)) & 0x0f0f0f0f0f0f0f0f;
+  return size_t((input_num * 0x0101010101010101) >> 56);
+#else
+  return size_t(__builtin_popcountll(input_num));
+#endif
+}
+} // unnamed namespace
+} // namespace internal
+
+namespace scalar {
+namespace {
+namespace utf8_to_utf16 {
+
+template <endianness big_endian>
+is_utf8_really_inline char16_t to_utf16(uint32_t word) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  const bool swap = !big_endian;
+#else
+  const bool swap = big_endian;
+#endif
+  return swap ? char16_t(uint16_t((word >> 8) | (word << 8)))
+              : char16_t(uint16_t(word));
+}
+
+/**
+ * Converts the characters of buf, which must have been validated, stopping
+ * before a character cut by the end of buf (it is completed by the next
+ * bytes of the input).
+ *
+ * @return the number of bytes converted. utf16_output is moved past the
+ * char16_t written.
+ */
+template <endianness big_endian>
+inline size_t convert_valid(const char *buf, size_t len,
+                            char16_t *&utf16_output) noexcept {
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(buf);
+  size_t pos = 0;
+  while (pos < len) {
+    // try to convert the next block of 8 ASCII bytes
+    if (pos + 8 <= len) {
+      uint64_t v;
+      std::memcpy(&v, data + pos, sizeof(uint64_t));
+      if ((v & 0x8080808080808080) == 0) {
+        for (size_t i = 0; i < 8; i++) {
+          *utf16_output++ = to_utf16<big_endian>(data[pos + i]);
+        }
+        pos += 8;
+        continue;
+      }
+    }
+    uint8_t leading_byte = data[pos];
+    if (leading_byte < 0b10000000) {
+      *utf16_output++ = to_utf16<big_endian>(leading_byte);
+      pos++;
+    } else if (leading_byte < 0b11100000) {
+      if (pos + 2 > len) {
+        break;
+      }
+      *utf16_output++ = to_utf16<big_endian>(
+          uint32_t(leading_byte & 0b00011111) << 6 |
+          uint32_t(data[pos + 1] & 0b00111111));
+      pos += 2;
+    } else if (leading_byte < 0b11110000) {
+      if (pos + 3 > len) {
+        break;
+      }
+      *utf16_output++ = to_utf16<big_endian>(
+          uint32_t(leading_byte & 0b00001111) << 12 |
+          uint32_t(data[pos + 1] & 0b00111111) << 6 |
+          uint32_t(data[pos + 2] & 0b00111111));
+      pos += 3;
+    } else {
+      if (pos + 4 > len) {
+        break;
+      }
+      uint32_t code_point = uint32_t(leading_byte & 0b00000111) << 18 |
+                            uint32_t(data[pos + 1] & 0b00111111) << 12 |
+                            uint32_t(data[pos + 2] & 0b00111111) << 6 |
+                            uint32_t(data[pos + 3] & 0b00111111);
+      code_point -= 0x10000;
+      *utf16_output++ = to_utf16<big_endian>(0xD800 + (code_point >> 10));
+      *utf16_output++ = to_utf16<big_endian>(0xDC00 + (code_point & 0x3FF));
+      pos += 4;
+    }
+  }
+  return pos;
+}
+
+// One char16_t per leading byte, and a second one for four-byte characters.
+inline size_t utf16_length_from_utf8(const char *buf, size_t len) noexcept {
+  const int8_t *data = reinterpret_cast<const int8_t *>(buf);
+  size_t counter{0};
+  for (size_t i = 0; i < len; i++) {
+    if (data[i] > -65) {
+      counter++;
+    }
+    if (uint8_t(data[i]) >= 240) {
+      counter++;
+    }
+  }
+  return counter;
+}
+
+} // namespace utf8_to_utf16
+
+namespace utf8 {
+// Profile of a string known to be valid.
+inline utf8_profile profile_valid(const char *buf, size_t len) noexcept {
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(buf);
+  uint8_t max_byte{0};
+  size_t continuation_bytes{0};
+  size_t four_byte_leading{0};
+  for (size_t i = 0; i < len; i++) {
+    max_byte = data[i] > max_byte ? data[i] : max_byte;
+    continuation_bytes += (data[i] & 0b11000000) == 0b10000000;
+    four_byte_leading += data[i] >= 0b11110000;
+  }
+  utf8_profile profile;
+  profile.is_ascii = max_byte < 0x80;
+  // U+0100 and above start with 0xC4 or more.
+  profile.is_latin1 = max_byte < 0xC4;
+  profile.code_points = len - continuation_bytes;
+  profile.utf16_length = profile.code_points + four_byte_leading;
+  return profile;
+}
+} // namespace utf8
+
+namespace utf16 {
+template <endianness big_endian>
+inline is_utf8_warn_unused bool validate(const char16_t *buf,
+                                         size_t len) noexcept {
+  size_t pos = 0;
+  while (pos < len) {
+    // The byte swap of to_utf16 goes both ways.
+    uint16_t word = utf8_to_utf16::to_utf16<big_endian>(buf[pos]);
+    if ((word & 0xF800) == 0xD800) {
+      // A high surrogate (D800...DBFF) followed by a low surrogate.
+      if (word >= 0xDC00 || pos + 1 >= len) {
+        return false;
+      }
+      uint16_t next = utf8_to_utf16::to_utf16<big_endian>(buf[pos + 1]);
+      if ((next & 0xFC00) != 0xDC00) {
+        return false;
+      }
+      pos += 2;
+    } else {
+      pos++;
+    }
+  }
+  return true;
+}
+} // namespace utf16
+} // unnamed namespace
+} // namespace scalar
+} // namespace is_utf8_internals
+
+#endif // IS_UTF8_UTF8_TO_UTF16_H
+
 IS_UTF8_PUSH_DISABLE_WARNINGS
 IS_UTF8_DISABLE_UNDESIRED_WARNINGS
 
@@ -5140,27 +7010,33 @@ struct utf8_checker {
     this->error |= this->prev_incomplete;
   }
 
+  // A block known to have non-ASCII bytes.
+  is_utf8_really_inline void
+  check_non_ascii_input(const simd8x64<uint8_t> &input) {
+    // you might think that a for-loop would work, but under Visual Studio, it
+    // is not good enough.
+    static_assert((simd8x64<uint8_t>::NUM_CHUNKS == 2) ||
+                      (simd8x64<uint8_t>::NUM_CHUNKS == 4),
+                  "We support either two or four chunks per 64-byte block.");
+    if (simd8x64<uint8_t>::NUM_CHUNKS == 2) {
+      this->check_utf8_bytes(input.chunks[0], this->prev_input_block);
+      this->check_utf8_bytes(input.chunks[1], input.chunks[0]);
+    } else if (simd8x64<uint8_t>::NUM_CHUNKS == 4) {
+      this->check_utf8_bytes(input.chunks[0], this->prev_input_block);
+      this->check_utf8_bytes(input.chunks[1], input.chunks[0]);
+      this->check_utf8_bytes(input.chunks[2], input.chunks[1]);
+      this->check_utf8_bytes(input.chunks[3], input.chunks[2]);
+    }
+    this->prev_incomplete =
+        is_incomplete(input.chunks[simd8x64<uint8_t>::NUM_CHUNKS - 1]);
+    this->prev_input_block = input.chunks[simd8x64<uint8_t>::NUM_CHUNKS - 1];
+  }
+
   is_utf8_really_inline void check_next_input(const simd8x64<uint8_t> &input) {
     if (is_utf8_likely(is_ascii(input))) {
       this->error |= this->prev_incomplete;
     } else {
-      // you might think that a for-loop would work, but under Visual Studio, it
-      // is not good enough.
-      static_assert((simd8x64<uint8_t>::NUM_CHUNKS == 2) ||
-                        (simd8x64<uint8_t>::NUM_CHUNKS == 4),
-                    "We support either two or four chunks per 64-byte block.");
-      if (simd8x64<uint8_t>::NUM_CHUNKS == 2) {
-        this->check_utf8_bytes(input.chunks[0], this->prev_input_block);
-        this->check_utf8_bytes(input.chunks[1], input.chunks[0]);
-      } else if (simd8x64<uint8_t>::NUM_CHUNKS == 4) {
-        this->check_utf8_bytes(input.chunks[0], this->prev_input_block);
-        this->check_utf8_bytes(input.chunks[1], input.chunks[0]);
-        this->check_utf8_bytes(input.chunks[2], input.chunks[1]);
-        this->check_utf8_bytes(input.chunks[3], input.chunks[2]);
-      }
-      this->prev_incomplete =
-          is_incomplete(input.chunks[simd8x64<uint8_t>::NUM_CHUNKS - 1]);
-      this->prev_input_block = input.chunks[simd8x64<uint8_t>::NUM_CHUNKS - 1];
+      this->check_non_ascii_input(input);
     }
   }
 
@@ -5184,73 +7060,1543 @@ namespace {
 namespace utf8_validation {
 
 /**
- * Validates that the string is actual UTF-8.
+ * Checks the whole 64-byte blocks of the input, and returns their length.
+ * After an ASCII block, the next ones are ORed together
+ * IS_UTF8_ASCII_SCAN_LENGTH bytes at a time, and skipped at once as long as
+ * none of these bytes is above 0x7F: the checker only sees the blocks around
+ * non-ASCII characters.
+ */
+template <class checker>
+is_utf8_really_inline size_t check_full_blocks(checker &c,
+                                               const uint8_t *input,
+                                               size_t length) {
+  constexpr size_t scan = IS_UTF8_ASCII_SCAN_LENGTH;
+  static_assert(scan % 64 == 0 && scan >= 64 && scan <= 1024,
+                "IS_UTF8_ASCII_SCAN_LENGTH must be a multiple of 64 between "
+                "64 and 1024");
+  size_t idx = 0;
+  size_t window_end = 0; // the window before it has non-ASCII bytes
+  while (idx + 64 <= length) {
+    simd::simd8x64<uint8_t> in(input + idx);
+    idx += 64;
+    if (!in.is_ascii()) {
+      c.check_non_ascii_input(in);
+      continue;
+    }
+    // However many ASCII blocks, they cannot finish an incomplete character:
+    // the same check as at EOF.
+    c.check_eof();
+    if (scan > 64 && idx >= window_end) {
+      for (; idx + scan <= length; idx += scan) {
+        simd::simd8x64<uint8_t> any(input + idx);
+        for (size_t block = 64; block < scan; block += 64) {
+          any |= simd::simd8x64<uint8_t>(input + idx + block);
+        }
+        if (!any.is_ascii()) {
+          window_end = idx + scan;
+          break;
+        }
+      }
+    }
+  }
+  return idx;
+}
+
+/**
+ * Validates that the string is actual UTF-8.
  */
 template <class checker>
 bool generic_validate_utf8(const uint8_t *input, size_t length) {
+  if (length < 16) {
+    return scalar::utf8::validate_with_errors(
+               reinterpret_cast<const char *>(input), length)
+               .error == error_code::SUCCESS;
+  }
+  checker c{};
+  size_t idx = check_full_blocks(c, input, length);
+  if (idx < length) {
+    // The remainder is loaded in place, without copying it to a padded block.
+    simd::simd8x64<uint8_t> in(input + idx, length - idx);
+    c.check_next_input(in);
+  }
+  c.check_eof();
+  return !c.errors();
+}
+
+bool generic_validate_utf8(const char *input, size_t length) {
+  return generic_validate_utf8<utf8_checker>(
+      reinterpret_cast<const uint8_t *>(input), length);
+}
+
+/**
+ * Validates that the string is actual UTF-8, reading up to 64 bytes past its
+ * end: the last block is loaded in place, the bytes past the end cleared.
+ */
+template <class checker>
+bool generic_validate_utf8_padded(const uint8_t *input, size_t length) {
+  checker c{};
+  size_t idx = check_full_blocks(c, input, length);
+  if (idx < length) {
+    simd::simd8x64<uint8_t> in(input + idx, length - idx,
+                               simd::padded_input{});
+    c.check_next_input(in);
+  }
+  c.check_eof();
+  return !c.errors();
+}
+
+/**
+ * Validates that the string is actual UTF-8, checking for errors every
+ * IS_UTF8_EARLY_EXIT_BLOCKS blocks: the inner loop is the same as in
+ * generic_validate_utf8.
+ */
+template <class checker>
+bool generic_validate_utf8_early_exit(const uint8_t *input, size_t length) {
+  constexpr size_t stride = 64 * IS_UTF8_EARLY_EXIT_BLOCKS;
+  checker c{};
+  size_t idx = 0;
+  for (; idx + stride <= length; idx += stride) {
+    for (size_t block = 0; block < stride; block += 64) {
+      simd::simd8x64<uint8_t> in(input + idx + block);
+      c.check_next_input(in);
+    }
+    if (c.errors()) {
+      return false;
+    }
+  }
+  if (length < 16) {
+    return scalar::utf8::validate_with_errors(
+               reinterpret_cast<const char *>(input), length)
+               .error == error_code::SUCCESS;
+  }
+  for (; idx + 64 <= length; idx += 64) {
+    simd::simd8x64<uint8_t> in(input + idx);
+    c.check_next_input(in);
+  }
+  if (idx < length) {
+    simd::simd8x64<uint8_t> in(input + idx, length - idx);
+    c.check_next_input(in);
+  }
+  c.check_eof();
+  return !c.errors();
+}
+
+/**
+ * Validates that the string is actual UTF-8 and stops on errors.
+ */
+template <class checker>
+result generic_validate_utf8_with_errors(const uint8_t *input, size_t length) {
+  checker c{};
+  buf_block_reader<64> reader(input, length);
+  size_t count{0};
+  while (reader.has_full_block()) {
+    simd::simd8x64<uint8_t> in(reader.full_block());
+    c.check_next_input(in);
+    if (c.errors()) {
+      if (count != 0) {
+        count--;
+      } // Sometimes the error is only detected in the next chunk
+      result res = scalar::utf8::rewind_and_validate_with_errors(
+          reinterpret_cast<const char *>(input),
+          reinterpret_cast<const char *>(input + count), length - count);
+      res.count += count;
+      return res;
+    }
+    reader.advance();
+    count += 64;
+  }
+  uint8_t block[64]{};
+  reader.get_remainder(block);
+  simd::simd8x64<uint8_t> in(block);
+  c.check_next_input(in);
+  reader.advance();
+  c.check_eof();
+  if (c.errors()) {
+    if (count != 0) {
+      count--;
+    } // Sometimes the error is only detected in the next chunk
+    result res = scalar::utf8::rewind_and_validate_with_errors(
+        reinterpret_cast<const char *>(input),
+        reinterpret_cast<const char *>(input) + count, length - count);
+    res.count += count;
+    return res;
+  } else {
+    return result(error_code::SUCCESS, length);
+  }
+}
+
+result generic_validate_utf8_with_errors(const char *input, size_t length) {
+  return generic_validate_utf8_with_errors<utf8_checker>(
+      reinterpret_cast<const uint8_t *>(input), length);
+}
+
+/**
+ * Streaming validation: the checker is kept in caller-provided storage between
+ * calls, so that characters may straddle the blocks of successive calls.
+ */
+template <class checker> void generic_utf8_stream_init(void *state) {
+  static_assert(sizeof(checker) <= internal::utf8_stream_state_size,
+                "the checker must fit in the stream state");
+  checker c{};
+  std::memcpy(state, static_cast<const void *>(&c), sizeof(c));
+}
+
+template <class checker>
+bool generic_utf8_stream_update(void *state, const uint8_t *input,
+                                size_t length) {
+  checker c{};
+  std::memcpy(static_cast<void *>(&c), state, sizeof(c));
+  for (size_t idx = 0; idx < length; idx += 64) {
+    simd::simd8x64<uint8_t> in(input + idx);
+    c.check_next_input(in);
+  }
+  std::memcpy(state, static_cast<const void *>(&c), sizeof(c));
+  return !c.errors();
+}
+
+template <class checker>
+bool generic_utf8_stream_finish(void *state, const uint8_t *input,
+                                size_t length) {
+  checker c{};
+  std::memcpy(static_cast<void *>(&c), state, sizeof(c));
+  if (length != 0) {
+    uint8_t block[64];
+    std::memset(block, 0x20, 64);
+    std::memcpy(block, input, length);
+    simd::simd8x64<uint8_t> in(block);
+    c.check_next_input(in);
+  }
+  c.check_eof();
+  return !c.errors();
+}
+
+/**
+ * Validates a single block, e.g., short strings packed together.
+ */
+template <class checker>
+is_utf8_really_inline bool generic_validate_utf8_block(const uint8_t *block) {
+  checker c{};
+  simd::simd8x64<uint8_t> in(block);
+  c.check_next_input(in);
+  c.check_eof();
+  return !c.errors();
+}
+
+/**
+ * Validates many strings: one dispatch for the whole batch. Strings shorter
+ * than 64 bytes are packed several to a block (see pack_short_strings), and
+ * only validated one by one if their block is invalid.
+ */
+template <class checker>
+size_t generic_validate_utf8_batch(const char *const *bufs, const size_t *lens,
+                                   size_t count, uint8_t *results) {
+  size_t valid_count = 0;
+  size_t i = 0;
+  while (i < count) {
+    if (lens[i] >= 64) {
+      bool valid = generic_validate_utf8<checker>(
+          reinterpret_cast<const uint8_t *>(bufs[i]), lens[i]);
+      results[i] = uint8_t(valid);
+      valid_count += valid;
+      i++;
+      continue;
+    }
+    uint8_t block[64];
+    size_t end = internal::pack_short_strings(bufs, lens, i, count, block);
+    if (is_utf8_likely(generic_validate_utf8_block<checker>(block))) {
+      valid_count += end - i;
+      for (; i < end; i++) {
+        results[i] = 1;
+      }
+      continue;
+    }
+    for (; i < end; i++) {
+      bool valid = generic_validate_utf8<checker>(
+          reinterpret_cast<const uint8_t *>(bufs[i]), lens[i]);
+      results[i] = uint8_t(valid);
+      valid_count += valid;
+    }
+  }
+  return valid_count;
+}
+
+template <class checker>
+size_t generic_find_first_invalid_utf8(const char *const *bufs,
+                                       const size_t *lens, size_t count) {
+  size_t i = 0;
+  while (i < count) {
+    size_t end = i + 1;
+    if (lens[i] < 64) {
+      uint8_t block[64];
+      end = internal::pack_short_strings(bufs, lens, i, count, block);
+      if (is_utf8_likely(generic_validate_utf8_block<checker>(block))) {
+        i = end;
+        continue;
+      }
+    }
+    for (; i < end; i++) {
+      if (!generic_validate_utf8<checker>(
+              reinterpret_cast<const uint8_t *>(bufs[i]), lens[i])) {
+        return i;
+      }
+    }
+  }
+  return count;
+}
+
+/**
+ * Validates and converts to UTF-16 in a single pass: each block goes through
+ * the checker, then the characters it completes are converted while the block
+ * is still in cache (ASCII blocks are widened with SIMD instructions). A
+ * character that straddles two blocks is converted after the second one.
+ * Errors are only located, with a second pass, when the checker reports one.
+ */
+template <endianness big_endian, class checker>
+result generic_convert_utf8_to_utf16_with_errors(const char *input,
+                                                 size_t length,
+                                                 char16_t *utf16_output) {
+  checker c{};
+  char16_t *start = utf16_output;
+  size_t pos = 0; // the bytes before pos have been converted
+  size_t idx = 0; // the bytes before idx have been validated
+  for (; idx + 64 <= length; idx += 64) {
+    simd::simd8x64<uint8_t> in(reinterpret_cast<const uint8_t *>(input + idx));
+    c.check_next_input(in);
+    if (c.errors()) {
+      break;
+    }
+    if (pos == idx && in.is_ascii()) {
+      simd::simd8x64<int8_t> ascii(
+          reinterpret_cast<const int8_t *>(input + idx));
+      ascii.template store_ascii_as_utf16<big_endian>(utf16_output);
+      utf16_output += 64;
+      pos += 64;
+    } else {
+      pos += scalar::utf8_to_utf16::convert_valid<big_endian>(
+          input + pos, idx + 64 - pos, utf16_output);
+    }
+  }
+  if (!c.errors()) {
+    if (idx < length) {
+      uint8_t block[64];
+      std::memset(block, 0x20, 64);
+      std::memcpy(block, input + idx, length - idx);
+      simd::simd8x64<uint8_t> in(block);
+      c.check_next_input(in);
+    }
+    c.check_eof();
+    if (is_utf8_likely(!c.errors())) {
+      scalar::utf8_to_utf16::convert_valid<big_endian>(
+          input + pos, length - pos, utf16_output);
+      return result(error_code::SUCCESS, size_t(utf16_output - start));
+    }
+  }
+  return generic_validate_utf8_with_errors<checker>(
+      reinterpret_cast<const uint8_t *>(input), length);
+}
+
+is_utf8_really_inline size_t utf16_length_from_utf8(const char *in,
+                                                    size_t size) {
+  size_t pos = 0;
+  size_t count = 0;
+  for (; pos + 64 <= size; pos += 64) {
+    simd::simd8x64<int8_t> input(reinterpret_cast<const int8_t *>(in + pos));
+    uint64_t utf8_continuation_mask = input.lt(-65 + 1);
+    uint64_t utf8_4byte = input.gteq_unsigned(240);
+    count += 64 - internal::count_ones(utf8_continuation_mask) +
+             internal::count_ones(utf8_4byte);
+  }
+  return count +
+         scalar::utf8_to_utf16::utf16_length_from_utf8(in + pos, size - pos);
+}
+
+/**
+ * Counts what is needed for the profile of a string. Only the non-ASCII blocks
+ * (already told apart by the checker) have bytes to count.
+ */
+struct utf8_profile_counters {
+  uint64_t above_latin1{0};
+  size_t continuation_bytes{0};
+  size_t four_byte_leading{0};
+  bool is_ascii{true};
+
+  is_utf8_really_inline void add(const simd::simd8x64<uint8_t> &in) {
+    if (in.is_ascii()) {
+      return;
+    }
+    is_ascii = false;
+    // U+0100 and above start with 0xC4 or more.
+    above_latin1 |= in.gteq_unsigned(0xC4);
+    continuation_bytes += internal::count_ones(in.in_range(0x80, 0xBF));
+    four_byte_leading += internal::count_ones(in.gteq_unsigned(0xF0));
+  }
+};
+
+/**
+ * Validates the string and, in the same loop, computes its profile.
+ */
+template <class checker>
+bool generic_validate_utf8_profile(const uint8_t *input, size_t length,
+                                   utf8_profile *profile) {
   checker c{};
+  utf8_profile_counters counters;
   buf_block_reader<64> reader(input, length);
   while (reader.has_full_block()) {
     simd::simd8x64<uint8_t> in(reader.full_block());
     c.check_next_input(in);
+    counters.add(in);
     reader.advance();
   }
+  // The padding is made of spaces: they are not counted.
   uint8_t block[64]{};
   reader.get_remainder(block);
   simd::simd8x64<uint8_t> in(block);
   c.check_next_input(in);
+  counters.add(in);
   reader.advance();
   c.check_eof();
+  if (c.errors()) {
+    return false;
+  }
+  profile->is_ascii = counters.is_ascii;
+  profile->is_latin1 = counters.above_latin1 == 0;
+  profile->code_points = length - counters.continuation_bytes;
+  profile->utf16_length = profile->code_points + counters.four_byte_leading;
+  return true;
+}
+
+} // namespace utf8_validation
+
+namespace utf16_validation {
+
+/**
+ * The only constraint on UTF-16 is that surrogates come in pairs: a high
+ * surrogate (D800...DBFF) must be immediately followed by a low surrogate
+ * (DC00...DFFF), and each low surrogate must follow a high surrogate. In other
+ * words, the high surrogates moved forward by one code unit must be exactly
+ * the low surrogates. The bitmasks have two bits per code unit, and the high
+ * surrogate ending a block is carried into the next block.
+ */
+struct utf16_checker {
+  uint64_t error{0};
+  uint64_t prev_high{0};
+
+  is_utf8_really_inline void
+  check_next_input(const simd::simd16x32<uint16_t> &in) {
+    uint64_t surrogates = in.in_range(0xD800, 0xDFFF);
+    if (is_utf8_likely((surrogates | prev_high) == 0)) {
+      return;
+    }
+    uint64_t high = in.in_range(0xD800, 0xDBFF);
+    uint64_t low = surrogates & ~high;
+    this->error |= low ^ ((high << 2) | prev_high);
+    this->prev_high = high >> 62;
+  }
+
+  // A high surrogate must not end the input.
+  is_utf8_really_inline void check_eof() { this->error |= this->prev_high; }
+
+  is_utf8_really_inline bool errors() const { return this->error != 0; }
+};
+
+template <endianness big_endian>
+bool generic_validate_utf16(const char16_t *input, size_t length) {
+  utf16_checker c{};
+  size_t pos = 0;
+  for (; pos + 32 <= length; pos += 32) {
+    simd::simd16x32<uint16_t> in(reinterpret_cast<const uint16_t *>(input + pos));
+    if (big_endian) {
+      in.swap_bytes();
+    }
+    c.check_next_input(in);
+  }
+  if (pos < length) {
+    // Zeros are not surrogates.
+    uint16_t block[32]{};
+    std::memcpy(block, input + pos, (length - pos) * sizeof(char16_t));
+    simd::simd16x32<uint16_t> in(block);
+    if (big_endian) {
+      in.swap_bytes();
+    }
+    c.check_next_input(in);
+  }
+  c.check_eof();
   return !c.errors();
 }
 
-bool generic_validate_utf8(const char *input, size_t length) {
-  return generic_validate_utf8<utf8_checker>(
-      reinterpret_cast<const uint8_t *>(input), length);
+} // namespace utf16_validation
+} // unnamed namespace
+} // namespace arm64
+} // namespace is_utf8_internals
+
+//
+// Implementation-specific overrides
+//
+namespace is_utf8_internals {
+namespace arm64 {
+
+is_utf8_warn_unused bool
+implementation::validate_utf8(const char *buf, size_t len) const noexcept {
+  return arm64::utf8_validation::generic_validate_utf8(buf, len);
+}
+
+implementation::validate_utf8_function
+implementation::get_validate_utf8_function() const noexcept {
+  return &arm64::utf8_validation::generic_validate_utf8;
+}
+
+is_utf8_warn_unused result implementation::validate_utf8_with_errors(
+    const char *buf, size_t len) const noexcept {
+  if (is_utf8_likely(arm64::utf8_validation::generic_validate_utf8(buf, len))) {
+    return result(error_code::SUCCESS, len);
+  }
+  return arm64::utf8_validation::generic_validate_utf8_with_errors(buf, len);
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf8_early_exit(const char *buf,
+                                         size_t len) const noexcept {
+  return arm64::utf8_validation::generic_validate_utf8_early_exit<
+      arm64::utf8_validation::utf8_checker>(
+      reinterpret_cast<const uint8_t *>(buf), len);
+}
+
+void implementation::utf8_stream_init(void *state) const noexcept {
+  arm64::utf8_validation::generic_utf8_stream_init<
+      arm64::utf8_validation::utf8_checker>(state);
+}
+
+is_utf8_warn_unused bool
+implementation::utf8_stream_update(void *state, const char *buf,
+                                   size_t len) const noexcept {
+  return arm64::utf8_validation::generic_utf8_stream_update<
+      arm64::utf8_validation::utf8_checker>(
+      state, reinterpret_cast<const uint8_t *>(buf), len);
+}
+
+is_utf8_warn_unused bool
+implementation::utf8_stream_finish(void *state, const char *buf,
+                                   size_t len) const noexcept {
+  return arm64::utf8_validation::generic_utf8_stream_finish<
+      arm64::utf8_validation::utf8_checker>(
+      state, reinterpret_cast<const uint8_t *>(buf), len);
+}
+
+size_t implementation::validate_utf8_batch(const char *const *bufs,
+                                           const size_t *lens, size_t count,
+                                           uint8_t *results) const noexcept {
+  return arm64::utf8_validation::generic_validate_utf8_batch<
+      arm64::utf8_validation::utf8_checker>(bufs, lens, count, results);
+}
+
+is_utf8_warn_unused size_t implementation::find_first_invalid_utf8(
+    const char *const *bufs, const size_t *lens, size_t count) const noexcept {
+  return arm64::utf8_validation::generic_find_first_invalid_utf8<
+      arm64::utf8_validation::utf8_checker>(bufs, lens, count);
+}
+
+is_utf8_warn_unused result implementation::convert_utf8_to_utf16le_with_errors(
+    const char *buf, size_t len, char16_t *utf16_output) const noexcept {
+  return arm64::utf8_validation::generic_convert_utf8_to_utf16_with_errors<
+      endianness::LITTLE, arm64::utf8_validation::utf8_checker>(buf, len,
+                                                                utf16_output);
+}
+
+is_utf8_warn_unused result implementation::convert_utf8_to_utf16be_with_errors(
+    const char *buf, size_t len, char16_t *utf16_output) const noexcept {
+  return arm64::utf8_validation::generic_convert_utf8_to_utf16_with_errors<
+      endianness::BIG, arm64::utf8_validation::utf8_checker>(buf, len,
+                                                             utf16_output);
+}
+
+is_utf8_warn_unused size_t implementation::utf16_length_from_utf8(
+    const char *buf, size_t len) const noexcept {
+  return arm64::utf8_validation::utf16_length_from_utf8(buf, len);
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf8_profile(const char *buf, size_t len,
+                                      utf8_profile *profile) const noexcept {
+  return arm64::utf8_validation::generic_validate_utf8_profile<
+      arm64::utf8_validation::utf8_checker>(
+      reinterpret_cast<const uint8_t *>(buf), len, profile);
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf16le(const char16_t *buf,
+                                 size_t len) const noexcept {
+  return arm64::utf16_validation::generic_validate_utf16<endianness::LITTLE>(
+      buf, len);
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf16be(const char16_t *buf,
+                                 size_t len) const noexcept {
+  return arm64::utf16_validation::generic_validate_utf16<endianness::BIG>(buf,
+                                                                        len);
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf8_padded(const char *buf,
+                                     size_t len) const noexcept {
+  return arm64::utf8_validation::generic_validate_utf8_padded<
+      arm64::utf8_validation::utf8_checker>(
+      reinterpret_cast<const uint8_t *>(buf), len);
+}
+
+} // namespace arm64
+} // namespace is_utf8_internals
+
+#endif
+#if IS_UTF8_IMPLEMENTATION_FALLBACK
+
+// redefining IS_UTF8_IMPLEMENTATION to "fallback"
+// #define IS_UTF8_IMPLEMENTATION fallback
+
+namespace is_utf8_internals {
+namespace fallback {
+
+is_utf8_warn_unused bool
+implementation::validate_utf8(const char *buf, size_t len) const noexcept {
+  return scalar::utf8::validate(buf, len);
+}
+
+implementation::validate_utf8_function
+implementation::get_validate_utf8_function() const noexcept {
+  return &scalar::utf8::validate;
+}
+
+is_utf8_warn_unused result implementation::validate_utf8_with_errors(
+    const char *buf, size_t len) const noexcept {
+  return scalar::utf8::validate_with_errors(buf, len);
+}
+
+// The scalar validation already stops on the first error.
+is_utf8_warn_unused bool
+implementation::validate_utf8_early_exit(const char *buf,
+                                         size_t len) const noexcept {
+  return scalar::utf8::validate(buf, len);
+}
+
+namespace {
+// Without SIMD registers to carry, we only keep the bytes of a character
+// that straddles two calls.
+struct utf8_stream_state {
+  uint8_t pending[3];
+  uint8_t pending_length;
+  bool error;
+};
+
+// Number of bytes in the character starting with this leading byte.
+is_utf8_really_inline size_t utf8_length_from_leading_byte(uint8_t byte) {
+  if (byte >= 0b11110000) {
+    return 4;
+  } else if (byte >= 0b11100000) {
+    return 3;
+  } else if (byte >= 0b11000000) {
+    return 2;
+  }
+  return 1;
+}
+} // unnamed namespace
+
+void implementation::utf8_stream_init(void *state) const noexcept {
+  static_assert(sizeof(utf8_stream_state) <= internal::utf8_stream_state_size,
+                "the state must fit in the stream state");
+  utf8_stream_state s{{0, 0, 0}, 0, false};
+  std::memcpy(state, &s, sizeof(s));
+}
+
+is_utf8_warn_unused bool
+implementation::utf8_stream_update(void *state, const char *buf,
+                                   size_t len) const noexcept {
+  utf8_stream_state s;
+  std::memcpy(&s, state, sizeof(s));
+  if (len == 0) {
+    // buf may be null: nothing to copy.
+    return !s.error;
+  }
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(buf);
+  size_t pos = 0;
+  if (!s.error && s.pending_length != 0) {
+    // Complete the character left over by the previous call.
+    uint8_t character[4];
+    size_t char_length = utf8_length_from_leading_byte(s.pending[0]);
+    std::memcpy(character, s.pending, s.pending_length);
+    size_t missing = char_length - s.pending_length;
+    if (len < missing) {
+      std::memcpy(s.pending + s.pending_length, data, len);
+      s.pending_length = uint8_t(s.pending_length + len);
+      std::memcpy(state, &s, sizeof(s));
+      return true;
+    }
+    std::memcpy(character + s.pending_length, data, missing);
+    s.error = !scalar::utf8::validate(reinterpret_cast<const char *>(character),
+                                      char_length);
+    s.pending_length = 0;
+    pos = missing;
+  }
+  if (!s.error) {
+    // Stop before a character that is cut by the end of the buffer.
+    size_t end = len;
+    for (size_t i = 1; i <= 3 && i <= len - pos; i++) {
+      uint8_t byte = data[len - i];
+      if (byte >= 0b11000000) {
+        if (utf8_length_from_leading_byte(byte) > i) {
+          end = len - i;
+        }
+        break;
+      } else if (byte < 0b10000000) {
+        break;
+      }
+    }
+    s.error = !scalar::utf8::validate(buf + pos, end - pos);
+    std::memcpy(s.pending, data + end, len - end);
+    s.pending_length = uint8_t(len - end);
+  }
+  std::memcpy(state, &s, sizeof(s));
+  return !s.error;
+}
+
+is_utf8_warn_unused bool
+implementation::utf8_stream_finish(void *state, const char *buf,
+                                   size_t len) const noexcept {
+  if (!utf8_stream_update(state, buf, len)) {
+    return false;
+  }
+  utf8_stream_state s;
+  std::memcpy(&s, state, sizeof(s));
+  // A character cut by the end of the stream is too short.
+  return s.pending_length == 0;
+}
+
+size_t implementation::validate_utf8_batch(const char *const *bufs,
+                                           const size_t *lens, size_t count,
+                                           uint8_t *results) const noexcept {
+  size_t valid_count = 0;
+  for (size_t i = 0; i < count; i++) {
+    bool valid = scalar::utf8::validate(bufs[i], lens[i]);
+    results[i] = uint8_t(valid);
+    valid_count += valid;
+  }
+  return valid_count;
+}
+
+is_utf8_warn_unused size_t implementation::find_first_invalid_utf8(
+    const char *const *bufs, const size_t *lens, size_t count) const noexcept {
+  for (size_t i = 0; i < count; i++) {
+    if (!scalar::utf8::validate(bufs[i], lens[i])) {
+      return i;
+    }
+  }
+  return count;
+}
+
+namespace {
+template <endianness big_endian>
+result convert_with_errors(const char *buf, size_t len,
+                           char16_t *utf16_output) noexcept {
+  result res = scalar::utf8::validate_with_errors(buf, len);
+  if (res.error != error_code::SUCCESS) {
+    return res;
+  }
+  char16_t *start = utf16_output;
+  scalar::utf8_to_utf16::convert_valid<big_endian>(buf, len, utf16_output);
+  return result(error_code::SUCCESS, size_t(utf16_output - start));
+}
+} // unnamed namespace
+
+is_utf8_warn_unused result implementation::convert_utf8_to_utf16le_with_errors(
+    const char *buf, size_t len, char16_t *utf16_output) const noexcept {
+  return convert_with_errors<endianness::LITTLE>(buf, len, utf16_output);
+}
+
+is_utf8_warn_unused result implementation::convert_utf8_to_utf16be_with_errors(
+    const char *buf, size_t len, char16_t *utf16_output) const noexcept {
+  return convert_with_errors<endianness::BIG>(buf, len, utf16_output);
+}
+
+is_utf8_warn_unused size_t implementation::utf16_length_from_utf8(
+    const char *buf, size_t len) const noexcept {
+  return scalar::utf8_to_utf16::utf16_length_from_utf8(buf, len);
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf8_profile(const char *buf, size_t len,
+                                      utf8_profile *profile) const noexcept {
+  if (!scalar::utf8::validate(buf, len)) {
+    return false;
+  }
+  *profile = scalar::utf8::profile_valid(buf, len);
+  return true;
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf16le(const char16_t *buf,
+                                 size_t len) const noexcept {
+  return scalar::utf16::validate<endianness::LITTLE>(buf, len);
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf16be(const char16_t *buf,
+                                 size_t len) const noexcept {
+  return scalar::utf16::validate<endianness::BIG>(buf, len);
+}
+
+// The scalar validation never reads past the end of the input.
+is_utf8_warn_unused bool
+implementation::validate_utf8_padded(const char *buf,
+                                     size_t len) const noexcept {
+  return scalar::utf8::validate(buf, len);
+}
+
+} // namespace fallback
+} // namespace is_utf8_internals
+
+#endif
+#if IS_UTF8_IMPLEMENTATION_AVX512BW
+
+// The kernel of icelake and skylake_x, compiled once for AVX-512BW: it uses no
+// VBMI2 instruction. Both implementations call the functions of avx512bw.
+IS_UTF8_TARGET_AVX512BW
+
+#if IS_UTF8_GCC11ORMORE // workaround for
+                        // https://gcc.gnu.org/bugzilla/show_bug.cgi?id=105593
+IS_UTF8_DISABLE_GCC_WARNING(-Wmaybe-uninitialized)
+#endif // end of workaround
+
+namespace is_utf8_internals {
+namespace avx512bw {
+namespace {
+
+/**
+ * Store the last N bytes of previous followed by 512-N bytes from input.
+ */
+template <int N> __m512i prev(__m512i input, __m512i previous) {
+  static_assert(N <= 32, "N must be no larger than 32");
+  const __m512i movemask =
+      _mm512_setr_epi32(28, 29, 30, 31, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11);
+  const __m512i rotated = _mm512_permutex2var_epi32(input, movemask, previous);
+#if IS_UTF8_GCC8 || IS_UTF8_GCC9
+  constexpr int shift = 16 - N; // workaround for GCC8,9
+  return _mm512_alignr_epi8(input, rotated, shift);
+#else
+  return _mm512_alignr_epi8(input, rotated, 16 - N);
+#endif // IS_UTF8_GCC8 || IS_UTF8_GCC9
+}
+
+is_utf8_really_inline __m512i check_special_cases(__m512i input,
+                                                  const __m512i prev1) {
+  __m512i mask1 = _mm512_setr_epi64(0x0202020202020202, 0x4915012180808080,
+                                    0x0202020202020202, 0x4915012180808080,
+                                    0x0202020202020202, 0x4915012180808080,
+                                    0x0202020202020202, 0x4915012180808080);
+  const __m512i v_0f = _mm512_set1_epi8(0x0f);
+  __m512i index1 = _mm512_and_si512(_mm512_srli_epi16(prev1, 4), v_0f);
+
+  __m512i byte_1_high = _mm512_shuffle_epi8(mask1, index1);
+  __m512i mask2 = _mm512_setr_epi64(0xcbcbcb8b8383a3e7, 0xcbcbdbcbcbcbcbcb,
+                                    0xcbcbcb8b8383a3e7, 0xcbcbdbcbcbcbcbcb,
+                                    0xcbcbcb8b8383a3e7, 0xcbcbdbcbcbcbcbcb,
+                                    0xcbcbcb8b8383a3e7, 0xcbcbdbcbcbcbcbcb);
+  __m512i index2 = _mm512_and_si512(prev1, v_0f);
+
+  __m512i byte_1_low = _mm512_shuffle_epi8(mask2, index2);
+  __m512i mask3 =
+      _mm512_setr_epi64(0x101010101010101, 0x1010101babaaee6, 0x101010101010101,
+                        0x1010101babaaee6, 0x101010101010101, 0x1010101babaaee6,
+                        0x101010101010101, 0x1010101babaaee6);
+  __m512i index3 = _mm512_and_si512(_mm512_srli_epi16(input, 4), v_0f);
+  __m512i byte_2_high = _mm512_shuffle_epi8(mask3, index3);
+  return _mm512_ternarylogic_epi64(byte_1_high, byte_1_low, byte_2_high, 128);
+}
+
+is_utf8_really_inline __m512i check_multibyte_lengths(const __m512i input,
+                                                      const __m512i prev_input,
+                                                      const __m512i sc) {
+  __m512i prev2 = prev<2>(input, prev_input);
+  __m512i prev3 = prev<3>(input, prev_input);
+  __m512i is_third_byte = _mm512_subs_epu8(
+      prev2, _mm512_set1_epi8(char(0b11011111))); // Only 111_____ will be > 0
+  __m512i is_fourth_byte = _mm512_subs_epu8(
+      prev3, _mm512_set1_epi8(char(0b11101111))); // Only 1111____ will be > 0
+  __m512i is_third_or_fourth_byte =
+      _mm512_or_si512(is_third_byte, is_fourth_byte);
+  const __m512i v_7f = _mm512_set1_epi8(char(0x7f));
+  is_third_or_fourth_byte = _mm512_adds_epu8(v_7f, is_third_or_fourth_byte);
+  // We want to compute (is_third_or_fourth_byte AND v80) XOR sc.
+  const __m512i v_80 = _mm512_set1_epi8(char(0x80));
+  return _mm512_ternarylogic_epi32(is_third_or_fourth_byte, v_80, sc,
+                                   0b1101010);
+  //__m512i is_third_or_fourth_byte_mask =
+  //_mm512_and_si512(is_third_or_fourth_byte, v_80); return
+  // _mm512_xor_si512(is_third_or_fourth_byte_mask, sc);
+}
+//
+// Return nonzero if there are incomplete multibyte characters at the end of the
+// block: e.g. if there is a 4-byte character, but it's 3 bytes from the end.
+//
+is_utf8_really_inline __m512i is_incomplete(const __m512i input) {
+  // If the previous input's last 3 bytes match this, they're too short (they
+  // ended at EOF):
+  // ... 1111____ 111_____ 11______
+  __m512i max_value = _mm512_setr_epi64(0xffffffffffffffff, 0xffffffffffffffff,
+                                        0xffffffffffffffff, 0xffffffffffffffff,
+                                        0xffffffffffffffff, 0xffffffffffffffff,
+                                        0xffffffffffffffff, 0xbfdfefffffffffff);
+  return _mm512_subs_epu8(input, max_value);
+}
+
+struct avx512_utf8_checker {
+  // If this is nonzero, there has been a UTF-8 error.
+  __m512i error{};
+
+  // The last input we received
+  __m512i prev_input_block{};
+  // Whether the last input we received was incomplete (used for ASCII fast
+  // path)
+  __m512i prev_incomplete{};
+
+  //
+  // Check whether the current bytes are valid UTF-8.
+  //
+  is_utf8_really_inline void check_utf8_bytes(const __m512i input,
+                                              const __m512i prev_input) {
+    // Flip prev1...prev3 so we can easily determine if they are 2+, 3+ or 4+
+    // lead bytes (2, 3, 4-byte leads become large positive numbers instead of
+    // small negative numbers)
+    __m512i prev1 = prev<1>(input, prev_input);
+    __m512i sc = check_special_cases(input, prev1);
+    this->error = _mm512_or_si512(
+        check_multibyte_lengths(input, prev_input, sc), this->error);
+  }
+
+  // The only problem that can happen at EOF is that a multibyte character is
+  // too short or a byte value too large in the last bytes: check_special_cases
+  // only checks for bytes too large in the first of two bytes.
+  is_utf8_really_inline void check_eof() {
+    // If the previous block had incomplete UTF-8 characters at the end, an
+    // ASCII block can't possibly finish them.
+    this->error = _mm512_or_si512(this->error, this->prev_incomplete);
+  }
+
+  // returns true if ASCII.
+  is_utf8_really_inline bool check_next_input(const __m512i input) {
+    const __m512i v_80 = _mm512_set1_epi8(char(0x80));
+    const __mmask64 ascii = _mm512_test_epi8_mask(input, v_80);
+    if (ascii == 0) {
+      this->error = _mm512_or_si512(this->error, this->prev_incomplete);
+      return true;
+    } else {
+      this->check_utf8_bytes(input, this->prev_input_block);
+      this->prev_incomplete = is_incomplete(input);
+      this->prev_input_block = input;
+      return false;
+    }
+  }
+
+  // The whole 64-byte blocks of the len bytes, of which it returns the
+  // length. After an ASCII block, the next ones are ORed together
+  // IS_UTF8_ASCII_SCAN_LENGTH bytes at a time, and skipped at once as long as
+  // none of these bytes is above 0x7F.
+  is_utf8_really_inline size_t check_full_blocks(const char *ptr,
+                                                 size_t len) {
+    constexpr size_t scan = IS_UTF8_ASCII_SCAN_LENGTH;
+    static_assert(scan % 64 == 0 && scan >= 64 && scan <= 1024,
+                  "IS_UTF8_ASCII_SCAN_LENGTH must be a multiple of 64 between "
+                  "64 and 1024");
+    const __m512i v_80 = _mm512_set1_epi8(char(0x80));
+    size_t idx = 0;
+    size_t window_end = 0; // the window before it has non-ASCII bytes
+    while (idx + 64 <= len) {
+      const __m512i input = _mm512_loadu_si512((const __m512i *)(ptr + idx));
+      idx += 64;
+      if (!this->check_next_input(input) || scan == 64 || idx < window_end) {
+        continue;
+      }
+      for (; idx + scan <= len; idx += scan) {
+        __m512i any = _mm512_loadu_si512((const __m512i *)(ptr + idx));
+        for (size_t block = 64; block < scan; block += 64) {
+          any = _mm512_or_si512(
+              any, _mm512_loadu_si512((const __m512i *)(ptr + idx + block)));
+        }
+        if (_mm512_test_epi8_mask(any, v_80) != 0) {
+          window_end = idx + scan;
+          break;
+        }
+      }
+    }
+    return idx;
+  }
+
+  // do not forget to call check_eof!
+  is_utf8_really_inline bool errors() const {
+    return _mm512_test_epi8_mask(this->error, this->error) != 0;
+  }
+
+}; // struct avx512_utf8_checker
+
+bool validate_utf8(const char *buf, size_t len) {
+  avx512_utf8_checker checker{};
+  const char *ptr = buf + checker.check_full_blocks(buf, len);
+  const char *end = buf + len;
+  {
+    const __m512i utf8 = _mm512_maskz_loadu_epi8((1ULL << (end - ptr)) - 1,
+                                                 (const __m512i *)ptr);
+    checker.check_next_input(utf8);
+  }
+  checker.check_eof();
+  return !checker.errors();
+}
+
+result validate_utf8_with_errors(const char *buf, size_t len) {
+  if (is_utf8_likely(validate_utf8(buf, len))) {
+    return result(error_code::SUCCESS, len);
+  }
+  avx512_utf8_checker checker{};
+  const char *ptr = buf;
+  const char *end = ptr + len;
+  size_t count{0};
+  for (; ptr + 64 <= end; ptr += 64) {
+    const __m512i utf8 = _mm512_loadu_si512((const __m512i *)ptr);
+    checker.check_next_input(utf8);
+    if (checker.errors()) {
+      if (count != 0) {
+        count--;
+      } // Sometimes the error is only detected in the next chunk
+      result res = scalar::utf8::rewind_and_validate_with_errors(
+          buf, buf + count, len - count);
+      res.count += count;
+      return res;
+    }
+    count += 64;
+  }
+  // The whole input is invalid, so the error is in the last block if we get
+  // here.
+  if (count != 0) {
+    count--;
+  }
+  result res = scalar::utf8::rewind_and_validate_with_errors(buf, buf + count,
+                                                             len - count);
+  res.count += count;
+  return res;
+}
+
+void utf8_stream_init(void *state) {
+  static_assert(sizeof(avx512_utf8_checker) <=
+                    internal::utf8_stream_state_size,
+                "the checker must fit in the stream state");
+  avx512_utf8_checker checker{};
+  std::memcpy(state, static_cast<const void *>(&checker), sizeof(checker));
+}
+
+bool utf8_stream_update(void *state, const char *buf, size_t len) {
+  avx512_utf8_checker checker{};
+  std::memcpy(static_cast<void *>(&checker), state, sizeof(checker));
+  const char *ptr = buf;
+  const char *end = ptr + len;
+  for (; ptr + 64 <= end; ptr += 64) {
+    const __m512i utf8 = _mm512_loadu_si512((const __m512i *)ptr);
+    checker.check_next_input(utf8);
+  }
+  std::memcpy(state, static_cast<const void *>(&checker), sizeof(checker));
+  return !checker.errors();
+}
+
+bool utf8_stream_finish(void *state, const char *buf, size_t len) {
+  avx512_utf8_checker checker{};
+  std::memcpy(static_cast<void *>(&checker), state, sizeof(checker));
+  if (len != 0) {
+    const __m512i utf8 =
+        _mm512_maskz_loadu_epi8((1ULL << len) - 1, (const __m512i *)buf);
+    checker.check_next_input(utf8);
+  }
+  checker.check_eof();
+  return !checker.errors();
+}
+
+// Validates a single block, e.g., short strings packed together.
+is_utf8_really_inline bool validate_utf8_block(const uint8_t *block) {
+  avx512_utf8_checker checker{};
+  checker.check_next_input(_mm512_loadu_si512((const __m512i *)block));
+  checker.check_eof();
+  return !checker.errors();
+}
+
+// Strings shorter than 64 bytes are packed several to a block (see
+// pack_short_strings), and only validated one by one if their block is
+// invalid.
+size_t validate_utf8_batch(const char *const *bufs, const size_t *lens,
+                           size_t count, uint8_t *results) {
+  size_t valid_count = 0;
+  size_t i = 0;
+  while (i < count) {
+    if (lens[i] >= 64) {
+      bool valid = validate_utf8(bufs[i], lens[i]);
+      results[i] = uint8_t(valid);
+      valid_count += valid;
+      i++;
+      continue;
+    }
+    uint8_t block[64];
+    size_t end = internal::pack_short_strings(bufs, lens, i, count, block);
+    if (is_utf8_likely(validate_utf8_block(block))) {
+      valid_count += end - i;
+      for (; i < end; i++) {
+        results[i] = 1;
+      }
+      continue;
+    }
+    for (; i < end; i++) {
+      bool valid = validate_utf8(bufs[i], lens[i]);
+      results[i] = uint8_t(valid);
+      valid_count += valid;
+    }
+  }
+  return valid_count;
+}
+
+size_t find_first_invalid_utf8(const char *const *bufs, const size_t *lens,
+                               size_t count) {
+  size_t i = 0;
+  while (i < count) {
+    size_t end = i + 1;
+    if (lens[i] < 64) {
+      uint8_t block[64];
+      end = internal::pack_short_strings(bufs, lens, i, count, block);
+      if (is_utf8_likely(validate_utf8_block(block))) {
+        i = end;
+        continue;
+      }
+    }
+    for (; i < end; i++) {
+      if (!validate_utf8(bufs[i], lens[i])) {
+        return i;
+      }
+    }
+  }
+  return count;
+}
+
+// Validates and converts to UTF-16 in a single pass, see
+// generic_convert_utf8_to_utf16_with_errors.
+template <endianness big_endian>
+result convert_utf8_to_utf16_with_errors(const char *buf, size_t len,
+                                         char16_t *utf16_output) {
+  avx512_utf8_checker checker{};
+  char16_t *start = utf16_output;
+  size_t pos = 0; // the bytes before pos have been converted
+  size_t idx = 0; // the bytes before idx have been validated
+  for (; idx + 64 <= len; idx += 64) {
+    const __m512i utf8 = _mm512_loadu_si512((const __m512i *)(buf + idx));
+    checker.check_next_input(utf8);
+    if (checker.errors()) {
+      break;
+    }
+    if (pos == idx && _mm512_movepi8_mask(utf8) == 0) {
+      __m512i first = _mm512_cvtepu8_epi16(_mm512_castsi512_si256(utf8));
+      __m512i second =
+          _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(utf8, 1));
+      if (big_endian) {
+        first = _mm512_or_si512(_mm512_slli_epi16(first, 8),
+                                _mm512_srli_epi16(first, 8));
+        second = _mm512_or_si512(_mm512_slli_epi16(second, 8),
+                                 _mm512_srli_epi16(second, 8));
+      }
+      _mm512_storeu_si512((__m512i *)utf16_output, first);
+      _mm512_storeu_si512((__m512i *)(utf16_output + 32), second);
+      utf16_output += 64;
+      pos += 64;
+    } else {
+      pos += scalar::utf8_to_utf16::convert_valid<big_endian>(
+          buf + pos, idx + 64 - pos, utf16_output);
+    }
+  }
+  if (!checker.errors()) {
+    const __m512i utf8 = _mm512_maskz_loadu_epi8((1ULL << (len - idx)) - 1,
+                                                 (const __m512i *)(buf + idx));
+    checker.check_next_input(utf8);
+    checker.check_eof();
+    if (is_utf8_likely(!checker.errors())) {
+      scalar::utf8_to_utf16::convert_valid<big_endian>(buf + pos, len - pos,
+                                                       utf16_output);
+      return result(error_code::SUCCESS, size_t(utf16_output - start));
+    }
+  }
+  // Locate the error.
+  avx512_utf8_checker error_checker{};
+  size_t count{0};
+  for (; count + 64 <= len; count += 64) {
+    error_checker.check_next_input(
+        _mm512_loadu_si512((const __m512i *)(buf + count)));
+    if (error_checker.errors()) {
+      break;
+    }
+  }
+  if (count != 0) {
+    count--;
+  } // Sometimes the error is only detected in the next chunk
+  result res = scalar::utf8::rewind_and_validate_with_errors(buf, buf + count,
+                                                             len - count);
+  res.count += count;
+  return res;
+}
+
+size_t utf16_length_from_utf8(const char *buf, size_t len) {
+  const __m512i continuation = _mm512_set1_epi8(char(0b10111111));
+  const __m512i four_bytes = _mm512_set1_epi8(char(0b11101111));
+  size_t pos = 0;
+  size_t count = 0;
+  for (; pos + 64 <= len; pos += 64) {
+    const __m512i utf8 = _mm512_loadu_si512((const __m512i *)(buf + pos));
+    // Leading bytes are above 0b10111111 as signed bytes (ASCII is
+    // positive), four-byte leading bytes above 0b11101111 as unsigned bytes.
+    uint64_t leading = _mm512_cmpgt_epi8_mask(utf8, continuation);
+    uint64_t four_byte_leading = _mm512_cmpgt_epu8_mask(utf8, four_bytes);
+    count += internal::count_ones(leading) +
+             internal::count_ones(four_byte_leading);
+  }
+  return count +
+         scalar::utf8_to_utf16::utf16_length_from_utf8(buf + pos, len - pos);
+}
+
+bool validate_utf8_profile(const char *buf, size_t len,
+                           utf8_profile *profile) {
+  const __m512i continuation_end = _mm512_set1_epi8(char(0b11000000));
+  const __m512i latin1_end = _mm512_set1_epi8(char(0xC4));
+  const __m512i four_byte_start = _mm512_set1_epi8(char(0b11110000));
+  avx512_utf8_checker checker{};
+  uint64_t above_latin1{0};
+  size_t continuation_bytes{0};
+  size_t four_byte_leading{0};
+  bool is_ascii{true};
+  size_t pos = 0;
+  while (true) {
+    const bool last = pos + 64 > len;
+    // The tail is padded with zeros: they are not counted.
+    const __m512i utf8 =
+        last ? _mm512_maskz_loadu_epi8((1ULL << (len - pos)) - 1,
+                                       (const __m512i *)(buf + pos))
+             : _mm512_loadu_si512((const __m512i *)(buf + pos));
+    checker.check_next_input(utf8);
+    if (_mm512_movepi8_mask(utf8) != 0) {
+      is_ascii = false;
+      // U+0100 and above start with 0xC4 or more.
+      above_latin1 |= _mm512_cmpge_epu8_mask(utf8, latin1_end);
+      // Continuation bytes are the signed bytes below 0b11000000.
+      continuation_bytes += internal::count_ones(
+          _mm512_cmplt_epi8_mask(utf8, continuation_end));
+      four_byte_leading += internal::count_ones(
+          _mm512_cmpge_epu8_mask(utf8, four_byte_start));
+    }
+    if (last) {
+      break;
+    }
+    pos += 64;
+  }
+  checker.check_eof();
+  if (checker.errors()) {
+    return false;
+  }
+  profile->is_ascii = is_ascii;
+  profile->is_latin1 = above_latin1 == 0;
+  profile->code_points = len - continuation_bytes;
+  profile->utf16_length = profile->code_points + four_byte_leading;
+  return true;
+}
+
+// See utf16_checker: with AVX-512, the masks have one bit per code unit.
+template <endianness big_endian>
+bool validate_utf16(const char16_t *buf, size_t len) {
+  const __m512i swap = _mm512_set_epi64(
+      0x0e0f0c0d0a0b0809, 0x0607040502030001, 0x0e0f0c0d0a0b0809,
+      0x0607040502030001, 0x0e0f0c0d0a0b0809, 0x0607040502030001,
+      0x0e0f0c0d0a0b0809, 0x0607040502030001);
+  const __m512i surrogate_mask = _mm512_set1_epi16(uint16_t(0xF800));
+  const __m512i surrogate = _mm512_set1_epi16(uint16_t(0xD800));
+  const __m512i high_mask = _mm512_set1_epi16(uint16_t(0xFC00));
+  uint32_t error{0};
+  uint32_t prev_high{0};
+  size_t pos = 0;
+  while (true) {
+    const bool last = pos + 32 > len;
+    // The tail is padded with zeros, which are not surrogates.
+    __m512i utf16 =
+        last ? _mm512_maskz_loadu_epi16((1U << (len - pos)) - 1,
+                                        (const __m512i *)(buf + pos))
+             : _mm512_loadu_si512((const __m512i *)(buf + pos));
+    if (big_endian) {
+      utf16 = _mm512_shuffle_epi8(utf16, swap);
+    }
+    uint32_t surrogates = _mm512_cmpeq_epi16_mask(
+        _mm512_and_si512(utf16, surrogate_mask), surrogate);
+    if (is_utf8_unlikely((surrogates | prev_high) != 0)) {
+      uint32_t high = _mm512_cmpeq_epi16_mask(
+          _mm512_and_si512(utf16, high_mask), surrogate);
+      uint32_t low = surrogates & ~high;
+      error |= low ^ ((high << 1) | prev_high);
+      prev_high = high >> 31;
+    }
+    if (last) {
+      break;
+    }
+    pos += 32;
+  }
+  return (error | prev_high) == 0;
+}
+
+bool validate_utf8_early_exit(const char *buf, size_t len) {
+  constexpr size_t stride = 64 * IS_UTF8_EARLY_EXIT_BLOCKS;
+  avx512_utf8_checker checker{};
+  const char *ptr = buf;
+  const char *end = ptr + len;
+  for (; ptr + stride <= end; ptr += stride) {
+    for (size_t block = 0; block < stride; block += 64) {
+      checker.check_next_input(
+          _mm512_loadu_si512((const __m512i *)(ptr + block)));
+    }
+    if (checker.errors()) {
+      return false;
+    }
+  }
+  for (; ptr + 64 <= end; ptr += 64) {
+    checker.check_next_input(_mm512_loadu_si512((const __m512i *)ptr));
+  }
+  checker.check_next_input(
+      _mm512_maskz_loadu_epi8((1ULL << (end - ptr)) - 1, (const __m512i *)ptr));
+  checker.check_eof();
+  return !checker.errors();
+}
+
+} // unnamed namespace
+} // namespace avx512bw
+} // namespace is_utf8_internals
+
+IS_UTF8_UNTARGET_AVX512BW
+
+#if IS_UTF8_GCC11ORMORE // workaround for
+                        // https://gcc.gnu.org/bugzilla/show_bug.cgi?id=105593
+IS_UTF8_POP_DISABLE_WARNINGS
+#endif // end of workaround
+
+#endif
+#if IS_UTF8_IMPLEMENTATION_ICELAKE
+
+// redefining IS_UTF8_IMPLEMENTATION to "icelake"
+// #define IS_UTF8_IMPLEMENTATION icelake
+IS_UTF8_TARGET_ICELAKE
+
+namespace is_utf8_internals {
+namespace icelake {
+
+// The kernel is that of avx512bw, shared with skylake_x.
+
+is_utf8_warn_unused bool
+implementation::validate_utf8(const char *buf, size_t len) const noexcept {
+  return avx512bw::validate_utf8(buf, len);
+}
+
+implementation::validate_utf8_function
+implementation::get_validate_utf8_function() const noexcept {
+  return &avx512bw::validate_utf8;
 }
 
-} // namespace utf8_validation
-} // unnamed namespace
-} // namespace arm64
-} // namespace is_utf8_internals
+is_utf8_warn_unused result implementation::validate_utf8_with_errors(
+    const char *buf, size_t len) const noexcept {
+  return avx512bw::validate_utf8_with_errors(buf, len);
+}
 
-//
-// Implementation-specific overrides
-//
-namespace is_utf8_internals {
-namespace arm64 {
+is_utf8_warn_unused bool
+implementation::validate_utf8_early_exit(const char *buf,
+                                         size_t len) const noexcept {
+  return avx512bw::validate_utf8_early_exit(buf, len);
+}
+
+void implementation::utf8_stream_init(void *state) const noexcept {
+  avx512bw::utf8_stream_init(state);
+}
 
 is_utf8_warn_unused bool
-implementation::validate_utf8(const char *buf, size_t len) const noexcept {
-  return arm64::utf8_validation::generic_validate_utf8(buf, len);
+implementation::utf8_stream_update(void *state, const char *buf,
+                                   size_t len) const noexcept {
+  return avx512bw::utf8_stream_update(state, buf, len);
 }
 
-} // namespace arm64
+is_utf8_warn_unused bool
+implementation::utf8_stream_finish(void *state, const char *buf,
+                                   size_t len) const noexcept {
+  return avx512bw::utf8_stream_finish(state, buf, len);
+}
+
+size_t implementation::validate_utf8_batch(const char *const *bufs,
+                                           const size_t *lens, size_t count,
+                                           uint8_t *results) const noexcept {
+  return avx512bw::validate_utf8_batch(bufs, lens, count, results);
+}
+
+is_utf8_warn_unused size_t implementation::find_first_invalid_utf8(
+    const char *const *bufs, const size_t *lens, size_t count) const noexcept {
+  return avx512bw::find_first_invalid_utf8(bufs, lens, count);
+}
+
+is_utf8_warn_unused result implementation::convert_utf8_to_utf16le_with_errors(
+    const char *buf, size_t len, char16_t *utf16_output) const noexcept {
+  return avx512bw::convert_utf8_to_utf16_with_errors<endianness::LITTLE>(
+      buf, len, utf16_output);
+}
+
+is_utf8_warn_unused result implementation::convert_utf8_to_utf16be_with_errors(
+    const char *buf, size_t len, char16_t *utf16_output) const noexcept {
+  return avx512bw::convert_utf8_to_utf16_with_errors<endianness::BIG>(
+      buf, len, utf16_output);
+}
+
+is_utf8_warn_unused size_t implementation::utf16_length_from_utf8(
+    const char *buf, size_t len) const noexcept {
+  return avx512bw::utf16_length_from_utf8(buf, len);
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf8_profile(const char *buf, size_t len,
+                                      utf8_profile *profile) const noexcept {
+  return avx512bw::validate_utf8_profile(buf, len, profile);
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf16le(const char16_t *buf,
+                                 size_t len) const noexcept {
+  return avx512bw::validate_utf16<endianness::LITTLE>(buf, len);
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf16be(const char16_t *buf,
+                                 size_t len) const noexcept {
+  return avx512bw::validate_utf16<endianness::BIG>(buf, len);
+}
+
+// The last block is already read in place, with a masked load.
+is_utf8_warn_unused bool
+implementation::validate_utf8_padded(const char *buf,
+                                     size_t len) const noexcept {
+  return avx512bw::validate_utf8(buf, len);
+}
+
+} // namespace icelake
 } // namespace is_utf8_internals
 
+IS_UTF8_UNTARGET_ICELAKE
+
 #endif
-#if IS_UTF8_IMPLEMENTATION_FALLBACK
+#if IS_UTF8_IMPLEMENTATION_SKYLAKE_X
 
-// redefining IS_UTF8_IMPLEMENTATION to "fallback"
-// #define IS_UTF8_IMPLEMENTATION fallback
+// redefining IS_UTF8_IMPLEMENTATION to "skylake_x"
+// #define IS_UTF8_IMPLEMENTATION skylake_x
+IS_UTF8_TARGET_SKYLAKE_X
 
 namespace is_utf8_internals {
-namespace fallback {
+namespace skylake_x {
+
+// The kernel is that of avx512bw, shared with icelake.
 
 is_utf8_warn_unused bool
 implementation::validate_utf8(const char *buf, size_t len) const noexcept {
-  return scalar::utf8::validate(buf, len);
+  return avx512bw::validate_utf8(buf, len);
 }
 
-} // namespace fallback
+implementation::validate_utf8_function
+implementation::get_validate_utf8_function() const noexcept {
+  return &avx512bw::validate_utf8;
+}
+
+is_utf8_warn_unused result implementation::validate_utf8_with_errors(
+    const char *buf, size_t len) const noexcept {
+  return avx512bw::validate_utf8_with_errors(buf, len);
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf8_early_exit(const char *buf,
+                                         size_t len) const noexcept {
+  return avx512bw::validate_utf8_early_exit(buf, len);
+}
+
+void implementation::utf8_stream_init(void *state) const noexcept {
+  avx512bw::utf8_stream_init(state);
+}
+
+is_utf8_warn_unused bool
+implementation::utf8_stream_update(void *state, const char *buf,
+                                   size_t len) const noexcept {
+  return avx512bw::utf8_stream_update(state, buf, len);
+}
+
+is_utf8_warn_unused bool
+implementation::utf8_stream_finish(void *state, const char *buf,
+                                   size_t len) const noexcept {
+  return avx512bw::utf8_stream_finish(state, buf, len);
+}
+
+size_t implementation::validate_utf8_batch(const char *const *bufs,
+                                           const size_t *lens, size_t count,
+                                           uint8_t *results) const noexcept {
+  return avx512bw::validate_utf8_batch(bufs, lens, count, results);
+}
+
+is_utf8_warn_unused size_t implementation::find_first_invalid_utf8(
+    const char *const *bufs, const size_t *lens, size_t count) const noexcept {
+  return avx512bw::find_first_invalid_utf8(bufs, lens, count);
+}
+
+is_utf8_warn_unused result implementation::convert_utf8_to_utf16le_with_errors(
+    const char *buf, size_t len, char16_t *utf16_output) const noexcept {
+  return avx512bw::convert_utf8_to_utf16_with_errors<endianness::LITTLE>(
+      buf, len, utf16_output);
+}
+
+is_utf8_warn_unused result implementation::convert_utf8_to_utf16be_with_errors(
+    const char *buf, size_t len, char16_t *utf16_output) const noexcept {
+  return avx512bw::convert_utf8_to_utf16_with_errors<endianness::BIG>(
+      buf, len, utf16_output);
+}
+
+is_utf8_warn_unused size_t implementation::utf16_length_from_utf8(
+    const char *buf, size_t len) const noexcept {
+  return avx512bw::utf16_length_from_utf8(buf, len);
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf8_profile(const char *buf, size_t len,
+                                      utf8_profile *profile) const noexcept {
+  return avx512bw::validate_utf8_profile(buf, len, profile);
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf16le(const char16_t *buf,
+                                 size_t len) const noexcept {
+  return avx512bw::validate_utf16<endianness::LITTLE>(buf, len);
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf16be(const char16_t *buf,
+                                 size_t len) const noexcept {
+  return avx512bw::validate_utf16<endianness::BIG>(buf, len);
+}
+
+// The last block is already read in place, with a masked load.
+is_utf8_warn_unused bool
+implementation::validate_utf8_padded(const char *buf,
+                                     size_t len) const noexcept {
+  return avx512bw::validate_utf8(buf, len);
+}
+
+} // namespace skylake_x
 } // namespace is_utf8_internals
 
+IS_UTF8_UNTARGET_SKYLAKE_X
+
 #endif
-#if IS_UTF8_IMPLEMENTATION_ICELAKE
+#if IS_UTF8_IMPLEMENTATION_AVX512VL
 
-// redefining IS_UTF8_IMPLEMENTATION to "icelake"
-// #define IS_UTF8_IMPLEMENTATION icelake
-IS_UTF8_TARGET_ICELAKE
+IS_UTF8_TARGET_AVX512VL
 
 #if IS_UTF8_GCC11ORMORE // workaround for
                         // https://gcc.gnu.org/bugzilla/show_bug.cgi?id=105593
@@ -5258,173 +8604,586 @@ IS_UTF8_DISABLE_GCC_WARNING(-Wmaybe-uninitialized)
 #endif // end of workaround
 
 namespace is_utf8_internals {
-namespace icelake {
+namespace avx512vl {
 namespace {
-#ifndef IS_UTF8_ICELAKE_H
-#error "icelake.h must be included"
+#ifndef IS_UTF8_AVX512VL_H
+#error "avx512vl.h must be included"
 #endif
 
 /**
- * Store the last N bytes of previous followed by 512-N bytes from input.
+ * Store the last N bytes of previous followed by 32-N bytes from input.
  */
-template <int N> __m512i prev(__m512i input, __m512i previous) {
-  static_assert(N <= 32, "N must be no larger than 32");
-  const __m512i movemask =
-      _mm512_setr_epi32(28, 29, 30, 31, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11);
-  const __m512i rotated = _mm512_permutex2var_epi32(input, movemask, previous);
-#if IS_UTF8_GCC8 || IS_UTF8_GCC9
-  constexpr int shift = 16 - N; // workaround for GCC8,9
-  return _mm512_alignr_epi8(input, rotated, shift);
-#else
-  return _mm512_alignr_epi8(input, rotated, 16 - N);
-#endif // IS_UTF8_GCC8 || IS_UTF8_GCC9
+template <int N> __m256i prev(__m256i input, __m256i previous) {
+  static_assert(N <= 16, "N must be no larger than 16");
+  return _mm256_alignr_epi8(
+      input, _mm256_permute2x128_si256(previous, input, 0x21), 16 - N);
 }
 
-is_utf8_really_inline __m512i check_special_cases(__m512i input,
-                                                  const __m512i prev1) {
-  __m512i mask1 = _mm512_setr_epi64(0x0202020202020202, 0x4915012180808080,
-                                    0x0202020202020202, 0x4915012180808080,
-                                    0x0202020202020202, 0x4915012180808080,
-                                    0x0202020202020202, 0x4915012180808080);
-  const __m512i v_0f = _mm512_set1_epi8(0x0f);
-  __m512i index1 = _mm512_and_si512(_mm512_srli_epi16(prev1, 4), v_0f);
-
-  __m512i byte_1_high = _mm512_shuffle_epi8(mask1, index1);
-  __m512i mask2 = _mm512_setr_epi64(0xcbcbcb8b8383a3e7, 0xcbcbdbcbcbcbcbcb,
-                                    0xcbcbcb8b8383a3e7, 0xcbcbdbcbcbcbcbcb,
-                                    0xcbcbcb8b8383a3e7, 0xcbcbdbcbcbcbcbcb,
-                                    0xcbcbcb8b8383a3e7, 0xcbcbdbcbcbcbcbcb);
-  __m512i index2 = _mm512_and_si512(prev1, v_0f);
-
-  __m512i byte_1_low = _mm512_shuffle_epi8(mask2, index2);
-  __m512i mask3 =
-      _mm512_setr_epi64(0x101010101010101, 0x1010101babaaee6, 0x101010101010101,
-                        0x1010101babaaee6, 0x101010101010101, 0x1010101babaaee6,
-                        0x101010101010101, 0x1010101babaaee6);
-  __m512i index3 = _mm512_and_si512(_mm512_srli_epi16(input, 4), v_0f);
-  __m512i byte_2_high = _mm512_shuffle_epi8(mask3, index3);
-  return _mm512_ternarylogic_epi64(byte_1_high, byte_1_low, byte_2_high, 128);
+is_utf8_really_inline __m256i check_special_cases(__m256i input,
+                                                  const __m256i prev1) {
+  const __m256i mask1 =
+      _mm256_setr_epi64x(0x0202020202020202, 0x4915012180808080,
+                         0x0202020202020202, 0x4915012180808080);
+  const __m256i v_0f = _mm256_set1_epi8(0x0f);
+  __m256i index1 = _mm256_and_si256(_mm256_srli_epi16(prev1, 4), v_0f);
+  __m256i byte_1_high = _mm256_shuffle_epi8(mask1, index1);
+  const __m256i mask2 =
+      _mm256_setr_epi64x(0xcbcbcb8b8383a3e7, 0xcbcbdbcbcbcbcbcb,
+                         0xcbcbcb8b8383a3e7, 0xcbcbdbcbcbcbcbcb);
+  __m256i index2 = _mm256_and_si256(prev1, v_0f);
+  __m256i byte_1_low = _mm256_shuffle_epi8(mask2, index2);
+  const __m256i mask3 =
+      _mm256_setr_epi64x(0x101010101010101, 0x1010101babaaee6,
+                         0x101010101010101, 0x1010101babaaee6);
+  __m256i index3 = _mm256_and_si256(_mm256_srli_epi16(input, 4), v_0f);
+  __m256i byte_2_high = _mm256_shuffle_epi8(mask3, index3);
+  return _mm256_ternarylogic_epi64(byte_1_high, byte_1_low, byte_2_high, 128);
 }
 
-is_utf8_really_inline __m512i check_multibyte_lengths(const __m512i input,
-                                                      const __m512i prev_input,
-                                                      const __m512i sc) {
-  __m512i prev2 = prev<2>(input, prev_input);
-  __m512i prev3 = prev<3>(input, prev_input);
-  __m512i is_third_byte = _mm512_subs_epu8(
-      prev2, _mm512_set1_epi8(char(0b11011111))); // Only 111_____ will be > 0
-  __m512i is_fourth_byte = _mm512_subs_epu8(
-      prev3, _mm512_set1_epi8(char(0b11101111))); // Only 1111____ will be > 0
-  __m512i is_third_or_fourth_byte =
-      _mm512_or_si512(is_third_byte, is_fourth_byte);
-  const __m512i v_7f = _mm512_set1_epi8(char(0x7f));
-  is_third_or_fourth_byte = _mm512_adds_epu8(v_7f, is_third_or_fourth_byte);
+is_utf8_really_inline __m256i check_multibyte_lengths(const __m256i input,
+                                                      const __m256i prev_input,
+                                                      const __m256i sc) {
+  __m256i prev2 = prev<2>(input, prev_input);
+  __m256i prev3 = prev<3>(input, prev_input);
+  __m256i is_third_byte = _mm256_subs_epu8(
+      prev2, _mm256_set1_epi8(char(0b11011111))); // Only 111_____ will be > 0
+  __m256i is_fourth_byte = _mm256_subs_epu8(
+      prev3, _mm256_set1_epi8(char(0b11101111))); // Only 1111____ will be > 0
+  __m256i is_third_or_fourth_byte =
+      _mm256_or_si256(is_third_byte, is_fourth_byte);
+  const __m256i v_7f = _mm256_set1_epi8(char(0x7f));
+  is_third_or_fourth_byte = _mm256_adds_epu8(v_7f, is_third_or_fourth_byte);
   // We want to compute (is_third_or_fourth_byte AND v80) XOR sc.
-  const __m512i v_80 = _mm512_set1_epi8(char(0x80));
-  return _mm512_ternarylogic_epi32(is_third_or_fourth_byte, v_80, sc,
+  const __m256i v_80 = _mm256_set1_epi8(char(0x80));
+  return _mm256_ternarylogic_epi32(is_third_or_fourth_byte, v_80, sc,
                                    0b1101010);
-  //__m512i is_third_or_fourth_byte_mask =
-  //_mm512_and_si512(is_third_or_fourth_byte, v_80); return
-  // _mm512_xor_si512(is_third_or_fourth_byte_mask, sc);
 }
+
 //
 // Return nonzero if there are incomplete multibyte characters at the end of the
 // block: e.g. if there is a 4-byte character, but it's 3 bytes from the end.
 //
-is_utf8_really_inline __m512i is_incomplete(const __m512i input) {
+is_utf8_really_inline __m256i is_incomplete(const __m256i input) {
   // If the previous input's last 3 bytes match this, they're too short (they
   // ended at EOF):
   // ... 1111____ 111_____ 11______
-  __m512i max_value = _mm512_setr_epi64(0xffffffffffffffff, 0xffffffffffffffff,
-                                        0xffffffffffffffff, 0xffffffffffffffff,
-                                        0xffffffffffffffff, 0xffffffffffffffff,
-                                        0xffffffffffffffff, 0xbfdfefffffffffff);
-  return _mm512_subs_epu8(input, max_value);
+  const __m256i max_value =
+      _mm256_setr_epi64x(0xffffffffffffffff, 0xffffffffffffffff,
+                         0xffffffffffffffff, 0xbfdfefffffffffff);
+  return _mm256_subs_epu8(input, max_value);
 }
 
-struct avx512_utf8_checker {
+// The avx512_utf8_checker of icelake on 32-byte registers: the masks and the
+// ternary logic of AVX-512 without the 512-bit registers.
+struct avx512vl_utf8_checker {
   // If this is nonzero, there has been a UTF-8 error.
-  __m512i error{};
+  __m256i error{};
 
   // The last input we received
-  __m512i prev_input_block{};
+  __m256i prev_input_block{};
   // Whether the last input we received was incomplete (used for ASCII fast
   // path)
-  __m512i prev_incomplete{};
+  __m256i prev_incomplete{};
 
   //
   // Check whether the current bytes are valid UTF-8.
   //
-  is_utf8_really_inline void check_utf8_bytes(const __m512i input,
-                                              const __m512i prev_input) {
-    // Flip prev1...prev3 so we can easily determine if they are 2+, 3+ or 4+
-    // lead bytes (2, 3, 4-byte leads become large positive numbers instead of
-    // small negative numbers)
-    __m512i prev1 = prev<1>(input, prev_input);
-    __m512i sc = check_special_cases(input, prev1);
-    this->error = _mm512_or_si512(
+  is_utf8_really_inline void check_utf8_bytes(const __m256i input,
+                                              const __m256i prev_input) {
+    __m256i prev1 = prev<1>(input, prev_input);
+    __m256i sc = check_special_cases(input, prev1);
+    this->error = _mm256_or_si256(
         check_multibyte_lengths(input, prev_input, sc), this->error);
   }
 
-  // The only problem that can happen at EOF is that a multibyte character is
-  // too short or a byte value too large in the last bytes: check_special_cases
-  // only checks for bytes too large in the first of two bytes.
-  is_utf8_really_inline void check_eof() {
-    // If the previous block had incomplete UTF-8 characters at the end, an
-    // ASCII block can't possibly finish them.
-    this->error = _mm512_or_si512(this->error, this->prev_incomplete);
+  // The only problem that can happen at EOF is that a multibyte character is
+  // too short or a byte value too large in the last bytes: check_special_cases
+  // only checks for bytes too large in the first of two bytes.
+  is_utf8_really_inline void check_eof() {
+    // If the previous block had incomplete UTF-8 characters at the end, an
+    // ASCII block can't possibly finish them.
+    this->error = _mm256_or_si256(this->error, this->prev_incomplete);
+  }
+
+  // 32 bytes known to have non-ASCII bytes.
+  is_utf8_really_inline void check_non_ascii_input(const __m256i input) {
+    this->check_utf8_bytes(input, this->prev_input_block);
+    this->prev_incomplete = is_incomplete(input);
+    this->prev_input_block = input;
+  }
+
+  // returns true if ASCII.
+  is_utf8_really_inline bool check_next_input(const __m256i input) {
+    const __m256i v_80 = _mm256_set1_epi8(char(0x80));
+    if (_mm256_test_epi8_mask(input, v_80) == 0) {
+      this->error = _mm256_or_si256(this->error, this->prev_incomplete);
+      return true;
+    } else {
+      this->check_non_ascii_input(input);
+      return false;
+    }
+  }
+
+  // A block of 64 bytes, with a single test when it is ASCII. Returns true if
+  // ASCII.
+  is_utf8_really_inline bool check_next_input(const char *ptr) {
+    const __m256i v_80 = _mm256_set1_epi8(char(0x80));
+    const __m256i first = _mm256_loadu_si256((const __m256i *)ptr);
+    const __m256i second = _mm256_loadu_si256((const __m256i *)(ptr + 32));
+    if (_mm256_test_epi8_mask(_mm256_or_si256(first, second), v_80) == 0) {
+      this->error = _mm256_or_si256(this->error, this->prev_incomplete);
+      return true;
+    }
+    this->check_non_ascii_input(first);
+    this->check_non_ascii_input(second);
+    return false;
+  }
+
+  // The whole 64-byte blocks of the len bytes, of which it returns the
+  // length. After an ASCII block, the next ones are ORed together
+  // IS_UTF8_ASCII_SCAN_LENGTH bytes at a time, and skipped at once as long as
+  // none of these bytes is above 0x7F.
+  is_utf8_really_inline size_t check_full_blocks(const char *ptr,
+                                                 size_t len) {
+    constexpr size_t scan = IS_UTF8_ASCII_SCAN_LENGTH;
+    static_assert(scan % 64 == 0 && scan >= 64 && scan <= 1024,
+                  "IS_UTF8_ASCII_SCAN_LENGTH must be a multiple of 64 between "
+                  "64 and 1024");
+    const __m256i v_80 = _mm256_set1_epi8(char(0x80));
+    size_t idx = 0;
+    size_t window_end = 0; // the window before it has non-ASCII bytes
+    while (idx + 64 <= len) {
+      const char *block = ptr + idx;
+      idx += 64;
+      if (!this->check_next_input(block) || scan == 64 || idx < window_end) {
+        continue;
+      }
+      for (; idx + scan <= len; idx += scan) {
+        __m256i any = _mm256_loadu_si256((const __m256i *)(ptr + idx));
+        for (size_t half = 32; half < scan; half += 32) {
+          any = _mm256_or_si256(
+              any, _mm256_loadu_si256((const __m256i *)(ptr + idx + half)));
+        }
+        if (_mm256_test_epi8_mask(any, v_80) != 0) {
+          window_end = idx + scan;
+          break;
+        }
+      }
+    }
+    return idx;
+  }
+
+  // The last len bytes, fewer than 64, read with masked loads: nothing is
+  // copied and nothing is read past the end.
+  is_utf8_really_inline void check_tail(const char *ptr, size_t len) {
+    if (len > 32) {
+      this->check_next_input(_mm256_loadu_si256((const __m256i *)ptr));
+      ptr += 32;
+      len -= 32;
+    }
+    this->check_next_input(_mm256_maskz_loadu_epi8(
+        __mmask32((uint64_t(1) << len) - 1), (const __m256i *)ptr));
+  }
+
+  // do not forget to call check_eof!
+  is_utf8_really_inline bool errors() const {
+    return _mm256_test_epi8_mask(this->error, this->error) != 0;
+  }
+
+}; // struct avx512vl_utf8_checker
+
+} // namespace
+} // namespace avx512vl
+} // namespace is_utf8_internals
+
+namespace is_utf8_internals {
+namespace avx512vl {
+
+namespace {
+bool avx512vl_validate_utf8(const char *buf, size_t len) {
+  avx512vl_utf8_checker checker{};
+  size_t idx = checker.check_full_blocks(buf, len);
+  checker.check_tail(buf + idx, len - idx);
+  checker.check_eof();
+  return !checker.errors();
+}
+} // unnamed namespace
+
+is_utf8_warn_unused bool
+implementation::validate_utf8(const char *buf, size_t len) const noexcept {
+  return avx512vl_validate_utf8(buf, len);
+}
+
+implementation::validate_utf8_function
+implementation::get_validate_utf8_function() const noexcept {
+  return &avx512vl_validate_utf8;
+}
+
+is_utf8_warn_unused result implementation::validate_utf8_with_errors(
+    const char *buf, size_t len) const noexcept {
+  if (is_utf8_likely(validate_utf8(buf, len))) {
+    return result(error_code::SUCCESS, len);
+  }
+  avx512vl_utf8_checker checker{};
+  const char *ptr = buf;
+  const char *end = ptr + len;
+  size_t count{0};
+  for (; ptr + 64 <= end; ptr += 64) {
+    checker.check_next_input(ptr);
+    if (checker.errors()) {
+      if (count != 0) {
+        count--;
+      } // Sometimes the error is only detected in the next chunk
+      result res = scalar::utf8::rewind_and_validate_with_errors(
+          buf, buf + count, len - count);
+      res.count += count;
+      return res;
+    }
+    count += 64;
+  }
+  // The whole input is invalid, so the error is in the last block if we get
+  // here.
+  if (count != 0) {
+    count--;
+  }
+  result res = scalar::utf8::rewind_and_validate_with_errors(buf, buf + count,
+                                                             len - count);
+  res.count += count;
+  return res;
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf8_early_exit(const char *buf,
+                                         size_t len) const noexcept {
+  constexpr size_t stride = 64 * IS_UTF8_EARLY_EXIT_BLOCKS;
+  avx512vl_utf8_checker checker{};
+  const char *ptr = buf;
+  const char *end = ptr + len;
+  for (; ptr + stride <= end; ptr += stride) {
+    for (size_t block = 0; block < stride; block += 64) {
+      checker.check_next_input(ptr + block);
+    }
+    if (checker.errors()) {
+      return false;
+    }
+  }
+  for (; ptr + 64 <= end; ptr += 64) {
+    checker.check_next_input(ptr);
+  }
+  checker.check_tail(ptr, size_t(end - ptr));
+  checker.check_eof();
+  return !checker.errors();
+}
+
+void implementation::utf8_stream_init(void *state) const noexcept {
+  static_assert(sizeof(avx512vl_utf8_checker) <=
+                    internal::utf8_stream_state_size,
+                "the checker must fit in the stream state");
+  avx512vl_utf8_checker checker{};
+  std::memcpy(state, static_cast<const void *>(&checker), sizeof(checker));
+}
+
+is_utf8_warn_unused bool
+implementation::utf8_stream_update(void *state, const char *buf,
+                                   size_t len) const noexcept {
+  avx512vl_utf8_checker checker{};
+  std::memcpy(static_cast<void *>(&checker), state, sizeof(checker));
+  const char *ptr = buf;
+  const char *end = ptr + len;
+  for (; ptr + 64 <= end; ptr += 64) {
+    checker.check_next_input(ptr);
+  }
+  std::memcpy(state, static_cast<const void *>(&checker), sizeof(checker));
+  return !checker.errors();
+}
+
+is_utf8_warn_unused bool
+implementation::utf8_stream_finish(void *state, const char *buf,
+                                   size_t len) const noexcept {
+  avx512vl_utf8_checker checker{};
+  std::memcpy(static_cast<void *>(&checker), state, sizeof(checker));
+  if (len != 0) {
+    checker.check_tail(buf, len);
+  }
+  checker.check_eof();
+  return !checker.errors();
+}
+
+namespace {
+// Validates a single block, e.g., short strings packed together.
+is_utf8_really_inline bool validate_utf8_block(const uint8_t *block) {
+  avx512vl_utf8_checker checker{};
+  checker.check_next_input(reinterpret_cast<const char *>(block));
+  checker.check_eof();
+  return !checker.errors();
+}
+} // unnamed namespace
+
+// Strings shorter than 64 bytes are packed several to a block (see
+// pack_short_strings), and only validated one by one if their block is
+// invalid.
+size_t implementation::validate_utf8_batch(const char *const *bufs,
+                                           const size_t *lens, size_t count,
+                                           uint8_t *results) const noexcept {
+  size_t valid_count = 0;
+  size_t i = 0;
+  while (i < count) {
+    if (lens[i] >= 64) {
+      bool valid = implementation::validate_utf8(bufs[i], lens[i]);
+      results[i] = uint8_t(valid);
+      valid_count += valid;
+      i++;
+      continue;
+    }
+    uint8_t block[64];
+    size_t end = internal::pack_short_strings(bufs, lens, i, count, block);
+    if (is_utf8_likely(validate_utf8_block(block))) {
+      valid_count += end - i;
+      for (; i < end; i++) {
+        results[i] = 1;
+      }
+      continue;
+    }
+    for (; i < end; i++) {
+      bool valid = implementation::validate_utf8(bufs[i], lens[i]);
+      results[i] = uint8_t(valid);
+      valid_count += valid;
+    }
   }
+  return valid_count;
+}
 
-  // returns true if ASCII.
-  is_utf8_really_inline bool check_next_input(const __m512i input) {
-    const __m512i v_80 = _mm512_set1_epi8(char(0x80));
-    const __mmask64 ascii = _mm512_test_epi8_mask(input, v_80);
-    if (ascii == 0) {
-      this->error = _mm512_or_si512(this->error, this->prev_incomplete);
-      return true;
+is_utf8_warn_unused size_t implementation::find_first_invalid_utf8(
+    const char *const *bufs, const size_t *lens, size_t count) const noexcept {
+  size_t i = 0;
+  while (i < count) {
+    size_t end = i + 1;
+    if (lens[i] < 64) {
+      uint8_t block[64];
+      end = internal::pack_short_strings(bufs, lens, i, count, block);
+      if (is_utf8_likely(validate_utf8_block(block))) {
+        i = end;
+        continue;
+      }
+    }
+    for (; i < end; i++) {
+      if (!implementation::validate_utf8(bufs[i], lens[i])) {
+        return i;
+      }
+    }
+  }
+  return count;
+}
+
+namespace {
+// Sixteen bytes, known to be ASCII, as sixteen char16_t.
+template <endianness big_endian>
+is_utf8_really_inline void store_ascii_as_utf16(__m128i ascii,
+                                                char16_t *utf16_output) {
+  __m256i utf16 = _mm256_cvtepu8_epi16(ascii);
+  if (big_endian) {
+    utf16 = _mm256_or_si256(_mm256_slli_epi16(utf16, 8),
+                            _mm256_srli_epi16(utf16, 8));
+  }
+  _mm256_storeu_si256((__m256i *)utf16_output, utf16);
+}
+
+// Validates and converts to UTF-16 in a single pass, see
+// generic_convert_utf8_to_utf16_with_errors.
+template <endianness big_endian>
+result avx512vl_convert_utf8_to_utf16_with_errors(const char *buf, size_t len,
+                                                  char16_t *utf16_output) {
+  avx512vl_utf8_checker checker{};
+  char16_t *start = utf16_output;
+  size_t pos = 0; // the bytes before pos have been converted
+  size_t idx = 0; // the bytes before idx have been validated
+  for (; idx + 32 <= len; idx += 32) {
+    const __m256i utf8 = _mm256_loadu_si256((const __m256i *)(buf + idx));
+    bool ascii = checker.check_next_input(utf8);
+    if (checker.errors()) {
+      break;
+    }
+    if (pos == idx && ascii) {
+      store_ascii_as_utf16<big_endian>(_mm256_castsi256_si128(utf8),
+                                       utf16_output);
+      store_ascii_as_utf16<big_endian>(_mm256_extracti128_si256(utf8, 1),
+                                       utf16_output + 16);
+      utf16_output += 32;
+      pos += 32;
     } else {
-      this->check_utf8_bytes(input, this->prev_input_block);
-      this->prev_incomplete = is_incomplete(input);
-      this->prev_input_block = input;
-      return false;
+      pos += scalar::utf8_to_utf16::convert_valid<big_endian>(
+          buf + pos, idx + 32 - pos, utf16_output);
     }
   }
-  // do not forget to call check_eof!
-  is_utf8_really_inline bool errors() const {
-    return _mm512_test_epi8_mask(this->error, this->error) != 0;
+  if (!checker.errors()) {
+    checker.check_tail(buf + idx, len - idx);
+    checker.check_eof();
+    if (is_utf8_likely(!checker.errors())) {
+      scalar::utf8_to_utf16::convert_valid<big_endian>(buf + pos, len - pos,
+                                                       utf16_output);
+      return result(error_code::SUCCESS, size_t(utf16_output - start));
+    }
   }
+  // Locate the error.
+  avx512vl_utf8_checker error_checker{};
+  size_t count{0};
+  for (; count + 64 <= len; count += 64) {
+    error_checker.check_next_input(buf + count);
+    if (error_checker.errors()) {
+      break;
+    }
+  }
+  if (count != 0) {
+    count--;
+  } // Sometimes the error is only detected in the next chunk
+  result res = scalar::utf8::rewind_and_validate_with_errors(buf, buf + count,
+                                                             len - count);
+  res.count += count;
+  return res;
+}
+} // unnamed namespace
 
-}; // struct avx512_utf8_checker
+is_utf8_warn_unused result implementation::convert_utf8_to_utf16le_with_errors(
+    const char *buf, size_t len, char16_t *utf16_output) const noexcept {
+  return avx512vl_convert_utf8_to_utf16_with_errors<endianness::LITTLE>(
+      buf, len, utf16_output);
+}
 
-} // namespace
-} // namespace icelake
-} // namespace is_utf8_internals
+is_utf8_warn_unused result implementation::convert_utf8_to_utf16be_with_errors(
+    const char *buf, size_t len, char16_t *utf16_output) const noexcept {
+  return avx512vl_convert_utf8_to_utf16_with_errors<endianness::BIG>(
+      buf, len, utf16_output);
+}
 
-namespace is_utf8_internals {
-namespace icelake {
+is_utf8_warn_unused size_t implementation::utf16_length_from_utf8(
+    const char *buf, size_t len) const noexcept {
+  const __m256i continuation = _mm256_set1_epi8(char(0b10111111));
+  const __m256i four_bytes = _mm256_set1_epi8(char(0b11101111));
+  size_t pos = 0;
+  size_t count = 0;
+  for (; pos + 32 <= len; pos += 32) {
+    const __m256i utf8 = _mm256_loadu_si256((const __m256i *)(buf + pos));
+    // Leading bytes are above 0b10111111 as signed bytes (ASCII is
+    // positive), four-byte leading bytes above 0b11101111 as unsigned bytes.
+    uint32_t leading = _mm256_cmpgt_epi8_mask(utf8, continuation);
+    uint32_t four_byte_leading = _mm256_cmpgt_epu8_mask(utf8, four_bytes);
+    count += internal::count_ones(leading) +
+             internal::count_ones(four_byte_leading);
+  }
+  return count +
+         scalar::utf8_to_utf16::utf16_length_from_utf8(buf + pos, len - pos);
+}
 
 is_utf8_warn_unused bool
-implementation::validate_utf8(const char *buf, size_t len) const noexcept {
-  avx512_utf8_checker checker{};
-  const char *ptr = buf;
-  const char *end = ptr + len;
-  for (; ptr + 64 <= end; ptr += 64) {
-    const __m512i utf8 = _mm512_loadu_si512((const __m512i *)ptr);
-    checker.check_next_input(utf8);
-  }
-  {
-    const __m512i utf8 = _mm512_maskz_loadu_epi8((1ULL << (end - ptr)) - 1,
-                                                 (const __m512i *)ptr);
-    checker.check_next_input(utf8);
+implementation::validate_utf8_profile(const char *buf, size_t len,
+                                      utf8_profile *profile) const noexcept {
+  const __m256i continuation_end = _mm256_set1_epi8(char(0b11000000));
+  const __m256i latin1_end = _mm256_set1_epi8(char(0xC4));
+  const __m256i four_byte_start = _mm256_set1_epi8(char(0b11110000));
+  avx512vl_utf8_checker checker{};
+  uint32_t above_latin1{0};
+  size_t continuation_bytes{0};
+  size_t four_byte_leading{0};
+  bool is_ascii{true};
+  size_t pos = 0;
+  while (true) {
+    const bool last = pos + 32 > len;
+    // The tail is padded with zeros: they are not counted.
+    const __m256i utf8 =
+        last ? _mm256_maskz_loadu_epi8(__mmask32((uint64_t(1) << (len - pos)) -
+                                                 1),
+                                       (const __m256i *)(buf + pos))
+             : _mm256_loadu_si256((const __m256i *)(buf + pos));
+    if (!checker.check_next_input(utf8)) {
+      is_ascii = false;
+      // U+0100 and above start with 0xC4 or more.
+      above_latin1 |= _mm256_cmpge_epu8_mask(utf8, latin1_end);
+      // Continuation bytes are the signed bytes below 0b11000000.
+      continuation_bytes += internal::count_ones(
+          _mm256_cmplt_epi8_mask(utf8, continuation_end));
+      four_byte_leading += internal::count_ones(
+          _mm256_cmpge_epu8_mask(utf8, four_byte_start));
+    }
+    if (last) {
+      break;
+    }
+    pos += 32;
   }
   checker.check_eof();
-  return !checker.errors();
+  if (checker.errors()) {
+    return false;
+  }
+  profile->is_ascii = is_ascii;
+  profile->is_latin1 = above_latin1 == 0;
+  profile->code_points = len - continuation_bytes;
+  profile->utf16_length = profile->code_points + four_byte_leading;
+  return true;
 }
 
-} // namespace icelake
+namespace {
+// See utf16_checker: with AVX-512VL, the masks have one bit per code unit.
+template <endianness big_endian>
+bool avx512vl_validate_utf16(const char16_t *buf, size_t len) {
+  const __m256i swap =
+      _mm256_setr_epi64x(0x0607040502030001, 0x0e0f0c0d0a0b0809,
+                         0x0607040502030001, 0x0e0f0c0d0a0b0809);
+  const __m256i surrogate_mask = _mm256_set1_epi16(uint16_t(0xF800));
+  const __m256i surrogate = _mm256_set1_epi16(uint16_t(0xD800));
+  const __m256i high_mask = _mm256_set1_epi16(uint16_t(0xFC00));
+  uint32_t error{0};
+  uint32_t prev_high{0};
+  size_t pos = 0;
+  while (true) {
+    const bool last = pos + 16 > len;
+    // The tail is padded with zeros, which are not surrogates.
+    __m256i utf16 =
+        last ? _mm256_maskz_loadu_epi16(__mmask16((1U << (len - pos)) - 1),
+                                        (const __m256i *)(buf + pos))
+             : _mm256_loadu_si256((const __m256i *)(buf + pos));
+    if (big_endian) {
+      utf16 = _mm256_shuffle_epi8(utf16, swap);
+    }
+    uint32_t surrogates = _mm256_cmpeq_epi16_mask(
+        _mm256_and_si256(utf16, surrogate_mask), surrogate);
+    if (is_utf8_unlikely((surrogates | prev_high) != 0)) {
+      uint32_t high = _mm256_cmpeq_epi16_mask(
+          _mm256_and_si256(utf16, high_mask), surrogate);
+      uint32_t low = surrogates & ~high;
+      error |= low ^ (((high << 1) | prev_high) & 0xFFFF);
+      prev_high = high >> 15;
+    }
+    if (last) {
+      break;
+    }
+    pos += 16;
+  }
+  return (error | prev_high) == 0;
+}
+} // unnamed namespace
+
+is_utf8_warn_unused bool
+implementation::validate_utf16le(const char16_t *buf,
+                                 size_t len) const noexcept {
+  return avx512vl_validate_utf16<endianness::LITTLE>(buf, len);
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf16be(const char16_t *buf,
+                                 size_t len) const noexcept {
+  return avx512vl_validate_utf16<endianness::BIG>(buf, len);
+}
+
+// The last block is already read in place, with a masked load.
+is_utf8_warn_unused bool
+implementation::validate_utf8_padded(const char *buf,
+                                     size_t len) const noexcept {
+  return implementation::validate_utf8(buf, len);
+}
+
+} // namespace avx512vl
 } // namespace is_utf8_internals
 
-IS_UTF8_UNTARGET_REGION
+IS_UTF8_UNTARGET_AVX512VL
 
 #if IS_UTF8_GCC11ORMORE // workaround for
                         // https://gcc.gnu.org/bugzilla/show_bug.cgi?id=105593
@@ -5782,76 +9541,521 @@ struct utf8_checker {
     this->error |= this->prev_incomplete;
   }
 
+  // A block known to have non-ASCII bytes.
+  is_utf8_really_inline void
+  check_non_ascii_input(const simd8x64<uint8_t> &input) {
+    // you might think that a for-loop would work, but under Visual Studio, it
+    // is not good enough.
+    static_assert((simd8x64<uint8_t>::NUM_CHUNKS == 2) ||
+                      (simd8x64<uint8_t>::NUM_CHUNKS == 4),
+                  "We support either two or four chunks per 64-byte block.");
+    if (simd8x64<uint8_t>::NUM_CHUNKS == 2) {
+      this->check_utf8_bytes(input.chunks[0], this->prev_input_block);
+      this->check_utf8_bytes(input.chunks[1], input.chunks[0]);
+    } else if (simd8x64<uint8_t>::NUM_CHUNKS == 4) {
+      this->check_utf8_bytes(input.chunks[0], this->prev_input_block);
+      this->check_utf8_bytes(input.chunks[1], input.chunks[0]);
+      this->check_utf8_bytes(input.chunks[2], input.chunks[1]);
+      this->check_utf8_bytes(input.chunks[3], input.chunks[2]);
+    }
+    this->prev_incomplete =
+        is_incomplete(input.chunks[simd8x64<uint8_t>::NUM_CHUNKS - 1]);
+    this->prev_input_block = input.chunks[simd8x64<uint8_t>::NUM_CHUNKS - 1];
+  }
+
   is_utf8_really_inline void check_next_input(const simd8x64<uint8_t> &input) {
     if (is_utf8_likely(is_ascii(input))) {
       this->error |= this->prev_incomplete;
     } else {
-      // you might think that a for-loop would work, but under Visual Studio, it
-      // is not good enough.
-      static_assert((simd8x64<uint8_t>::NUM_CHUNKS == 2) ||
-                        (simd8x64<uint8_t>::NUM_CHUNKS == 4),
-                    "We support either two or four chunks per 64-byte block.");
-      if (simd8x64<uint8_t>::NUM_CHUNKS == 2) {
-        this->check_utf8_bytes(input.chunks[0], this->prev_input_block);
-        this->check_utf8_bytes(input.chunks[1], input.chunks[0]);
-      } else if (simd8x64<uint8_t>::NUM_CHUNKS == 4) {
-        this->check_utf8_bytes(input.chunks[0], this->prev_input_block);
-        this->check_utf8_bytes(input.chunks[1], input.chunks[0]);
-        this->check_utf8_bytes(input.chunks[2], input.chunks[1]);
-        this->check_utf8_bytes(input.chunks[3], input.chunks[2]);
+      this->check_non_ascii_input(input);
+    }
+  }
+
+  // do not forget to call check_eof!
+  is_utf8_really_inline bool errors() const {
+    return this->error.any_bits_set_anywhere();
+  }
+
+}; // struct utf8_checker
+} // namespace utf8_validation
+
+using utf8_validation::utf8_checker;
+
+} // unnamed namespace
+} // namespace haswell
+} // namespace is_utf8_internals
+
+namespace is_utf8_internals {
+namespace haswell {
+namespace {
+namespace utf8_validation {
+
+/**
+ * Checks the whole 64-byte blocks of the input, and returns their length.
+ * After an ASCII block, the next ones are ORed together
+ * IS_UTF8_ASCII_SCAN_LENGTH bytes at a time, and skipped at once as long as
+ * none of these bytes is above 0x7F: the checker only sees the blocks around
+ * non-ASCII characters.
+ */
+template <class checker>
+is_utf8_really_inline size_t check_full_blocks(checker &c,
+                                               const uint8_t *input,
+                                               size_t length) {
+  constexpr size_t scan = IS_UTF8_ASCII_SCAN_LENGTH;
+  static_assert(scan % 64 == 0 && scan >= 64 && scan <= 1024,
+                "IS_UTF8_ASCII_SCAN_LENGTH must be a multiple of 64 between "
+                "64 and 1024");
+  size_t idx = 0;
+  size_t window_end = 0; // the window before it has non-ASCII bytes
+  while (idx + 64 <= length) {
+    simd::simd8x64<uint8_t> in(input + idx);
+    idx += 64;
+    if (!in.is_ascii()) {
+      c.check_non_ascii_input(in);
+      continue;
+    }
+    // However many ASCII blocks, they cannot finish an incomplete character:
+    // the same check as at EOF.
+    c.check_eof();
+    if (scan > 64 && idx >= window_end) {
+      for (; idx + scan <= length; idx += scan) {
+        simd::simd8x64<uint8_t> any(input + idx);
+        for (size_t block = 64; block < scan; block += 64) {
+          any |= simd::simd8x64<uint8_t>(input + idx + block);
+        }
+        if (!any.is_ascii()) {
+          window_end = idx + scan;
+          break;
+        }
+      }
+    }
+  }
+  return idx;
+}
+
+/**
+ * Validates that the string is actual UTF-8.
+ */
+template <class checker>
+bool generic_validate_utf8(const uint8_t *input, size_t length) {
+  if (length < 16) {
+    return scalar::utf8::validate_with_errors(
+               reinterpret_cast<const char *>(input), length)
+               .error == error_code::SUCCESS;
+  }
+  checker c{};
+  size_t idx = check_full_blocks(c, input, length);
+  if (idx < length) {
+    // The remainder is loaded in place, without copying it to a padded block.
+    simd::simd8x64<uint8_t> in(input + idx, length - idx);
+    c.check_next_input(in);
+  }
+  c.check_eof();
+  return !c.errors();
+}
+
+bool generic_validate_utf8(const char *input, size_t length) {
+  return generic_validate_utf8<utf8_checker>(
+      reinterpret_cast<const uint8_t *>(input), length);
+}
+
+/**
+ * Validates that the string is actual UTF-8, reading up to 64 bytes past its
+ * end: the last block is loaded in place, the bytes past the end cleared.
+ */
+template <class checker>
+bool generic_validate_utf8_padded(const uint8_t *input, size_t length) {
+  checker c{};
+  size_t idx = check_full_blocks(c, input, length);
+  if (idx < length) {
+    simd::simd8x64<uint8_t> in(input + idx, length - idx,
+                               simd::padded_input{});
+    c.check_next_input(in);
+  }
+  c.check_eof();
+  return !c.errors();
+}
+
+/**
+ * Validates that the string is actual UTF-8, checking for errors every
+ * IS_UTF8_EARLY_EXIT_BLOCKS blocks: the inner loop is the same as in
+ * generic_validate_utf8.
+ */
+template <class checker>
+bool generic_validate_utf8_early_exit(const uint8_t *input, size_t length) {
+  constexpr size_t stride = 64 * IS_UTF8_EARLY_EXIT_BLOCKS;
+  checker c{};
+  size_t idx = 0;
+  for (; idx + stride <= length; idx += stride) {
+    for (size_t block = 0; block < stride; block += 64) {
+      simd::simd8x64<uint8_t> in(input + idx + block);
+      c.check_next_input(in);
+    }
+    if (c.errors()) {
+      return false;
+    }
+  }
+  if (length < 16) {
+    return scalar::utf8::validate_with_errors(
+               reinterpret_cast<const char *>(input), length)
+               .error == error_code::SUCCESS;
+  }
+  for (; idx + 64 <= length; idx += 64) {
+    simd::simd8x64<uint8_t> in(input + idx);
+    c.check_next_input(in);
+  }
+  if (idx < length) {
+    simd::simd8x64<uint8_t> in(input + idx, length - idx);
+    c.check_next_input(in);
+  }
+  c.check_eof();
+  return !c.errors();
+}
+
+/**
+ * Validates that the string is actual UTF-8 and stops on errors.
+ */
+template <class checker>
+result generic_validate_utf8_with_errors(const uint8_t *input, size_t length) {
+  checker c{};
+  buf_block_reader<64> reader(input, length);
+  size_t count{0};
+  while (reader.has_full_block()) {
+    simd::simd8x64<uint8_t> in(reader.full_block());
+    c.check_next_input(in);
+    if (c.errors()) {
+      if (count != 0) {
+        count--;
+      } // Sometimes the error is only detected in the next chunk
+      result res = scalar::utf8::rewind_and_validate_with_errors(
+          reinterpret_cast<const char *>(input),
+          reinterpret_cast<const char *>(input + count), length - count);
+      res.count += count;
+      return res;
+    }
+    reader.advance();
+    count += 64;
+  }
+  uint8_t block[64]{};
+  reader.get_remainder(block);
+  simd::simd8x64<uint8_t> in(block);
+  c.check_next_input(in);
+  reader.advance();
+  c.check_eof();
+  if (c.errors()) {
+    if (count != 0) {
+      count--;
+    } // Sometimes the error is only detected in the next chunk
+    result res = scalar::utf8::rewind_and_validate_with_errors(
+        reinterpret_cast<const char *>(input),
+        reinterpret_cast<const char *>(input) + count, length - count);
+    res.count += count;
+    return res;
+  } else {
+    return result(error_code::SUCCESS, length);
+  }
+}
+
+result generic_validate_utf8_with_errors(const char *input, size_t length) {
+  return generic_validate_utf8_with_errors<utf8_checker>(
+      reinterpret_cast<const uint8_t *>(input), length);
+}
+
+/**
+ * Streaming validation: the checker is kept in caller-provided storage between
+ * calls, so that characters may straddle the blocks of successive calls.
+ */
+template <class checker> void generic_utf8_stream_init(void *state) {
+  static_assert(sizeof(checker) <= internal::utf8_stream_state_size,
+                "the checker must fit in the stream state");
+  checker c{};
+  std::memcpy(state, static_cast<const void *>(&c), sizeof(c));
+}
+
+template <class checker>
+bool generic_utf8_stream_update(void *state, const uint8_t *input,
+                                size_t length) {
+  checker c{};
+  std::memcpy(static_cast<void *>(&c), state, sizeof(c));
+  for (size_t idx = 0; idx < length; idx += 64) {
+    simd::simd8x64<uint8_t> in(input + idx);
+    c.check_next_input(in);
+  }
+  std::memcpy(state, static_cast<const void *>(&c), sizeof(c));
+  return !c.errors();
+}
+
+template <class checker>
+bool generic_utf8_stream_finish(void *state, const uint8_t *input,
+                                size_t length) {
+  checker c{};
+  std::memcpy(static_cast<void *>(&c), state, sizeof(c));
+  if (length != 0) {
+    uint8_t block[64];
+    std::memset(block, 0x20, 64);
+    std::memcpy(block, input, length);
+    simd::simd8x64<uint8_t> in(block);
+    c.check_next_input(in);
+  }
+  c.check_eof();
+  return !c.errors();
+}
+
+/**
+ * Validates a single block, e.g., short strings packed together.
+ */
+template <class checker>
+is_utf8_really_inline bool generic_validate_utf8_block(const uint8_t *block) {
+  checker c{};
+  simd::simd8x64<uint8_t> in(block);
+  c.check_next_input(in);
+  c.check_eof();
+  return !c.errors();
+}
+
+/**
+ * Validates many strings: one dispatch for the whole batch. Strings shorter
+ * than 64 bytes are packed several to a block (see pack_short_strings), and
+ * only validated one by one if their block is invalid.
+ */
+template <class checker>
+size_t generic_validate_utf8_batch(const char *const *bufs, const size_t *lens,
+                                   size_t count, uint8_t *results) {
+  size_t valid_count = 0;
+  size_t i = 0;
+  while (i < count) {
+    if (lens[i] >= 64) {
+      bool valid = generic_validate_utf8<checker>(
+          reinterpret_cast<const uint8_t *>(bufs[i]), lens[i]);
+      results[i] = uint8_t(valid);
+      valid_count += valid;
+      i++;
+      continue;
+    }
+    uint8_t block[64];
+    size_t end = internal::pack_short_strings(bufs, lens, i, count, block);
+    if (is_utf8_likely(generic_validate_utf8_block<checker>(block))) {
+      valid_count += end - i;
+      for (; i < end; i++) {
+        results[i] = 1;
+      }
+      continue;
+    }
+    for (; i < end; i++) {
+      bool valid = generic_validate_utf8<checker>(
+          reinterpret_cast<const uint8_t *>(bufs[i]), lens[i]);
+      results[i] = uint8_t(valid);
+      valid_count += valid;
+    }
+  }
+  return valid_count;
+}
+
+template <class checker>
+size_t generic_find_first_invalid_utf8(const char *const *bufs,
+                                       const size_t *lens, size_t count) {
+  size_t i = 0;
+  while (i < count) {
+    size_t end = i + 1;
+    if (lens[i] < 64) {
+      uint8_t block[64];
+      end = internal::pack_short_strings(bufs, lens, i, count, block);
+      if (is_utf8_likely(generic_validate_utf8_block<checker>(block))) {
+        i = end;
+        continue;
+      }
+    }
+    for (; i < end; i++) {
+      if (!generic_validate_utf8<checker>(
+              reinterpret_cast<const uint8_t *>(bufs[i]), lens[i])) {
+        return i;
       }
-      this->prev_incomplete =
-          is_incomplete(input.chunks[simd8x64<uint8_t>::NUM_CHUNKS - 1]);
-      this->prev_input_block = input.chunks[simd8x64<uint8_t>::NUM_CHUNKS - 1];
     }
   }
+  return count;
+}
 
-  // do not forget to call check_eof!
-  is_utf8_really_inline bool errors() const {
-    return this->error.any_bits_set_anywhere();
+/**
+ * Validates and converts to UTF-16 in a single pass: each block goes through
+ * the checker, then the characters it completes are converted while the block
+ * is still in cache (ASCII blocks are widened with SIMD instructions). A
+ * character that straddles two blocks is converted after the second one.
+ * Errors are only located, with a second pass, when the checker reports one.
+ */
+template <endianness big_endian, class checker>
+result generic_convert_utf8_to_utf16_with_errors(const char *input,
+                                                 size_t length,
+                                                 char16_t *utf16_output) {
+  checker c{};
+  char16_t *start = utf16_output;
+  size_t pos = 0; // the bytes before pos have been converted
+  size_t idx = 0; // the bytes before idx have been validated
+  for (; idx + 64 <= length; idx += 64) {
+    simd::simd8x64<uint8_t> in(reinterpret_cast<const uint8_t *>(input + idx));
+    c.check_next_input(in);
+    if (c.errors()) {
+      break;
+    }
+    if (pos == idx && in.is_ascii()) {
+      simd::simd8x64<int8_t> ascii(
+          reinterpret_cast<const int8_t *>(input + idx));
+      ascii.template store_ascii_as_utf16<big_endian>(utf16_output);
+      utf16_output += 64;
+      pos += 64;
+    } else {
+      pos += scalar::utf8_to_utf16::convert_valid<big_endian>(
+          input + pos, idx + 64 - pos, utf16_output);
+    }
   }
+  if (!c.errors()) {
+    if (idx < length) {
+      uint8_t block[64];
+      std::memset(block, 0x20, 64);
+      std::memcpy(block, input + idx, length - idx);
+      simd::simd8x64<uint8_t> in(block);
+      c.check_next_input(in);
+    }
+    c.check_eof();
+    if (is_utf8_likely(!c.errors())) {
+      scalar::utf8_to_utf16::convert_valid<big_endian>(
+          input + pos, length - pos, utf16_output);
+      return result(error_code::SUCCESS, size_t(utf16_output - start));
+    }
+  }
+  return generic_validate_utf8_with_errors<checker>(
+      reinterpret_cast<const uint8_t *>(input), length);
+}
 
-}; // struct utf8_checker
-} // namespace utf8_validation
-
-using utf8_validation::utf8_checker;
-
-} // unnamed namespace
-} // namespace haswell
-} // namespace is_utf8_internals
+is_utf8_really_inline size_t utf16_length_from_utf8(const char *in,
+                                                    size_t size) {
+  size_t pos = 0;
+  size_t count = 0;
+  for (; pos + 64 <= size; pos += 64) {
+    simd::simd8x64<int8_t> input(reinterpret_cast<const int8_t *>(in + pos));
+    uint64_t utf8_continuation_mask = input.lt(-65 + 1);
+    uint64_t utf8_4byte = input.gteq_unsigned(240);
+    count += 64 - internal::count_ones(utf8_continuation_mask) +
+             internal::count_ones(utf8_4byte);
+  }
+  return count +
+         scalar::utf8_to_utf16::utf16_length_from_utf8(in + pos, size - pos);
+}
 
-namespace is_utf8_internals {
-namespace haswell {
-namespace {
-namespace utf8_validation {
+/**
+ * Counts what is needed for the profile of a string. Only the non-ASCII blocks
+ * (already told apart by the checker) have bytes to count.
+ */
+struct utf8_profile_counters {
+  uint64_t above_latin1{0};
+  size_t continuation_bytes{0};
+  size_t four_byte_leading{0};
+  bool is_ascii{true};
+
+  is_utf8_really_inline void add(const simd::simd8x64<uint8_t> &in) {
+    if (in.is_ascii()) {
+      return;
+    }
+    is_ascii = false;
+    // U+0100 and above start with 0xC4 or more.
+    above_latin1 |= in.gteq_unsigned(0xC4);
+    continuation_bytes += internal::count_ones(in.in_range(0x80, 0xBF));
+    four_byte_leading += internal::count_ones(in.gteq_unsigned(0xF0));
+  }
+};
 
 /**
- * Validates that the string is actual UTF-8.
+ * Validates the string and, in the same loop, computes its profile.
  */
 template <class checker>
-bool generic_validate_utf8(const uint8_t *input, size_t length) {
+bool generic_validate_utf8_profile(const uint8_t *input, size_t length,
+                                   utf8_profile *profile) {
   checker c{};
+  utf8_profile_counters counters;
   buf_block_reader<64> reader(input, length);
   while (reader.has_full_block()) {
     simd::simd8x64<uint8_t> in(reader.full_block());
     c.check_next_input(in);
+    counters.add(in);
     reader.advance();
   }
+  // The padding is made of spaces: they are not counted.
   uint8_t block[64]{};
   reader.get_remainder(block);
   simd::simd8x64<uint8_t> in(block);
   c.check_next_input(in);
+  counters.add(in);
   reader.advance();
   c.check_eof();
-  return !c.errors();
+  if (c.errors()) {
+    return false;
+  }
+  profile->is_ascii = counters.is_ascii;
+  profile->is_latin1 = counters.above_latin1 == 0;
+  profile->code_points = length - counters.continuation_bytes;
+  profile->utf16_length = profile->code_points + counters.four_byte_leading;
+  return true;
 }
 
-bool generic_validate_utf8(const char *input, size_t length) {
-  return generic_validate_utf8<utf8_checker>(
-      reinterpret_cast<const uint8_t *>(input), length);
+} // namespace utf8_validation
+
+namespace utf16_validation {
+
+/**
+ * The only constraint on UTF-16 is that surrogates come in pairs: a high
+ * surrogate (D800...DBFF) must be immediately followed by a low surrogate
+ * (DC00...DFFF), and each low surrogate must follow a high surrogate. In other
+ * words, the high surrogates moved forward by one code unit must be exactly
+ * the low surrogates. The bitmasks have two bits per code unit, and the high
+ * surrogate ending a block is carried into the next block.
+ */
+struct utf16_checker {
+  uint64_t error{0};
+  uint64_t prev_high{0};
+
+  is_utf8_really_inline void
+  check_next_input(const simd::simd16x32<uint16_t> &in) {
+    uint64_t surrogates = in.in_range(0xD800, 0xDFFF);
+    if (is_utf8_likely((surrogates | prev_high) == 0)) {
+      return;
+    }
+    uint64_t high = in.in_range(0xD800, 0xDBFF);
+    uint64_t low = surrogates & ~high;
+    this->error |= low ^ ((high << 2) | prev_high);
+    this->prev_high = high >> 62;
+  }
+
+  // A high surrogate must not end the input.
+  is_utf8_really_inline void check_eof() { this->error |= this->prev_high; }
+
+  is_utf8_really_inline bool errors() const { return this->error != 0; }
+};
+
+template <endianness big_endian>
+bool generic_validate_utf16(const char16_t *input, size_t length) {
+  utf16_checker c{};
+  size_t pos = 0;
+  for (; pos + 32 <= length; pos += 32) {
+    simd::simd16x32<uint16_t> in(reinterpret_cast<const uint16_t *>(input + pos));
+    if (big_endian) {
+      in.swap_bytes();
+    }
+    c.check_next_input(in);
+  }
+  if (pos < length) {
+    // Zeros are not surrogates.
+    uint16_t block[32]{};
+    std::memcpy(block, input + pos, (length - pos) * sizeof(char16_t));
+    simd::simd16x32<uint16_t> in(block);
+    if (big_endian) {
+      in.swap_bytes();
+    }
+    c.check_next_input(in);
+  }
+  c.check_eof();
+  return !c.errors();
 }
 
-} // namespace utf8_validation
+} // namespace utf16_validation
 } // unnamed namespace
 } // namespace haswell
 } // namespace is_utf8_internals
@@ -5859,9 +10063,176 @@ bool generic_validate_utf8(const char *input, size_t length) {
 namespace is_utf8_internals {
 namespace haswell {
 
+namespace {
+// Two checkers on the two halves of the input, 128 bytes of each per
+// iteration: the lookups of one half overlap those of the other. The second
+// checker starts as if it had just seen the last 32 bytes of the first half,
+// so that it checks the characters across the junction, and the first half
+// needs no end-of-input check.
+bool validate_utf8_dual_stream(const char *buf, size_t len) {
+  using utf8_validation::utf8_checker;
+  const uint8_t *input = reinterpret_cast<const uint8_t *>(buf);
+  const size_t half = len / 2 / 128 * 128;
+  const uint8_t *first_half = input;
+  const uint8_t *second_half = input + half;
+  utf8_checker first{};
+  utf8_checker second{};
+  second.prev_input_block = simd::simd8<uint8_t>(second_half - 32);
+  second.prev_incomplete =
+      utf8_validation::is_incomplete(second.prev_input_block);
+  for (size_t idx = 0; idx < half; idx += 128) {
+    _mm_prefetch(reinterpret_cast<const char *>(first_half + idx +
+                                                IS_UTF8_PREFETCH_DISTANCE),
+                 _MM_HINT_T0);
+    _mm_prefetch(reinterpret_cast<const char *>(second_half + idx +
+                                                IS_UTF8_PREFETCH_DISTANCE),
+                 _MM_HINT_T0);
+    first.check_next_input(simd::simd8x64<uint8_t>(first_half + idx));
+    second.check_next_input(simd::simd8x64<uint8_t>(second_half + idx));
+    first.check_next_input(simd::simd8x64<uint8_t>(first_half + idx + 64));
+    second.check_next_input(simd::simd8x64<uint8_t>(second_half + idx + 64));
+  }
+  // The second half is longer by fewer than 256 bytes.
+  const uint8_t *end = input + len;
+  const uint8_t *ptr = second_half + half;
+  for (; ptr + 64 <= end; ptr += 64) {
+    second.check_next_input(simd::simd8x64<uint8_t>(ptr));
+  }
+  if (ptr < end) {
+    second.check_next_input(simd::simd8x64<uint8_t>(ptr, size_t(end - ptr)));
+  }
+  second.check_eof();
+  return !first.errors() && !second.errors();
+}
+
+// Whether validate_utf8_dual_stream validates inputs of len bytes.
+is_utf8_really_inline bool use_dual_stream(size_t len) {
+#if IS_UTF8_DUAL_STREAM_LENGTH > 0
+  return len >= IS_UTF8_DUAL_STREAM_LENGTH && len >= 256;
+#else
+  (void)len;
+  return false;
+#endif
+}
+
+bool haswell_validate_utf8(const char *buf, size_t len) {
+  if (use_dual_stream(len)) {
+    return validate_utf8_dual_stream(buf, len);
+  }
+  return utf8_validation::generic_validate_utf8(buf, len);
+}
+} // unnamed namespace
+
 is_utf8_warn_unused bool
 implementation::validate_utf8(const char *buf, size_t len) const noexcept {
-  return haswell::utf8_validation::generic_validate_utf8(buf, len);
+  return haswell_validate_utf8(buf, len);
+}
+
+implementation::validate_utf8_function
+implementation::get_validate_utf8_function() const noexcept {
+  return &haswell_validate_utf8;
+}
+
+is_utf8_warn_unused result implementation::validate_utf8_with_errors(
+    const char *buf, size_t len) const noexcept {
+  if (is_utf8_likely(haswell_validate_utf8(buf, len))) {
+    return result(error_code::SUCCESS, len);
+  }
+  return haswell::utf8_validation::generic_validate_utf8_with_errors(buf, len);
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf8_early_exit(const char *buf,
+                                         size_t len) const noexcept {
+  return haswell::utf8_validation::generic_validate_utf8_early_exit<
+      haswell::utf8_validation::utf8_checker>(
+      reinterpret_cast<const uint8_t *>(buf), len);
+}
+
+void implementation::utf8_stream_init(void *state) const noexcept {
+  haswell::utf8_validation::generic_utf8_stream_init<
+      haswell::utf8_validation::utf8_checker>(state);
+}
+
+is_utf8_warn_unused bool
+implementation::utf8_stream_update(void *state, const char *buf,
+                                   size_t len) const noexcept {
+  return haswell::utf8_validation::generic_utf8_stream_update<
+      haswell::utf8_validation::utf8_checker>(
+      state, reinterpret_cast<const uint8_t *>(buf), len);
+}
+
+is_utf8_warn_unused bool
+implementation::utf8_stream_finish(void *state, const char *buf,
+                                   size_t len) const noexcept {
+  return haswell::utf8_validation::generic_utf8_stream_finish<
+      haswell::utf8_validation::utf8_checker>(
+      state, reinterpret_cast<const uint8_t *>(buf), len);
+}
+
+size_t implementation::validate_utf8_batch(const char *const *bufs,
+                                           const size_t *lens, size_t count,
+                                           uint8_t *results) const noexcept {
+  return haswell::utf8_validation::generic_validate_utf8_batch<
+      haswell::utf8_validation::utf8_checker>(bufs, lens, count, results);
+}
+
+is_utf8_warn_unused size_t implementation::find_first_invalid_utf8(
+    const char *const *bufs, const size_t *lens, size_t count) const noexcept {
+  return haswell::utf8_validation::generic_find_first_invalid_utf8<
+      haswell::utf8_validation::utf8_checker>(bufs, lens, count);
+}
+
+is_utf8_warn_unused result implementation::convert_utf8_to_utf16le_with_errors(
+    const char *buf, size_t len, char16_t *utf16_output) const noexcept {
+  return haswell::utf8_validation::generic_convert_utf8_to_utf16_with_errors<
+      endianness::LITTLE, haswell::utf8_validation::utf8_checker>(buf, len,
+                                                                utf16_output);
+}
+
+is_utf8_warn_unused result implementation::convert_utf8_to_utf16be_with_errors(
+    const char *buf, size_t len, char16_t *utf16_output) const noexcept {
+  return haswell::utf8_validation::generic_convert_utf8_to_utf16_with_errors<
+      endianness::BIG, haswell::utf8_validation::utf8_checker>(buf, len,
+                                                             utf16_output);
+}
+
+is_utf8_warn_unused size_t implementation::utf16_length_from_utf8(
+    const char *buf, size_t len) const noexcept {
+  return haswell::utf8_validation::utf16_length_from_utf8(buf, len);
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf8_profile(const char *buf, size_t len,
+                                      utf8_profile *profile) const noexcept {
+  return haswell::utf8_validation::generic_validate_utf8_profile<
+      haswell::utf8_validation::utf8_checker>(
+      reinterpret_cast<const uint8_t *>(buf), len, profile);
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf16le(const char16_t *buf,
+                                 size_t len) const noexcept {
+  return haswell::utf16_validation::generic_validate_utf16<endianness::LITTLE>(
+      buf, len);
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf16be(const char16_t *buf,
+                                 size_t len) const noexcept {
+  return haswell::utf16_validation::generic_validate_utf16<endianness::BIG>(buf,
+                                                                        len);
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf8_padded(const char *buf,
+                                     size_t len) const noexcept {
+  if (use_dual_stream(len)) {
+    return validate_utf8_dual_stream(buf, len);
+  }
+  return haswell::utf8_validation::generic_validate_utf8_padded<
+      haswell::utf8_validation::utf8_checker>(
+      reinterpret_cast<const uint8_t *>(buf), len);
 }
 
 } // namespace haswell
@@ -6623,107 +10994,552 @@ is_utf8_really_inline simd8<uint8_t> is_incomplete(const simd8<uint8_t> input) {
   return input.gt_bits(max_value);
 }
 
-struct utf8_checker {
-  // If this is nonzero, there has been a UTF-8 error.
-  simd8<uint8_t> error;
-  // The last input we received
-  simd8<uint8_t> prev_input_block;
-  // Whether the last input we received was incomplete (used for ASCII fast
-  // path)
-  simd8<uint8_t> prev_incomplete;
+struct utf8_checker {
+  // If this is nonzero, there has been a UTF-8 error.
+  simd8<uint8_t> error;
+  // The last input we received
+  simd8<uint8_t> prev_input_block;
+  // Whether the last input we received was incomplete (used for ASCII fast
+  // path)
+  simd8<uint8_t> prev_incomplete;
+
+  //
+  // Check whether the current bytes are valid UTF-8.
+  //
+  is_utf8_really_inline void check_utf8_bytes(const simd8<uint8_t> input,
+                                              const simd8<uint8_t> prev_input) {
+    // Flip prev1...prev3 so we can easily determine if they are 2+, 3+ or 4+
+    // lead bytes (2, 3, 4-byte leads become large positive numbers instead of
+    // small negative numbers)
+    simd8<uint8_t> prev1 = input.prev<1>(prev_input);
+    simd8<uint8_t> sc = check_special_cases(input, prev1);
+    this->error |= check_multibyte_lengths(input, prev_input, sc);
+  }
+
+  // The only problem that can happen at EOF is that a multibyte character is
+  // too short or a byte value too large in the last bytes: check_special_cases
+  // only checks for bytes too large in the first of two bytes.
+  is_utf8_really_inline void check_eof() {
+    // If the previous block had incomplete UTF-8 characters at the end, an
+    // ASCII block can't possibly finish them.
+    this->error |= this->prev_incomplete;
+  }
+
+  // A block known to have non-ASCII bytes.
+  is_utf8_really_inline void
+  check_non_ascii_input(const simd8x64<uint8_t> &input) {
+    // you might think that a for-loop would work, but under Visual Studio, it
+    // is not good enough.
+    static_assert((simd8x64<uint8_t>::NUM_CHUNKS == 2) ||
+                      (simd8x64<uint8_t>::NUM_CHUNKS == 4),
+                  "We support either two or four chunks per 64-byte block.");
+    if (simd8x64<uint8_t>::NUM_CHUNKS == 2) {
+      this->check_utf8_bytes(input.chunks[0], this->prev_input_block);
+      this->check_utf8_bytes(input.chunks[1], input.chunks[0]);
+    } else if (simd8x64<uint8_t>::NUM_CHUNKS == 4) {
+      this->check_utf8_bytes(input.chunks[0], this->prev_input_block);
+      this->check_utf8_bytes(input.chunks[1], input.chunks[0]);
+      this->check_utf8_bytes(input.chunks[2], input.chunks[1]);
+      this->check_utf8_bytes(input.chunks[3], input.chunks[2]);
+    }
+    this->prev_incomplete =
+        is_incomplete(input.chunks[simd8x64<uint8_t>::NUM_CHUNKS - 1]);
+    this->prev_input_block = input.chunks[simd8x64<uint8_t>::NUM_CHUNKS - 1];
+  }
+
+  is_utf8_really_inline void check_next_input(const simd8x64<uint8_t> &input) {
+    if (is_utf8_likely(is_ascii(input))) {
+      this->error |= this->prev_incomplete;
+    } else {
+      this->check_non_ascii_input(input);
+    }
+  }
+
+  // do not forget to call check_eof!
+  is_utf8_really_inline bool errors() const {
+    return this->error.any_bits_set_anywhere();
+  }
+
+}; // struct utf8_checker
+} // namespace utf8_validation
+
+using utf8_validation::utf8_checker;
+
+} // unnamed namespace
+} // namespace westmere
+} // namespace is_utf8_internals
+
+namespace is_utf8_internals {
+namespace westmere {
+namespace {
+namespace utf8_validation {
+
+/**
+ * Checks the whole 64-byte blocks of the input, and returns their length.
+ * After an ASCII block, the next ones are ORed together
+ * IS_UTF8_ASCII_SCAN_LENGTH bytes at a time, and skipped at once as long as
+ * none of these bytes is above 0x7F: the checker only sees the blocks around
+ * non-ASCII characters.
+ */
+template <class checker>
+is_utf8_really_inline size_t check_full_blocks(checker &c,
+                                               const uint8_t *input,
+                                               size_t length) {
+  constexpr size_t scan = IS_UTF8_ASCII_SCAN_LENGTH;
+  static_assert(scan % 64 == 0 && scan >= 64 && scan <= 1024,
+                "IS_UTF8_ASCII_SCAN_LENGTH must be a multiple of 64 between "
+                "64 and 1024");
+  size_t idx = 0;
+  size_t window_end = 0; // the window before it has non-ASCII bytes
+  while (idx + 64 <= length) {
+    simd::simd8x64<uint8_t> in(input + idx);
+    idx += 64;
+    if (!in.is_ascii()) {
+      c.check_non_ascii_input(in);
+      continue;
+    }
+    // However many ASCII blocks, they cannot finish an incomplete character:
+    // the same check as at EOF.
+    c.check_eof();
+    if (scan > 64 && idx >= window_end) {
+      for (; idx + scan <= length; idx += scan) {
+        simd::simd8x64<uint8_t> any(input + idx);
+        for (size_t block = 64; block < scan; block += 64) {
+          any |= simd::simd8x64<uint8_t>(input + idx + block);
+        }
+        if (!any.is_ascii()) {
+          window_end = idx + scan;
+          break;
+        }
+      }
+    }
+  }
+  return idx;
+}
+
+/**
+ * Validates that the string is actual UTF-8.
+ */
+template <class checker>
+bool generic_validate_utf8(const uint8_t *input, size_t length) {
+  if (length < 16) {
+    return scalar::utf8::validate_with_errors(
+               reinterpret_cast<const char *>(input), length)
+               .error == error_code::SUCCESS;
+  }
+  checker c{};
+  size_t idx = check_full_blocks(c, input, length);
+  if (idx < length) {
+    // The remainder is loaded in place, without copying it to a padded block.
+    simd::simd8x64<uint8_t> in(input + idx, length - idx);
+    c.check_next_input(in);
+  }
+  c.check_eof();
+  return !c.errors();
+}
+
+bool generic_validate_utf8(const char *input, size_t length) {
+  return generic_validate_utf8<utf8_checker>(
+      reinterpret_cast<const uint8_t *>(input), length);
+}
+
+/**
+ * Validates that the string is actual UTF-8, reading up to 64 bytes past its
+ * end: the last block is loaded in place, the bytes past the end cleared.
+ */
+template <class checker>
+bool generic_validate_utf8_padded(const uint8_t *input, size_t length) {
+  checker c{};
+  size_t idx = check_full_blocks(c, input, length);
+  if (idx < length) {
+    simd::simd8x64<uint8_t> in(input + idx, length - idx,
+                               simd::padded_input{});
+    c.check_next_input(in);
+  }
+  c.check_eof();
+  return !c.errors();
+}
+
+/**
+ * Validates that the string is actual UTF-8, checking for errors every
+ * IS_UTF8_EARLY_EXIT_BLOCKS blocks: the inner loop is the same as in
+ * generic_validate_utf8.
+ */
+template <class checker>
+bool generic_validate_utf8_early_exit(const uint8_t *input, size_t length) {
+  constexpr size_t stride = 64 * IS_UTF8_EARLY_EXIT_BLOCKS;
+  checker c{};
+  size_t idx = 0;
+  for (; idx + stride <= length; idx += stride) {
+    for (size_t block = 0; block < stride; block += 64) {
+      simd::simd8x64<uint8_t> in(input + idx + block);
+      c.check_next_input(in);
+    }
+    if (c.errors()) {
+      return false;
+    }
+  }
+  if (length < 16) {
+    return scalar::utf8::validate_with_errors(
+               reinterpret_cast<const char *>(input), length)
+               .error == error_code::SUCCESS;
+  }
+  for (; idx + 64 <= length; idx += 64) {
+    simd::simd8x64<uint8_t> in(input + idx);
+    c.check_next_input(in);
+  }
+  if (idx < length) {
+    simd::simd8x64<uint8_t> in(input + idx, length - idx);
+    c.check_next_input(in);
+  }
+  c.check_eof();
+  return !c.errors();
+}
+
+/**
+ * Validates that the string is actual UTF-8 and stops on errors.
+ */
+template <class checker>
+result generic_validate_utf8_with_errors(const uint8_t *input, size_t length) {
+  checker c{};
+  buf_block_reader<64> reader(input, length);
+  size_t count{0};
+  while (reader.has_full_block()) {
+    simd::simd8x64<uint8_t> in(reader.full_block());
+    c.check_next_input(in);
+    if (c.errors()) {
+      if (count != 0) {
+        count--;
+      } // Sometimes the error is only detected in the next chunk
+      result res = scalar::utf8::rewind_and_validate_with_errors(
+          reinterpret_cast<const char *>(input),
+          reinterpret_cast<const char *>(input + count), length - count);
+      res.count += count;
+      return res;
+    }
+    reader.advance();
+    count += 64;
+  }
+  uint8_t block[64]{};
+  reader.get_remainder(block);
+  simd::simd8x64<uint8_t> in(block);
+  c.check_next_input(in);
+  reader.advance();
+  c.check_eof();
+  if (c.errors()) {
+    if (count != 0) {
+      count--;
+    } // Sometimes the error is only detected in the next chunk
+    result res = scalar::utf8::rewind_and_validate_with_errors(
+        reinterpret_cast<const char *>(input),
+        reinterpret_cast<const char *>(input) + count, length - count);
+    res.count += count;
+    return res;
+  } else {
+    return result(error_code::SUCCESS, length);
+  }
+}
+
+result generic_validate_utf8_with_errors(const char *input, size_t length) {
+  return generic_validate_utf8_with_errors<utf8_checker>(
+      reinterpret_cast<const uint8_t *>(input), length);
+}
 
-  //
-  // Check whether the current bytes are valid UTF-8.
-  //
-  is_utf8_really_inline void check_utf8_bytes(const simd8<uint8_t> input,
-                                              const simd8<uint8_t> prev_input) {
-    // Flip prev1...prev3 so we can easily determine if they are 2+, 3+ or 4+
-    // lead bytes (2, 3, 4-byte leads become large positive numbers instead of
-    // small negative numbers)
-    simd8<uint8_t> prev1 = input.prev<1>(prev_input);
-    simd8<uint8_t> sc = check_special_cases(input, prev1);
-    this->error |= check_multibyte_lengths(input, prev_input, sc);
+/**
+ * Streaming validation: the checker is kept in caller-provided storage between
+ * calls, so that characters may straddle the blocks of successive calls.
+ */
+template <class checker> void generic_utf8_stream_init(void *state) {
+  static_assert(sizeof(checker) <= internal::utf8_stream_state_size,
+                "the checker must fit in the stream state");
+  checker c{};
+  std::memcpy(state, static_cast<const void *>(&c), sizeof(c));
+}
+
+template <class checker>
+bool generic_utf8_stream_update(void *state, const uint8_t *input,
+                                size_t length) {
+  checker c{};
+  std::memcpy(static_cast<void *>(&c), state, sizeof(c));
+  for (size_t idx = 0; idx < length; idx += 64) {
+    simd::simd8x64<uint8_t> in(input + idx);
+    c.check_next_input(in);
   }
+  std::memcpy(state, static_cast<const void *>(&c), sizeof(c));
+  return !c.errors();
+}
 
-  // The only problem that can happen at EOF is that a multibyte character is
-  // too short or a byte value too large in the last bytes: check_special_cases
-  // only checks for bytes too large in the first of two bytes.
-  is_utf8_really_inline void check_eof() {
-    // If the previous block had incomplete UTF-8 characters at the end, an
-    // ASCII block can't possibly finish them.
-    this->error |= this->prev_incomplete;
+template <class checker>
+bool generic_utf8_stream_finish(void *state, const uint8_t *input,
+                                size_t length) {
+  checker c{};
+  std::memcpy(static_cast<void *>(&c), state, sizeof(c));
+  if (length != 0) {
+    uint8_t block[64];
+    std::memset(block, 0x20, 64);
+    std::memcpy(block, input, length);
+    simd::simd8x64<uint8_t> in(block);
+    c.check_next_input(in);
   }
+  c.check_eof();
+  return !c.errors();
+}
 
-  is_utf8_really_inline void check_next_input(const simd8x64<uint8_t> &input) {
-    if (is_utf8_likely(is_ascii(input))) {
-      this->error |= this->prev_incomplete;
-    } else {
-      // you might think that a for-loop would work, but under Visual Studio, it
-      // is not good enough.
-      static_assert((simd8x64<uint8_t>::NUM_CHUNKS == 2) ||
-                        (simd8x64<uint8_t>::NUM_CHUNKS == 4),
-                    "We support either two or four chunks per 64-byte block.");
-      if (simd8x64<uint8_t>::NUM_CHUNKS == 2) {
-        this->check_utf8_bytes(input.chunks[0], this->prev_input_block);
-        this->check_utf8_bytes(input.chunks[1], input.chunks[0]);
-      } else if (simd8x64<uint8_t>::NUM_CHUNKS == 4) {
-        this->check_utf8_bytes(input.chunks[0], this->prev_input_block);
-        this->check_utf8_bytes(input.chunks[1], input.chunks[0]);
-        this->check_utf8_bytes(input.chunks[2], input.chunks[1]);
-        this->check_utf8_bytes(input.chunks[3], input.chunks[2]);
+/**
+ * Validates a single block, e.g., short strings packed together.
+ */
+template <class checker>
+is_utf8_really_inline bool generic_validate_utf8_block(const uint8_t *block) {
+  checker c{};
+  simd::simd8x64<uint8_t> in(block);
+  c.check_next_input(in);
+  c.check_eof();
+  return !c.errors();
+}
+
+/**
+ * Validates many strings: one dispatch for the whole batch. Strings shorter
+ * than 64 bytes are packed several to a block (see pack_short_strings), and
+ * only validated one by one if their block is invalid.
+ */
+template <class checker>
+size_t generic_validate_utf8_batch(const char *const *bufs, const size_t *lens,
+                                   size_t count, uint8_t *results) {
+  size_t valid_count = 0;
+  size_t i = 0;
+  while (i < count) {
+    if (lens[i] >= 64) {
+      bool valid = generic_validate_utf8<checker>(
+          reinterpret_cast<const uint8_t *>(bufs[i]), lens[i]);
+      results[i] = uint8_t(valid);
+      valid_count += valid;
+      i++;
+      continue;
+    }
+    uint8_t block[64];
+    size_t end = internal::pack_short_strings(bufs, lens, i, count, block);
+    if (is_utf8_likely(generic_validate_utf8_block<checker>(block))) {
+      valid_count += end - i;
+      for (; i < end; i++) {
+        results[i] = 1;
       }
-      this->prev_incomplete =
-          is_incomplete(input.chunks[simd8x64<uint8_t>::NUM_CHUNKS - 1]);
-      this->prev_input_block = input.chunks[simd8x64<uint8_t>::NUM_CHUNKS - 1];
+      continue;
+    }
+    for (; i < end; i++) {
+      bool valid = generic_validate_utf8<checker>(
+          reinterpret_cast<const uint8_t *>(bufs[i]), lens[i]);
+      results[i] = uint8_t(valid);
+      valid_count += valid;
     }
   }
+  return valid_count;
+}
 
-  // do not forget to call check_eof!
-  is_utf8_really_inline bool errors() const {
-    return this->error.any_bits_set_anywhere();
+template <class checker>
+size_t generic_find_first_invalid_utf8(const char *const *bufs,
+                                       const size_t *lens, size_t count) {
+  size_t i = 0;
+  while (i < count) {
+    size_t end = i + 1;
+    if (lens[i] < 64) {
+      uint8_t block[64];
+      end = internal::pack_short_strings(bufs, lens, i, count, block);
+      if (is_utf8_likely(generic_validate_utf8_block<checker>(block))) {
+        i = end;
+        continue;
+      }
+    }
+    for (; i < end; i++) {
+      if (!generic_validate_utf8<checker>(
+              reinterpret_cast<const uint8_t *>(bufs[i]), lens[i])) {
+        return i;
+      }
+    }
   }
+  return count;
+}
 
-}; // struct utf8_checker
-} // namespace utf8_validation
-
-using utf8_validation::utf8_checker;
+/**
+ * Validates and converts to UTF-16 in a single pass: each block goes through
+ * the checker, then the characters it completes are converted while the block
+ * is still in cache (ASCII blocks are widened with SIMD instructions). A
+ * character that straddles two blocks is converted after the second one.
+ * Errors are only located, with a second pass, when the checker reports one.
+ */
+template <endianness big_endian, class checker>
+result generic_convert_utf8_to_utf16_with_errors(const char *input,
+                                                 size_t length,
+                                                 char16_t *utf16_output) {
+  checker c{};
+  char16_t *start = utf16_output;
+  size_t pos = 0; // the bytes before pos have been converted
+  size_t idx = 0; // the bytes before idx have been validated
+  for (; idx + 64 <= length; idx += 64) {
+    simd::simd8x64<uint8_t> in(reinterpret_cast<const uint8_t *>(input + idx));
+    c.check_next_input(in);
+    if (c.errors()) {
+      break;
+    }
+    if (pos == idx && in.is_ascii()) {
+      simd::simd8x64<int8_t> ascii(
+          reinterpret_cast<const int8_t *>(input + idx));
+      ascii.template store_ascii_as_utf16<big_endian>(utf16_output);
+      utf16_output += 64;
+      pos += 64;
+    } else {
+      pos += scalar::utf8_to_utf16::convert_valid<big_endian>(
+          input + pos, idx + 64 - pos, utf16_output);
+    }
+  }
+  if (!c.errors()) {
+    if (idx < length) {
+      uint8_t block[64];
+      std::memset(block, 0x20, 64);
+      std::memcpy(block, input + idx, length - idx);
+      simd::simd8x64<uint8_t> in(block);
+      c.check_next_input(in);
+    }
+    c.check_eof();
+    if (is_utf8_likely(!c.errors())) {
+      scalar::utf8_to_utf16::convert_valid<big_endian>(
+          input + pos, length - pos, utf16_output);
+      return result(error_code::SUCCESS, size_t(utf16_output - start));
+    }
+  }
+  return generic_validate_utf8_with_errors<checker>(
+      reinterpret_cast<const uint8_t *>(input), length);
+}
 
-} // unnamed namespace
-} // namespace westmere
-} // namespace is_utf8_internals
+is_utf8_really_inline size_t utf16_length_from_utf8(const char *in,
+                                                    size_t size) {
+  size_t pos = 0;
+  size_t count = 0;
+  for (; pos + 64 <= size; pos += 64) {
+    simd::simd8x64<int8_t> input(reinterpret_cast<const int8_t *>(in + pos));
+    uint64_t utf8_continuation_mask = input.lt(-65 + 1);
+    uint64_t utf8_4byte = input.gteq_unsigned(240);
+    count += 64 - internal::count_ones(utf8_continuation_mask) +
+             internal::count_ones(utf8_4byte);
+  }
+  return count +
+         scalar::utf8_to_utf16::utf16_length_from_utf8(in + pos, size - pos);
+}
 
-namespace is_utf8_internals {
-namespace westmere {
-namespace {
-namespace utf8_validation {
+/**
+ * Counts what is needed for the profile of a string. Only the non-ASCII blocks
+ * (already told apart by the checker) have bytes to count.
+ */
+struct utf8_profile_counters {
+  uint64_t above_latin1{0};
+  size_t continuation_bytes{0};
+  size_t four_byte_leading{0};
+  bool is_ascii{true};
+
+  is_utf8_really_inline void add(const simd::simd8x64<uint8_t> &in) {
+    if (in.is_ascii()) {
+      return;
+    }
+    is_ascii = false;
+    // U+0100 and above start with 0xC4 or more.
+    above_latin1 |= in.gteq_unsigned(0xC4);
+    continuation_bytes += internal::count_ones(in.in_range(0x80, 0xBF));
+    four_byte_leading += internal::count_ones(in.gteq_unsigned(0xF0));
+  }
+};
 
 /**
- * Validates that the string is actual UTF-8.
+ * Validates the string and, in the same loop, computes its profile.
  */
 template <class checker>
-bool generic_validate_utf8(const uint8_t *input, size_t length) {
+bool generic_validate_utf8_profile(const uint8_t *input, size_t length,
+                                   utf8_profile *profile) {
   checker c{};
+  utf8_profile_counters counters;
   buf_block_reader<64> reader(input, length);
   while (reader.has_full_block()) {
     simd::simd8x64<uint8_t> in(reader.full_block());
     c.check_next_input(in);
+    counters.add(in);
     reader.advance();
   }
+  // The padding is made of spaces: they are not counted.
   uint8_t block[64]{};
   reader.get_remainder(block);
   simd::simd8x64<uint8_t> in(block);
   c.check_next_input(in);
+  counters.add(in);
   reader.advance();
   c.check_eof();
-  return !c.errors();
+  if (c.errors()) {
+    return false;
+  }
+  profile->is_ascii = counters.is_ascii;
+  profile->is_latin1 = counters.above_latin1 == 0;
+  profile->code_points = length - counters.continuation_bytes;
+  profile->utf16_length = profile->code_points + counters.four_byte_leading;
+  return true;
 }
 
-bool generic_validate_utf8(const char *input, size_t length) {
-  return generic_validate_utf8<utf8_checker>(
-      reinterpret_cast<const uint8_t *>(input), length);
+} // namespace utf8_validation
+
+namespace utf16_validation {
+
+/**
+ * The only constraint on UTF-16 is that surrogates come in pairs: a high
+ * surrogate (D800...DBFF) must be immediately followed by a low surrogate
+ * (DC00...DFFF), and each low surrogate must follow a high surrogate. In other
+ * words, the high surrogates moved forward by one code unit must be exactly
+ * the low surrogates. The bitmasks have two bits per code unit, and the high
+ * surrogate ending a block is carried into the next block.
+ */
+struct utf16_checker {
+  uint64_t error{0};
+  uint64_t prev_high{0};
+
+  is_utf8_really_inline void
+  check_next_input(const simd::simd16x32<uint16_t> &in) {
+    uint64_t surrogates = in.in_range(0xD800, 0xDFFF);
+    if (is_utf8_likely((surrogates | prev_high) == 0)) {
+      return;
+    }
+    uint64_t high = in.in_range(0xD800, 0xDBFF);
+    uint64_t low = surrogates & ~high;
+    this->error |= low ^ ((high << 2) | prev_high);
+    this->prev_high = high >> 62;
+  }
+
+  // A high surrogate must not end the input.
+  is_utf8_really_inline void check_eof() { this->error |= this->prev_high; }
+
+  is_utf8_really_inline bool errors() const { return this->error != 0; }
+};
+
+template <endianness big_endian>
+bool generic_validate_utf16(const char16_t *input, size_t length) {
+  utf16_checker c{};
+  size_t pos = 0;
+  for (; pos + 32 <= length; pos += 32) {
+    simd::simd16x32<uint16_t> in(reinterpret_cast<const uint16_t *>(input + pos));
+    if (big_endian) {
+      in.swap_bytes();
+    }
+    c.check_next_input(in);
+  }
+  if (pos < length) {
+    // Zeros are not surrogates.
+    uint16_t block[32]{};
+    std::memcpy(block, input + pos, (length - pos) * sizeof(char16_t));
+    simd::simd16x32<uint16_t> in(block);
+    if (big_endian) {
+      in.swap_bytes();
+    }
+    c.check_next_input(in);
+  }
+  c.check_eof();
+  return !c.errors();
 }
 
-} // namespace utf8_validation
+} // namespace utf16_validation
 } // unnamed namespace
 } // namespace westmere
 } // namespace is_utf8_internals
@@ -6739,6 +11555,110 @@ implementation::validate_utf8(const char *buf, size_t len) const noexcept {
   return westmere::utf8_validation::generic_validate_utf8(buf, len);
 }
 
+implementation::validate_utf8_function
+implementation::get_validate_utf8_function() const noexcept {
+  return &westmere::utf8_validation::generic_validate_utf8;
+}
+
+is_utf8_warn_unused result implementation::validate_utf8_with_errors(
+    const char *buf, size_t len) const noexcept {
+  if (is_utf8_likely(westmere::utf8_validation::generic_validate_utf8(buf, len))) {
+    return result(error_code::SUCCESS, len);
+  }
+  return westmere::utf8_validation::generic_validate_utf8_with_errors(buf, len);
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf8_early_exit(const char *buf,
+                                         size_t len) const noexcept {
+  return westmere::utf8_validation::generic_validate_utf8_early_exit<
+      westmere::utf8_validation::utf8_checker>(
+      reinterpret_cast<const uint8_t *>(buf), len);
+}
+
+void implementation::utf8_stream_init(void *state) const noexcept {
+  westmere::utf8_validation::generic_utf8_stream_init<
+      westmere::utf8_validation::utf8_checker>(state);
+}
+
+is_utf8_warn_unused bool
+implementation::utf8_stream_update(void *state, const char *buf,
+                                   size_t len) const noexcept {
+  return westmere::utf8_validation::generic_utf8_stream_update<
+      westmere::utf8_validation::utf8_checker>(
+      state, reinterpret_cast<const uint8_t *>(buf), len);
+}
+
+is_utf8_warn_unused bool
+implementation::utf8_stream_finish(void *state, const char *buf,
+                                   size_t len) const noexcept {
+  return westmere::utf8_validation::generic_utf8_stream_finish<
+      westmere::utf8_validation::utf8_checker>(
+      state, reinterpret_cast<const uint8_t *>(buf), len);
+}
+
+size_t implementation::validate_utf8_batch(const char *const *bufs,
+                                           const size_t *lens, size_t count,
+                                           uint8_t *results) const noexcept {
+  return westmere::utf8_validation::generic_validate_utf8_batch<
+      westmere::utf8_validation::utf8_checker>(bufs, lens, count, results);
+}
+
+is_utf8_warn_unused size_t implementation::find_first_invalid_utf8(
+    const char *const *bufs, const size_t *lens, size_t count) const noexcept {
+  return westmere::utf8_validation::generic_find_first_invalid_utf8<
+      westmere::utf8_validation::utf8_checker>(bufs, lens, count);
+}
+
+is_utf8_warn_unused result implementation::convert_utf8_to_utf16le_with_errors(
+    const char *buf, size_t len, char16_t *utf16_output) const noexcept {
+  return westmere::utf8_validation::generic_convert_utf8_to_utf16_with_errors<
+      endianness::LITTLE, westmere::utf8_validation::utf8_checker>(buf, len,
+                                                                utf16_output);
+}
+
+is_utf8_warn_unused result implementation::convert_utf8_to_utf16be_with_errors(
+    const char *buf, size_t len, char16_t *utf16_output) const noexcept {
+  return westmere::utf8_validation::generic_convert_utf8_to_utf16_with_errors<
+      endianness::BIG, westmere::utf8_validation::utf8_checker>(buf, len,
+                                                             utf16_output);
+}
+
+is_utf8_warn_unused size_t implementation::utf16_length_from_utf8(
+    const char *buf, size_t len) const noexcept {
+  return westmere::utf8_validation::utf16_length_from_utf8(buf, len);
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf8_profile(const char *buf, size_t len,
+                                      utf8_profile *profile) const noexcept {
+  return westmere::utf8_validation::generic_validate_utf8_profile<
+      westmere::utf8_validation::utf8_checker>(
+      reinterpret_cast<const uint8_t *>(buf), len, profile);
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf16le(const char16_t *buf,
+                                 size_t len) const noexcept {
+  return westmere::utf16_validation::generic_validate_utf16<endianness::LITTLE>(
+      buf, len);
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf16be(const char16_t *buf,
+                                 size_t len) const noexcept {
+  return westmere::utf16_validation::generic_validate_utf16<endianness::BIG>(buf,
+                                                                        len);
+}
+
+is_utf8_warn_unused bool
+implementation::validate_utf8_padded(const char *buf,
+                                     size_t len) const noexcept {
+  return westmere::utf8_validation::generic_validate_utf8_padded<
+      westmere::utf8_validation::utf8_checker>(
+      reinterpret_cast<const uint8_t *>(buf), len);
+}
+
 } // namespace westmere
 } // namespace is_utf8_internals
 
@@ -6746,10 +11666,299 @@ IS_UTF8_UNTARGET_REGION
 
 #endif
 
+#if IS_UTF8_IS_X86_64
+#include <emmintrin.h> // SSE2, always available on x64
+#elif IS_UTF8_IS_ARM64
+#include <arm_neon.h>
+#endif
+
+namespace is_utf8_internals {
+namespace internal {
+// Whether the len bytes are ASCII, for short inputs. The loads overlap rather
+// than going byte by byte at the end.
+is_utf8_really_inline bool is_ascii_short(const char *buf, size_t len) {
+  if (len >= 16) {
+#if IS_UTF8_IS_X86_64
+    __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + len - 16));
+    for (size_t pos = 0; pos + 16 < len; pos += 16) {
+      bytes = _mm_or_si128(
+          bytes, _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + pos)));
+    }
+    return _mm_movemask_epi8(bytes) == 0;
+#elif IS_UTF8_IS_ARM64
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(buf);
+    uint8x16_t bytes = vld1q_u8(data + len - 16);
+    for (size_t pos = 0; pos + 16 < len; pos += 16) {
+      bytes = vorrq_u8(bytes, vld1q_u8(data + pos));
+    }
+    return vmaxvq_u8(bytes) < 0x80;
+#endif
+  }
+  uint64_t bits = 0;
+  if (len >= 8) {
+    uint64_t word;
+    for (size_t pos = 0; pos + 8 < len; pos += 8) {
+      std::memcpy(&word, buf + pos, 8);
+      bits |= word;
+    }
+    std::memcpy(&word, buf + len - 8, 8);
+    bits |= word;
+  } else if (len >= 4) {
+    uint32_t word;
+    std::memcpy(&word, buf, 4);
+    bits = word;
+    std::memcpy(&word, buf + len - 4, 4);
+    bits |= word;
+  } else {
+    for (size_t pos = 0; pos < len; pos++) {
+      bits |= uint8_t(buf[pos]);
+    }
+  }
+  return (bits & 0x8080808080808080) == 0;
+}
+
+// is_utf8 for inputs of fewer than IS_UTF8_MEDIUM_INPUT_LENGTH bytes.
+is_utf8_really_inline bool validate_utf8_by_size_class(const char *buf,
+                                                       size_t len) {
+  if (is_ascii_short(buf, len)) {
+    return true;
+  }
+#if IS_UTF8_SHORT_INPUT_LENGTH > 0
+  if (len < IS_UTF8_SHORT_INPUT_LENGTH) {
+    return scalar::utf8::validate_with_errors(buf, len).error ==
+           error_code::SUCCESS;
+  }
+#endif
+  return cached_medium_validate_utf8_function()(buf, len);
+}
+} // namespace internal
+} // namespace is_utf8_internals
+
 IS_UTF8_POP_DISABLE_WARNINGS
 
+struct is_utf8_stream {
+  // Opaque state of the implementation, e.g., the SIMD registers carried from
+  // one block to the next.
+  char state[is_utf8_internals::internal::utf8_stream_state_size];
+  // Bytes received but not yet validated, fewer than one block.
+  char block[64];
+  size_t block_length;
+  const is_utf8_internals::implementation *impl;
+  bool valid;
+};
+
+static_assert(int(is_utf8_internals::error_code::SURROGATE) ==
+                      int(IS_UTF8_SURROGATE) &&
+                  int(is_utf8_internals::error_code::OTHER) ==
+                      int(IS_UTF8_OTHER),
+              "the public error codes must match the internal ones");
+
 extern "C" {
   bool is_utf8(const char *src, size_t len) {
-    return is_utf8_internals::validate_utf8(src, len);
+#if IS_UTF8_MEDIUM_INPUT_LENGTH > 0
+    if (len < IS_UTF8_MEDIUM_INPUT_LENGTH &&
+        is_utf8_internals::internal::by_size_class()) {
+      return is_utf8_internals::internal::validate_utf8_by_size_class(src,
+                                                                      len);
+    }
+#endif
+    return is_utf8_internals::internal::cached_validate_utf8_function()(src,
+                                                                         len);
+  }
+  const char *is_utf8_autotune(void) {
+    using namespace is_utf8_internals;
+    // A forced implementation is pinned.
+    if (internal::forced_implementation_name() == nullptr) {
+      get_active_implementation() = internal::autotune();
+      internal::refresh_validate_utf8_function();
+    }
+    return internal::get_resolved_active_implementation()->name().c_str();
+  }
+  size_t is_utf8_implementation_count(void) {
+    return is_utf8_internals::get_available_implementations().size();
+  }
+  const char *is_utf8_implementation_name(size_t index) {
+    const is_utf8_internals::internal::available_implementation_list &list =
+        is_utf8_internals::get_available_implementations();
+    return index < list.size() ? list.begin()[index]->name().c_str() : nullptr;
+  }
+  const char *is_utf8_implementation_description(size_t index) {
+    const is_utf8_internals::internal::available_implementation_list &list =
+        is_utf8_internals::get_available_implementations();
+    return index < list.size() ? list.begin()[index]->description().c_str()
+                               : nullptr;
+  }
+  bool is_utf8_implementation_supported(size_t index) {
+    const is_utf8_internals::internal::available_implementation_list &list =
+        is_utf8_internals::get_available_implementations();
+    return index < list.size() &&
+           list.begin()[index]->supported_by_runtime_system();
+  }
+  const char *is_utf8_active_implementation(void) {
+    return is_utf8_internals::internal::get_resolved_active_implementation()
+        ->name()
+        .c_str();
+  }
+  const char *is_utf8_medium_implementation(void) {
+    using namespace is_utf8_internals;
+    const implementation *active =
+        internal::get_resolved_active_implementation();
+    const implementation *medium = internal::medium_implementation;
+    return (medium != nullptr ? medium : active)->name().c_str();
+  }
+  bool is_utf8_set_implementation(const char *name) {
+    using namespace is_utf8_internals;
+    if (name == nullptr) {
+      return false;
+    }
+    const implementation *impl = get_available_implementations()[name];
+    if (impl == nullptr || !impl->supported_by_runtime_system()) {
+      return false;
+    }
+    // The kernel that autotuning picked for medium inputs goes too.
+    internal::medium_implementation = nullptr;
+    get_active_implementation() = impl;
+    internal::refresh_validate_utf8_function();
+    return true;
+  }
+  is_utf8_result is_utf8_with_errors(const char *src, size_t len) {
+    is_utf8_internals::result r =
+        is_utf8_internals::validate_utf8_with_errors(src, len);
+    return is_utf8_result{static_cast<is_utf8_error_code>(r.error), r.count};
+  }
+
+  is_utf8_stream *is_utf8_stream_init(void) {
+    is_utf8_stream *stream = new (std::nothrow) is_utf8_stream;
+    if (stream == nullptr) {
+      return nullptr;
+    }
+    // Resolve the implementation detected on first use now: the state layout
+    // belongs to one implementation and must not change in the middle of a
+    // stream.
+    stream->impl =
+        is_utf8_internals::internal::get_resolved_active_implementation();
+    stream->impl->utf8_stream_init(stream->state);
+    stream->block_length = 0;
+    stream->valid = true;
+    return stream;
+  }
+
+  bool is_utf8_stream_update(is_utf8_stream *stream, const char *src,
+                             size_t len) {
+    if (!stream->valid) {
+      return false;
+    }
+    if (len == 0) {
+      // src may be null: nothing to copy.
+      return true;
+    }
+    if (stream->block_length != 0) {
+      // Complete the block left over by the previous call.
+      size_t missing = sizeof(stream->block) - stream->block_length;
+      if (len < missing) {
+        std::memcpy(stream->block + stream->block_length, src, len);
+        stream->block_length += len;
+        return true;
+      }
+      std::memcpy(stream->block + stream->block_length, src, missing);
+      stream->valid = stream->impl->utf8_stream_update(
+          stream->state, stream->block, sizeof(stream->block));
+      stream->block_length = 0;
+      src += missing;
+      len -= missing;
+    }
+    // Whole blocks are validated in place, only the tail is kept.
+    size_t whole = len / sizeof(stream->block) * sizeof(stream->block);
+    if (whole != 0 && stream->valid) {
+      stream->valid = stream->impl->utf8_stream_update(stream->state, src, whole);
+    }
+    std::memcpy(stream->block, src + whole, len - whole);
+    stream->block_length = len - whole;
+    return stream->valid;
+  }
+
+  is_utf8_result is_utf8_to_utf16le(const char *src, size_t len,
+                                    char16_t *out) {
+    is_utf8_internals::result r =
+        is_utf8_internals::convert_utf8_to_utf16le_with_errors(src, len, out);
+    return is_utf8_result{static_cast<is_utf8_error_code>(r.error), r.count};
+  }
+
+  is_utf8_result is_utf8_to_utf16be(const char *src, size_t len,
+                                    char16_t *out) {
+    is_utf8_internals::result r =
+        is_utf8_internals::convert_utf8_to_utf16be_with_errors(src, len, out);
+    return is_utf8_result{static_cast<is_utf8_error_code>(r.error), r.count};
+  }
+
+  size_t is_utf8_utf16_length(const char *src, size_t len) {
+    return is_utf8_internals::utf16_length_from_utf8(src, len);
+  }
+
+  bool is_utf8_early_exit(const char *src, size_t len) {
+    return is_utf8_internals::get_active_implementation()
+        ->validate_utf8_early_exit(src, len);
+  }
+
+  bool is_utf8_padded(const char *src, size_t len) {
+    // Short strings are read in place by the size classes already.
+#if IS_UTF8_MEDIUM_INPUT_LENGTH > 0
+    if (len < IS_UTF8_MEDIUM_INPUT_LENGTH &&
+        is_utf8_internals::internal::by_size_class()) {
+      return is_utf8_internals::internal::validate_utf8_by_size_class(src,
+                                                                      len);
+    }
+#endif
+    return is_utf8_internals::get_active_implementation()->validate_utf8_padded(
+        src, len);
+  }
+
+  bool is_utf16le_valid(const char16_t *src, size_t len) {
+    return is_utf8_internals::get_active_implementation()->validate_utf16le(
+        src, len);
+  }
+
+  bool is_utf16be_valid(const char16_t *src, size_t len) {
+    return is_utf8_internals::get_active_implementation()->validate_utf16be(
+        src, len);
+  }
+
+  bool is_utf8_profile(const char *src, size_t len,
+                       is_utf8_string_profile *profile) {
+    is_utf8_internals::utf8_profile p;
+    if (!is_utf8_internals::get_active_implementation()->validate_utf8_profile(
+            src, len, &p)) {
+      return false;
+    }
+    profile->is_ascii = p.is_ascii;
+    profile->is_latin1 = p.is_latin1;
+    profile->code_points = p.code_points;
+    profile->utf16_length = p.utf16_length;
+    return true;
+  }
+
+  bool is_utf8_parallel(const char *src, size_t len, size_t nthreads) {
+    return is_utf8_internals::validate_utf8_parallel(src, len, nthreads);
+  }
+
+  size_t is_utf8_batch(const char *const *ptrs, const size_t *lens, size_t n,
+                       uint8_t *results) {
+    return is_utf8_internals::get_active_implementation()->validate_utf8_batch(
+        ptrs, lens, n, results);
+  }
+
+  size_t is_utf8_batch_first_invalid(const char *const *ptrs,
+                                     const size_t *lens, size_t n) {
+    return is_utf8_internals::get_active_implementation()
+        ->find_first_invalid_utf8(ptrs, lens, n);
+  }
+
+  bool is_utf8_stream_finish(is_utf8_stream *stream) {
+    bool valid = stream->valid &&
+                 stream->impl->utf8_stream_finish(stream->state, stream->block,
+                                                  stream->block_length);
+    delete stream;
+    return valid;
   }
 }
@@ -1,10 +1,13 @@
 #include "is_utf8.h"
+#include "is_utf8_api.h"
+#include <algorithm>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <random>
+#include <string>
 #include <vector>
 
 bool hard_coded() {
@@ -225,6 +228,37 @@ std::vector<uint8_t> random_utf8::generate(size_t output_bytes, long seed) {
   return generate(output_bytes);
 }
 
+// Whether the kernel of the given name is compiled in and supported by the
+// processor.
+bool is_supported(const char *name) {
+  for (size_t i = 0; i < is_utf8_implementation_count(); i++) {
+    if (strcmp(is_utf8_implementation_name(i), name) == 0) {
+      return is_utf8_implementation_supported(i);
+    }
+  }
+  return false;
+}
+
+// Sets the kernel of the given name, if the processor supports it, and puts
+// the previous one back when it goes out of scope: for the tests of code that
+// only one kernel has.
+class kernel_scope {
+public:
+  explicit kernel_scope(const char *name)
+      : previous(is_utf8_active_implementation()),
+        set(is_utf8_set_implementation(name)) {
+    if (!set) {
+      std::cout << "skipped: " << name << " is not available" << std::endl;
+    }
+  }
+  ~kernel_scope() { is_utf8_set_implementation(previous.c_str()); }
+  bool is_set() const { return set; }
+
+private:
+  const std::string previous;
+  const bool set;
+};
+
 // credit: based on code from Google Fuchsia (Apache Licensed)
 bool reference_validate_utf8(const char *buf, size_t len) noexcept {
   const uint8_t *data = (const uint8_t *)buf;
@@ -332,7 +366,941 @@ bool brute_force() {
   return true;
 }
 
+// The reported position must be the end of the longest valid prefix.
+bool check_with_errors(const char *buf, size_t len) {
+  is_utf8_result r = is_utf8_with_errors(buf, len);
+  bool valid = reference_validate_utf8(buf, len);
+  if (valid) {
+    return r.error == IS_UTF8_SUCCESS && r.count == len;
+  }
+  if (r.error == IS_UTF8_SUCCESS || r.count >= len) {
+    return false;
+  }
+  if (!reference_validate_utf8(buf, r.count)) {
+    return false;
+  }
+  for (size_t end = r.count + 1; end <= len && end <= r.count + 4; end++) {
+    if (reference_validate_utf8(buf, end)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool with_errors() {
+  std::cout << "with errors tests." << std::endl;
+  struct {
+    const char *input;
+    is_utf8_error_code error;
+    size_t count;
+  } cases[] = {
+      {"abc", IS_UTF8_SUCCESS, 3},
+      {"ab\xc3\x28", IS_UTF8_TOO_SHORT, 2},
+      {"\xa0\xa1", IS_UTF8_TOO_LONG, 0},
+      {"a\xc0\x9f", IS_UTF8_OVERLONG, 1},
+      {"\xed\xa0\x81", IS_UTF8_SURROGATE, 0},
+      {"\xf4\x90\x80\x80", IS_UTF8_TOO_LARGE, 0},
+      {"\xf8\x90\x80\x80\x80", IS_UTF8_HEADER_BITS, 0},
+      {"123456789012345\xed", IS_UTF8_TOO_SHORT, 15},
+  };
+  for (const auto &c : cases) {
+    is_utf8_result r = is_utf8_with_errors(c.input, std::strlen(c.input));
+    if (r.error != c.error || r.count != c.count) {
+      std::cerr << "bug: " << c.input << " " << r.error << " " << r.count
+                << std::endl;
+      return false;
+    }
+  }
+  uint32_t seed{4321};
+  random_utf8 gen_1_2_3_4(seed, 1, 1, 1, 1);
+  for (size_t i = 0; i < 1000; i++) {
+    auto UTF8 = gen_1_2_3_4.generate(rand() % 1024);
+    if (!check_with_errors((const char *)UTF8.data(), UTF8.size())) {
+      std::cerr << "bug" << std::endl;
+      return false;
+    }
+    if (UTF8.empty()) {
+      continue;
+    }
+    for (size_t flip = 0; flip < 100; ++flip) {
+      const int bitflip{1 << (rand() % 8)};
+      UTF8[rand() % UTF8.size()] = uint8_t(bitflip);
+      if (!check_with_errors((const char *)UTF8.data(), UTF8.size())) {
+        std::cerr << "bug" << std::endl;
+        return false;
+      }
+    }
+  }
+  printf("Success.\n");
+  return true;
+}
+
+// Feed the input in random pieces, the verdict must match is_utf8.
+bool check_stream(const char *buf, size_t len) {
+  is_utf8_stream *stream = is_utf8_stream_init();
+  size_t pos = 0;
+  while (pos < len) {
+    size_t piece = std::min<size_t>(size_t(rand() % 200), len - pos);
+    is_utf8_stream_update(stream, buf + pos, piece);
+    pos += piece;
+  }
+  return is_utf8_stream_finish(stream) == is_utf8(buf, len);
+}
+
+bool stream() {
+  std::cout << "stream tests." << std::endl;
+  uint32_t seed{1111};
+  random_utf8 gen_1_2_3_4(seed, 1, 1, 1, 1);
+  for (size_t i = 0; i < 1000; i++) {
+    auto UTF8 = gen_1_2_3_4.generate(rand() % 4096);
+    if (!check_stream((const char *)UTF8.data(), UTF8.size())) {
+      std::cerr << "bug" << std::endl;
+      return false;
+    }
+    if (UTF8.empty()) {
+      continue;
+    }
+    for (size_t flip = 0; flip < 10; ++flip) {
+      const int bitflip{1 << (rand() % 8)};
+      UTF8[rand() % UTF8.size()] = uint8_t(bitflip);
+      if (!check_stream((const char *)UTF8.data(), UTF8.size())) {
+        std::cerr << "bug" << std::endl;
+        return false;
+      }
+    }
+  }
+  // A character cut at the very end of the stream.
+  is_utf8_stream *truncated = is_utf8_stream_init();
+  if (!is_utf8_stream_update(truncated, "a\xe2\x82", 3) ||
+      is_utf8_stream_finish(truncated)) {
+    std::cerr << "bug" << std::endl;
+    return false;
+  }
+  // Empty pieces, which may be null, between the pieces of a character.
+  is_utf8_stream *empty = is_utf8_stream_init();
+  if (!is_utf8_stream_update(empty, nullptr, 0) ||
+      !is_utf8_stream_update(empty, "a\xe2", 2) ||
+      !is_utf8_stream_update(empty, nullptr, 0) ||
+      !is_utf8_stream_update(empty, "\x82\xac", 2) ||
+      !is_utf8_stream_finish(empty)) {
+    std::cerr << "bug: empty pieces" << std::endl;
+    return false;
+  }
+  printf("Success.\n");
+  return true;
+}
+
+bool parallel() {
+  std::cout << "parallel tests." << std::endl;
+  uint32_t seed{2222};
+  random_utf8 gen_1_2_3_4(seed, 1, 1, 1, 1);
+  auto UTF8 = gen_1_2_3_4.generate(8 << 20);
+  const char *buf = (const char *)UTF8.data();
+  for (size_t threads = 0; threads <= 8; threads++) {
+    if (!is_utf8_parallel(buf, UTF8.size(), threads)) {
+      std::cerr << "bug" << std::endl;
+      return false;
+    }
+  }
+  for (size_t flip = 0; flip < 100; ++flip) {
+    auto copy = UTF8;
+    // errors near the boundaries between the ranges matter the most
+    size_t range = copy.size() / (1 + rand() % 8);
+    size_t pos = (range * size_t(rand() % 8) + size_t(rand() % 8)) % copy.size();
+    copy[pos] = uint8_t(1 << (rand() % 8));
+    const char *b = (const char *)copy.data();
+    if (is_utf8_parallel(b, copy.size(), size_t(1 + rand() % 8)) !=
+        is_utf8(b, copy.size())) {
+      std::cerr << "bug" << std::endl;
+      return false;
+    }
+  }
+  printf("Success.\n");
+  return true;
+}
+
+bool batch() {
+  std::cout << "batch tests." << std::endl;
+  uint32_t seed{3333};
+  random_utf8 gen_1_2_3_4(seed, 1, 1, 1, 1);
+  for (size_t trial = 0; trial < 100; trial++) {
+    std::vector<std::vector<uint8_t>> strings;
+    size_t n = size_t(rand() % 300);
+    for (size_t i = 0; i < n; i++) {
+      strings.push_back(gen_1_2_3_4.generate(size_t(rand() % 200)));
+      if (!strings.back().empty() && rand() % 4 == 0) {
+        strings.back()[rand() % strings.back().size()] =
+            uint8_t(1 << (rand() % 8));
+      }
+    }
+    std::vector<const char *> ptrs;
+    std::vector<size_t> lens;
+    for (const auto &str : strings) {
+      ptrs.push_back((const char *)str.data());
+      lens.push_back(str.size());
+    }
+    std::vector<uint8_t> results(n);
+    size_t valid_count =
+        is_utf8_batch(ptrs.data(), lens.data(), n, results.data());
+    size_t first_invalid = is_utf8_batch_first_invalid(ptrs.data(), lens.data(), n);
+    size_t expected_valid_count = 0;
+    size_t expected_first_invalid = n;
+    for (size_t i = 0; i < n; i++) {
+      bool valid = is_utf8(ptrs[i], lens[i]);
+      if (results[i] != uint8_t(valid)) {
+        std::cerr << "bug" << std::endl;
+        return false;
+      }
+      expected_valid_count += valid;
+      if (!valid && expected_first_invalid == n) {
+        expected_first_invalid = i;
+      }
+    }
+    if (valid_count != expected_valid_count ||
+        first_invalid != expected_first_invalid) {
+      std::cerr << "bug" << std::endl;
+      return false;
+    }
+  }
+  // Characters cut between neighbours: the strings are packed several to a
+  // block, but each one must be invalid on its own.
+  {
+    const char *ptrs[] = {"abc\xC3", "\xA9xyz", "\xE2\x82", "\xAC"};
+    const size_t lens[] = {4, 4, 2, 1};
+    uint8_t results[4];
+    if (is_utf8_batch(ptrs, lens, 4, results) != 0 ||
+        is_utf8_batch_first_invalid(ptrs, lens, 4) != 0) {
+      std::cerr << "bug: characters cut between strings" << std::endl;
+      return false;
+    }
+    for (size_t i = 0; i < 4; i++) {
+      if (results[i] != 0) {
+        std::cerr << "bug: string " << i << " is valid" << std::endl;
+        return false;
+      }
+    }
+  }
+  // One string of each length below 64, starting with a character, valid
+  // when ending with a whole character, invalid when ending with a cut one:
+  // every length that is copied to the blocks.
+  for (size_t cut = 0; cut < 2; cut++) {
+    std::vector<std::string> strings;
+    std::vector<const char *> ptrs;
+    std::vector<size_t> lens;
+    for (size_t len = 0; len < 64; len++) {
+      std::string str(len, 'a');
+      if (cut && len >= 1) {
+        str[len - 1] = char(0xC3);
+      } else if (len >= 2) {
+        str[len - 2] = char(0xC3);
+        str[len - 1] = char(0xA9);
+      }
+      if (len >= 4) {
+        str[0] = char(0xC3);
+        str[1] = char(0xA9);
+      }
+      strings.push_back(str);
+    }
+    for (const std::string &str : strings) {
+      ptrs.push_back(str.data());
+      lens.push_back(str.size());
+    }
+    std::vector<uint8_t> results(strings.size());
+    is_utf8_batch(ptrs.data(), lens.data(), strings.size(), results.data());
+    for (size_t len = 0; len < 64; len++) {
+      const bool valid = !cut || len == 0;
+      if (results[len] != uint8_t(valid)) {
+        std::cerr << "bug: length " << len << (cut ? ", cut" : "")
+                  << std::endl;
+        return false;
+      }
+    }
+  }
+  printf("Success.\n");
+  return true;
+}
+
+// Reference conversion of a valid UTF-8 string to UTF-16LE.
+std::vector<char16_t> reference_utf16le(const uint8_t *data, size_t len) {
+  std::vector<char16_t> output;
+  size_t pos = 0;
+  while (pos < len) {
+    uint32_t code_point;
+    if (data[pos] < 0x80) {
+      code_point = data[pos];
+      pos += 1;
+    } else if (data[pos] < 0xe0) {
+      code_point = (data[pos] & 0x1f) << 6 | (data[pos + 1] & 0x3f);
+      pos += 2;
+    } else if (data[pos] < 0xf0) {
+      code_point = (data[pos] & 0x0f) << 12 | (data[pos + 1] & 0x3f) << 6 |
+                   (data[pos + 2] & 0x3f);
+      pos += 3;
+    } else {
+      code_point = (data[pos] & 0x07) << 18 | (data[pos + 1] & 0x3f) << 12 |
+                   (data[pos + 2] & 0x3f) << 6 | (data[pos + 3] & 0x3f);
+      pos += 4;
+    }
+    if (code_point >= 0x10000) {
+      code_point -= 0x10000;
+      output.push_back(char16_t(0xd800 + (code_point >> 10)));
+      output.push_back(char16_t(0xdc00 + (code_point & 0x3ff)));
+    } else {
+      output.push_back(char16_t(code_point));
+    }
+  }
+  return output;
+}
+
+// Valid inputs must be converted as the reference does, invalid ones must
+// report the error of is_utf8_with_errors.
+bool check_utf16(const std::vector<uint8_t> &input) {
+  const char *buf = (const char *)input.data();
+  size_t len = input.size();
+  size_t utf16_length = is_utf8_utf16_length(buf, len);
+  std::vector<char16_t> le(utf16_length + 1, u'!');
+  std::vector<char16_t> be(utf16_length + 1, u'!');
+  is_utf8_result r_le = is_utf8_to_utf16le(buf, len, le.data());
+  is_utf8_result r_be = is_utf8_to_utf16be(buf, len, be.data());
+  if (le[utf16_length] != u'!' || be[utf16_length] != u'!') {
+    return false; // written past the announced length
+  }
+  is_utf8_result expected = is_utf8_with_errors(buf, len);
+  if (expected.error != IS_UTF8_SUCCESS) {
+    return r_le.error == expected.error && r_le.count == expected.count &&
+           r_be.error == expected.error && r_be.count == expected.count;
+  }
+  std::vector<char16_t> reference = reference_utf16le(input.data(), len);
+  if (r_le.error != IS_UTF8_SUCCESS || r_be.error != IS_UTF8_SUCCESS ||
+      utf16_length != reference.size() || r_le.count != utf16_length ||
+      r_be.count != utf16_length) {
+    return false;
+  }
+  for (size_t i = 0; i < utf16_length; i++) {
+    if (le[i] != reference[i] ||
+        be[i] != char16_t((reference[i] >> 8) | (reference[i] << 8))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool utf16() {
+  std::cout << "utf16 tests." << std::endl;
+  uint32_t seed{5555};
+  random_utf8 gen_1_2_3_4(seed, 1, 1, 1, 1);
+  random_utf8 gen_ascii(seed, 1, 0, 0, 0);
+  for (size_t i = 0; i < 1000; i++) {
+    // ASCII runs take another path than the other characters
+    auto UTF8 = gen_ascii.generate(rand() % 256);
+    auto tail = gen_1_2_3_4.generate(rand() % 1024);
+    UTF8.insert(UTF8.end(), tail.begin(), tail.end());
+    if (!check_utf16(UTF8)) {
+      std::cerr << "bug" << std::endl;
+      return false;
+    }
+    if (UTF8.empty()) {
+      continue;
+    }
+    for (size_t flip = 0; flip < 10; ++flip) {
+      const int bitflip{1 << (rand() % 8)};
+      UTF8[rand() % UTF8.size()] = uint8_t(bitflip);
+      if (!check_utf16(UTF8)) {
+        std::cerr << "bug" << std::endl;
+        return false;
+      }
+    }
+  }
+  printf("Success.\n");
+  return true;
+}
+
+// The profile must match the one computed from the reference conversion.
+bool check_profile(const std::vector<uint8_t> &input) {
+  const char *buf = (const char *)input.data();
+  is_utf8_string_profile profile;
+  bool valid = is_utf8_profile(buf, input.size(), &profile);
+  if (valid != is_utf8(buf, input.size())) {
+    return false;
+  }
+  if (!valid) {
+    return true;
+  }
+  std::vector<char16_t> utf16 = reference_utf16le(input.data(), input.size());
+  size_t code_points = 0;
+  char16_t max_unit = 0;
+  for (char16_t unit : utf16) {
+    code_points += (unit & 0xfc00) != 0xdc00; // not a low surrogate
+    max_unit = std::max(max_unit, unit);
+  }
+  return profile.is_ascii == (max_unit < 0x80) &&
+         profile.is_latin1 == (max_unit < 0x100) &&
+         profile.code_points == code_points &&
+         profile.utf16_length == utf16.size();
+}
+
+bool profile() {
+  std::cout << "profile tests." << std::endl;
+  uint32_t seed{6666};
+  random_utf8 gen_ascii(seed, 1, 0, 0, 0);
+  random_utf8 gen_1_2(seed, 8, 1, 0, 0);
+  random_utf8 gen_1_2_3_4(seed, 1, 1, 1, 1);
+  random_utf8 *generators[] = {&gen_ascii, &gen_1_2, &gen_1_2_3_4};
+  for (size_t i = 0; i < 3000; i++) {
+    auto UTF8 = generators[i % 3]->generate(rand() % 1024);
+    if (!check_profile(UTF8)) {
+      std::cerr << "bug" << std::endl;
+      return false;
+    }
+    if (UTF8.empty()) {
+      continue;
+    }
+    UTF8[rand() % UTF8.size()] = uint8_t(1 << (rand() % 8));
+    if (!check_profile(UTF8)) {
+      std::cerr << "bug" << std::endl;
+      return false;
+    }
+  }
+  // Latin-1 but not ASCII: U+00E9 and U+00FF.
+  is_utf8_string_profile latin1;
+  if (!is_utf8_profile("caf\xc3\xa9 \xc3\xbf", 8, &latin1) ||
+      latin1.is_ascii || !latin1.is_latin1 || latin1.code_points != 6 ||
+      latin1.utf16_length != 6) {
+    std::cerr << "bug" << std::endl;
+    return false;
+  }
+  printf("Success.\n");
+  return true;
+}
+
+bool reference_validate_utf16(const std::vector<char16_t> &input) {
+  for (size_t i = 0; i < input.size(); i++) {
+    if (input[i] >= 0xdc00 && input[i] <= 0xdfff) {
+      return false;
+    }
+    if (input[i] >= 0xd800 && input[i] <= 0xdbff) {
+      if (i + 1 == input.size() || input[i + 1] < 0xdc00 ||
+          input[i + 1] > 0xdfff) {
+        return false;
+      }
+      i++;
+    }
+  }
+  return true;
+}
+
+bool check_utf16_validation(const std::vector<char16_t> &le) {
+  std::vector<char16_t> be(le.size());
+  for (size_t i = 0; i < le.size(); i++) {
+    be[i] = char16_t((le[i] >> 8) | (le[i] << 8));
+  }
+  bool expected = reference_validate_utf16(le);
+  return is_utf16le_valid(le.data(), le.size()) == expected &&
+         is_utf16be_valid(be.data(), be.size()) == expected;
+}
+
+bool utf16_validation() {
+  std::cout << "utf16 validation tests." << std::endl;
+  uint32_t seed{7777};
+  random_utf8 gen_1_2_3_4(seed, 1, 1, 1, 1);
+  for (size_t i = 0; i < 1000; i++) {
+    auto UTF8 = gen_1_2_3_4.generate(rand() % 1024);
+    std::vector<char16_t> utf16 = reference_utf16le(UTF8.data(), UTF8.size());
+    if (!check_utf16_validation(utf16)) {
+      std::cerr << "bug" << std::endl;
+      return false;
+    }
+    if (utf16.empty()) {
+      continue;
+    }
+    for (size_t flip = 0; flip < 10; ++flip) {
+      // mostly surrogates, some of them cut from their pair, across blocks
+      const char16_t units[] = {0xd800, 0xdbff, 0xdc00, 0xdfff, 0x0041};
+      utf16[rand() % utf16.size()] = units[rand() % 5];
+      if (!check_utf16_validation(utf16)) {
+        std::cerr << "bug" << std::endl;
+        return false;
+      }
+    }
+  }
+  // A pair straddling two blocks of 32 code units, a high surrogate at the end.
+  std::vector<char16_t> straddling(64, u'a');
+  straddling[31] = 0xd83d;
+  straddling[32] = 0xde00;
+  straddling[63] = 0xd83d;
+  if (!check_utf16_validation(straddling) ||
+      is_utf16le_valid(straddling.data(), 64) ||
+      !is_utf16le_valid(straddling.data(), 63)) {
+    std::cerr << "bug" << std::endl;
+    return false;
+  }
+  printf("Success.\n");
+  return true;
+}
+
+bool early_exit() {
+  std::cout << "early exit tests." << std::endl;
+  uint32_t seed{8888};
+  random_utf8 gen_1_2_3_4(seed, 1, 1, 1, 1);
+  for (size_t i = 0; i < 200; i++) {
+    // long enough to cross several checks
+    auto UTF8 = gen_1_2_3_4.generate(rand() % 20000);
+    const char *buf = (const char *)UTF8.data();
+    if (is_utf8_early_exit(buf, UTF8.size()) != is_utf8(buf, UTF8.size())) {
+      std::cerr << "bug" << std::endl;
+      return false;
+    }
+    if (UTF8.empty()) {
+      continue;
+    }
+    for (size_t flip = 0; flip < 10; ++flip) {
+      auto copy = UTF8;
+      copy[rand() % copy.size()] = uint8_t(1 << (rand() % 8));
+      buf = (const char *)copy.data();
+      if (is_utf8_early_exit(buf, copy.size()) != is_utf8(buf, copy.size())) {
+        std::cerr << "bug" << std::endl;
+        return false;
+      }
+    }
+  }
+  printf("Success.\n");
+  return true;
+}
+
+// Short inputs are validated by size class (inline scalar code, ASCII check),
+// at every length around the thresholds.
+bool size_classes() {
+  std::cout << "size classes tests." << std::endl;
+  // Before the tests that set the kernel.
+  const char *medium = is_utf8_medium_implementation();
+  const char *forced_medium = getenv("IS_UTF8_FORCE_MEDIUM_IMPLEMENTATION");
+  if (forced_medium != nullptr && strcmp(forced_medium, medium) != 0) {
+    std::cerr << "bug: " << medium << " instead of " << forced_medium
+              << std::endl;
+    return false;
+  }
+  uint32_t seed{9999};
+  random_utf8 gen_1_2_3_4(seed, 1, 1, 1, 1);
+  for (size_t len = 0; len <= 160; len++) {
+    // exactly len bytes, so that reading past them is caught by sanitizers
+    std::vector<char> ascii(len);
+    for (size_t i = 0; i < len; i++) {
+      ascii[i] = char(rand() % 128);
+    }
+    if (!is_utf8(ascii.data(), len)) {
+      std::cerr << "bug: ascii, length " << len << std::endl;
+      return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+      std::vector<char> copy(ascii);
+      copy[i] = char(0x80 | rand());
+      if (is_utf8(copy.data(), len) !=
+          reference_validate_utf8(copy.data(), len)) {
+        std::cerr << "bug: length " << len << ", byte " << i << std::endl;
+        return false;
+      }
+    }
+    for (size_t trial = 0; trial < 100; trial++) {
+      auto UTF8 = gen_1_2_3_4.generate(len);
+      std::vector<char> copy(UTF8.begin(), UTF8.end());
+      if (!copy.empty() && trial % 2 == 1) {
+        copy[rand() % copy.size()] = char(1 << (rand() % 8));
+      }
+      if (is_utf8(copy.data(), copy.size()) !=
+          reference_validate_utf8(copy.data(), copy.size())) {
+        std::cerr << "bug: length " << copy.size() << std::endl;
+        return false;
+      }
+    }
+  }
+  printf("Success.\n");
+  return true;
+}
+
+bool long_inputs() {
+  std::cout << "long inputs tests." << std::endl;
+  // The haswell kernel validates the two halves of long inputs in the same
+  // loop.
+  kernel_scope haswell("haswell");
+  if (!haswell.is_set()) {
+    return true;
+  }
+  uint32_t seed{4096};
+  random_utf8 gen_1_2_3_4(seed, 1, 1, 1, 1);
+  for (size_t len = 4096; len < 4096 + 512; len += 37) {
+    // Errors near the middle.
+    const size_t middle = len / 2 / 128 * 128;
+    for (size_t trial = 0; trial < 200; trial++) {
+      auto UTF8 = gen_1_2_3_4.generate(len);
+      std::vector<char> copy(UTF8.begin(), UTF8.end());
+      if (trial % 4 != 0) {
+        size_t i = middle - 96 + size_t(rand() % 192);
+        if (i < copy.size()) {
+          copy[i] = char(1 << (rand() % 8));
+        }
+      }
+      if (is_utf8(copy.data(), copy.size()) !=
+          reference_validate_utf8(copy.data(), copy.size())) {
+        std::cerr << "bug: length " << copy.size() << std::endl;
+        return false;
+      }
+    }
+    // A character across the middle, or cut at the middle, of ASCII.
+    for (size_t i = middle - 4; i <= middle; i++) {
+      std::vector<char> ascii(len, 'a');
+      const char emoji[] = "\xF0\x9F\x98\x80";
+      std::copy(emoji, emoji + 4, ascii.begin() + i);
+      if (!is_utf8(ascii.data(), len)) {
+        std::cerr << "bug: length " << len << ", character at " << i
+                  << std::endl;
+        return false;
+      }
+      ascii[i + 3] = 'a';
+      if (is_utf8(ascii.data(), len)) {
+        std::cerr << "bug: length " << len << ", cut character at " << i
+                  << std::endl;
+        return false;
+      }
+    }
+  }
+  printf("Success.\n");
+  return true;
+}
+
+// A character, a cut character or a stray continuation byte in a run of ASCII,
+// on each side of each block edge: the kernels skip the windows of ASCII blocks
+// without checking them one by one.
+bool ascii_runs(const char *kernel) {
+  std::cout << "ASCII runs tests on " << kernel << "." << std::endl;
+  kernel_scope scope(kernel);
+  if (!scope.is_set()) {
+    return false;
+  }
+  const std::string characters[] = {"\xC3\xA9", "\xE2\x82\xAC",
+                                    "\xF0\x9F\x98\x80"};
+  for (size_t len = 1024; len < 3072; len += 61) {
+    for (size_t edge = 64; edge < len; edge += 64) {
+      for (size_t i = edge - 4; i < edge + 2 && i < len; i++) {
+        for (const std::string &character : characters) {
+          if (i + character.size() > len) {
+            continue;
+          }
+          std::vector<char> ascii(len, 'a');
+          std::copy(character.begin(), character.end(), ascii.begin() + i);
+          if (!is_utf8(ascii.data(), len)) {
+            std::cerr << "bug: " << kernel << ", length " << len
+                      << ", character at " << i << std::endl;
+            return false;
+          }
+          ascii[i + character.size() - 1] = 'a';
+          if (is_utf8(ascii.data(), len)) {
+            std::cerr << "bug: " << kernel << ", length " << len
+                      << ", cut character at " << i << std::endl;
+            return false;
+          }
+        }
+        std::vector<char> ascii(len, 'a');
+        ascii[i] = char(0x80);
+        if (is_utf8(ascii.data(), len)) {
+          std::cerr << "bug: " << kernel << ", length " << len
+                    << ", continuation byte at " << i << std::endl;
+          return false;
+        }
+        // A leading byte, and a continuation byte after ASCII blocks.
+        const size_t j = (len / 64 - 1) * 64;
+        if (j >= i + 128) {
+          ascii[i] = char(0xC3);
+          ascii[j] = char(0xA9);
+          if (is_utf8(ascii.data(), len)) {
+            std::cerr << "bug: " << kernel << ", length " << len
+                      << ", leading byte at " << i << std::endl;
+            return false;
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
+
+bool ascii_runs() {
+  // Each kernel has its own pre-scan of the ASCII blocks.
+  for (size_t i = 0; i < is_utf8_implementation_count(); i++) {
+    if (is_utf8_implementation_supported(i) &&
+        !ascii_runs(is_utf8_implementation_name(i))) {
+      return false;
+    }
+  }
+  printf("Success.\n");
+  return true;
+}
+
+bool streams() {
+  std::cout << "streams tests." << std::endl;
+  // A character, a cut character or continuation bytes only around each
+  // quarter: the fallback kernel validates inputs of 256 bytes or more as
+  // four streams starting near the quarters.
+  kernel_scope fallback("fallback");
+  if (!fallback.is_set()) {
+    return true;
+  }
+  const std::string characters[] = {"\xC3\xA9", "\xE2\x82\xAC",
+                                    "\xF0\x9F\x98\x80"};
+  for (size_t len = 256; len < 1100; len += 29) {
+    for (size_t quarter = 1; quarter < 4; quarter++) {
+      const size_t q = len / 4 * quarter;
+      for (size_t i = q - 4; i < q + 4; i++) {
+        for (const std::string &character : characters) {
+          std::vector<char> ascii(len, 'a');
+          std::copy(character.begin(), character.end(), ascii.begin() + i);
+          if (!is_utf8(ascii.data(), len)) {
+            std::cerr << "bug: length " << len << ", character at " << i
+                      << std::endl;
+            return false;
+          }
+          ascii[i + character.size() - 1] = 'a';
+          if (is_utf8(ascii.data(), len)) {
+            std::cerr << "bug: length " << len << ", cut character at " << i
+                      << std::endl;
+            return false;
+          }
+          ascii[i + character.size() - 1] = character.back();
+          ascii[i] = char(0x80); // continuation bytes only
+          if (is_utf8(ascii.data(), len)) {
+            std::cerr << "bug: length " << len << ", continuation bytes at "
+                      << i << std::endl;
+            return false;
+          }
+        }
+      }
+    }
+  }
+  uint32_t seed{2560};
+  random_utf8 gen_1_2_3_4(seed, 1, 1, 1, 1);
+  for (size_t trial = 0; trial < 2000; trial++) {
+    auto UTF8 = gen_1_2_3_4.generate(256 + size_t(rand() % 1024));
+    if (trial % 2 == 1) {
+      UTF8[rand() % UTF8.size()] = uint8_t(1 << (rand() % 8));
+    }
+    const char *buf = (const char *)UTF8.data();
+    if (is_utf8(buf, UTF8.size()) !=
+        reference_validate_utf8(buf, UTF8.size())) {
+      std::cerr << "bug: length " << UTF8.size() << std::endl;
+      return false;
+    }
+  }
+  printf("Success.\n");
+  return true;
+}
+
+bool padded() {
+  std::cout << "padded tests." << std::endl;
+  uint32_t seed{6464};
+  random_utf8 gen_1_2_3_4(seed, 1, 1, 1, 1);
+  // Whatever follows the input must not matter: leading bytes, continuation
+  // bytes, ASCII.
+  const char paddings[] = {char(0xF0), char(0x80), 'a'};
+  for (size_t len = 0; len <= 300; len++) {
+    for (size_t trial = 0; trial < 30; trial++) {
+      auto UTF8 = gen_1_2_3_4.generate(len);
+      std::vector<char> input(UTF8.begin(), UTF8.end());
+      if (!input.empty() && trial % 2 == 1) {
+        input[rand() % input.size()] = char(1 << (rand() % 8));
+      }
+      const bool expected =
+          reference_validate_utf8(input.data(), input.size());
+      for (char padding : paddings) {
+        // exactly 64 bytes of padding, so that reading past them is caught
+        // by sanitizers
+        std::vector<char> padded(input);
+        padded.resize(input.size() + 64, padding);
+        if (is_utf8_padded(padded.data(), input.size()) != expected) {
+          std::cerr << "bug: length " << input.size() << std::endl;
+          return false;
+        }
+      }
+    }
+  }
+  printf("Success.\n");
+  return true;
+}
+
+// Last: the kernels may change.
+bool autotune() {
+  std::cout << "autotune tests." << std::endl;
+  const char *name = is_utf8_autotune();
+  if (name == nullptr || name[0] == '\0') {
+    std::cerr << "bug: no implementation" << std::endl;
+    return false;
+  }
+  const char *forced = getenv("IS_UTF8_FORCE_IMPLEMENTATION");
+  if (forced != nullptr && strcmp(forced, name) != 0) {
+    std::cerr << "bug: " << name << " instead of " << forced << std::endl;
+    return false;
+  }
+  const char *medium = is_utf8_medium_implementation();
+  if (!is_supported(medium)) {
+    std::cerr << "bug: " << medium << " for medium inputs" << std::endl;
+    return false;
+  }
+  std::cout << "autotuned: " << name << ", " << medium << " for medium inputs"
+            << std::endl;
+  // both size classes, valid and invalid
+  uint32_t seed{1010};
+  random_utf8 gen_1_2_3_4(seed, 1, 1, 1, 1);
+  for (size_t i = 0; i < 1000; i++) {
+    auto UTF8 = gen_1_2_3_4.generate(rand() % 300);
+    if (!UTF8.empty() && i % 2 == 1) {
+      UTF8[rand() % UTF8.size()] = uint8_t(1 << (rand() % 8));
+    }
+    const char *buf = (const char *)UTF8.data();
+    if (is_utf8(buf, UTF8.size()) !=
+        reference_validate_utf8(buf, UTF8.size())) {
+      std::cerr << "bug" << std::endl;
+      return false;
+    }
+  }
+  printf("Success.\n");
+  return true;
+}
+
+// After autotune: the kernel changes.
+bool implementations() {
+  std::cout << "implementations tests." << std::endl;
+  const size_t count = is_utf8_implementation_count();
+  if (count == 0 || is_utf8_implementation_name(count) != nullptr ||
+      is_utf8_implementation_description(count) != nullptr ||
+      is_utf8_implementation_supported(count)) {
+    std::cerr << "bug: list of implementations" << std::endl;
+    return false;
+  }
+  const std::string active = is_utf8_active_implementation();
+  if (is_utf8_set_implementation("no such kernel") ||
+      is_utf8_set_implementation(nullptr) ||
+      active != is_utf8_active_implementation()) {
+    std::cerr << "bug: unknown implementation" << std::endl;
+    return false;
+  }
+  uint32_t seed{2525};
+  random_utf8 gen_1_2_3_4(seed, 1, 1, 1, 1);
+  for (size_t index = 0; index < count; index++) {
+    const char *name = is_utf8_implementation_name(index);
+    if (name == nullptr ||
+        is_utf8_implementation_description(index) == nullptr) {
+      std::cerr << "bug: implementation " << index << std::endl;
+      return false;
+    }
+    if (is_utf8_set_implementation(name) !=
+        is_utf8_implementation_supported(index)) {
+      std::cerr << "bug: setting " << name << std::endl;
+      return false;
+    }
+    if (!is_utf8_implementation_supported(index)) {
+      continue;
+    }
+    std::cout << "implementation: " << name << std::endl;
+    if (strcmp(is_utf8_active_implementation(), name) != 0 ||
+        strcmp(is_utf8_medium_implementation(), name) != 0) {
+      std::cerr << "bug: " << is_utf8_active_implementation() << " and "
+                << is_utf8_medium_implementation() << " instead of " << name
+                << std::endl;
+      return false;
+    }
+    for (size_t i = 0; i < 1000; i++) {
+      auto UTF8 = gen_1_2_3_4.generate(rand() % 300);
+      if (!UTF8.empty() && i % 2 == 1) {
+        UTF8[rand() % UTF8.size()] = uint8_t(1 << (rand() % 8));
+      }
+      const char *buf = (const char *)UTF8.data();
+      if (is_utf8(buf, UTF8.size()) !=
+          reference_validate_utf8(buf, UTF8.size())) {
+        std::cerr << "bug: " << name << std::endl;
+        return false;
+      }
+    }
+  }
+  if (!is_utf8_set_implementation(active.c_str())) {
+    std::cerr << "bug: setting " << active << " back" << std::endl;
+    return false;
+  }
+  printf("Success.\n");
+  return true;
+}
+
+// After autotune: the kernel changes.
+bool cpp_api() {
+  std::cout << "C++ API tests." << std::endl;
+  const std::vector<is_utf8_api::implementation> list =
+      is_utf8_api::implementations();
+  if (list.size() != is_utf8_implementation_count()) {
+    std::cerr << "bug: list of implementations" << std::endl;
+    return false;
+  }
+  const std::string active = is_utf8_api::active_implementation();
+  if (is_utf8_api::set_implementation("no such kernel") ||
+      active != is_utf8_active_implementation()) {
+    std::cerr << "bug: unknown implementation" << std::endl;
+    return false;
+  }
+  for (size_t index = 0; index < list.size(); index++) {
+    const is_utf8_api::implementation &impl = list[index];
+    if (impl.name != is_utf8_implementation_name(index) ||
+        impl.description != is_utf8_implementation_description(index) ||
+        impl.supported != is_utf8_implementation_supported(index)) {
+      std::cerr << "bug: implementation " << index << std::endl;
+      return false;
+    }
+    if (is_utf8_api::set_implementation(impl.name) != impl.supported) {
+      std::cerr << "bug: setting " << impl.name << std::endl;
+      return false;
+    }
+    if (impl.supported &&
+        (is_utf8_api::active_implementation() != impl.name ||
+         is_utf8_api::medium_implementation() != impl.name)) {
+      std::cerr << "bug: " << is_utf8_api::active_implementation()
+                << " instead of " << impl.name << std::endl;
+      return false;
+    }
+  }
+  if (!is_utf8_api::set_implementation(active)) {
+    std::cerr << "bug: setting " << active << " back" << std::endl;
+    return false;
+  }
+  printf("Success.\n");
+  return true;
+}
+
 int main() {
-  bool results = hard_coded() & brute_force();
+  const char *forced = getenv("IS_UTF8_FORCE_IMPLEMENTATION");
+  if (forced != nullptr && !is_supported(forced)) {
+    std::cout << "skipped: " << forced << " is not available" << std::endl;
+    return 77; // SKIP_RETURN_CODE in tests/CMakeLists.txt
+  }
+  const char *forced_medium = getenv("IS_UTF8_FORCE_MEDIUM_IMPLEMENTATION");
+  if (forced_medium != nullptr && !is_supported(forced_medium)) {
+    std::cout << "skipped: " << forced_medium << " is not available"
+              << std::endl;
+    return 77;
+  }
+  // In this order (the operands of & are not sequenced): all of them, even
+  // after a failure.
+  bool results = hard_coded();
+  results &= brute_force();
+  results &= with_errors();
+  results &= stream();
+  results &= parallel();
+  results &= batch();
+  results &= utf16();
+  results &= profile();
+  results &= utf16_validation();
+  results &= early_exit();
+  results &= size_classes();
+  results &= long_inputs();
+  results &= ascii_runs();
+  results &= streams();
+  results &= padded();
+  results &= autotune();
+  results &= implementations();
+  results &= cpp_api();
   return results ? EXIT_SUCCESS : EXIT_FAILURE;
 }
\ No newline at end of file